@@ -0,0 +1,93 @@
+#pragma once
+#include <concepts>
+#include <optional>
+
+
+
+// Subtree summaries for augmented trees, see avl_tree::aggregate().
+// An augmentation is a class with a summary_type and three static functions:
+// - identity() is the summary of no elements.
+// - summarize(key, data) is the summary of a single element.
+// - combine(left, right) is the summary of the elements summarized by left followed by the ones summarized by right.
+// combine() has to be associative with identity() as its identity, since the tree groups elements however its shape happens to.
+// It doesn't have to be commutative, elements are always combined in key order.
+
+template<typename Augmentation, typename KeyType, typename DataType>
+concept augmentation_for = requires(const KeyType& key, const DataType& data, const typename Augmentation::summary_type& summary) {
+	{ Augmentation::identity() } -> std::convertible_to<typename Augmentation::summary_type>;
+	{ Augmentation::summarize(key, data) } -> std::convertible_to<typename Augmentation::summary_type>;
+	{ Augmentation::combine(summary, summary) } -> std::convertible_to<typename Augmentation::summary_type>;
+};
+
+// Default augmentation of the tree containers. Keeps no summaries, so the nodes don't grow.
+struct no_augmentation {
+	struct summary_type {};
+
+	static summary_type identity() {
+		return summary_type();
+	}
+	template<typename KeyType, typename DataType>
+	static summary_type summarize(const KeyType& key, const DataType& data) {
+		return summary_type();
+	}
+	static summary_type combine(const summary_type& left, const summary_type& right) {
+		return summary_type();
+	}
+};
+
+// Sum of the data of the elements. ValueType() is the sum of no elements.
+template<typename ValueType>
+struct sum_augmentation {
+	using summary_type = ValueType;
+
+	static summary_type identity() {
+		return ValueType();
+	}
+	template<typename KeyType>
+	static summary_type summarize(const KeyType& key, const ValueType& data) {
+		return data;
+	}
+	static summary_type combine(const summary_type& left, const summary_type& right) {
+		return left + right;
+	}
+};
+
+// Smallest data of the elements, std::nullopt if there are none. Compared with <.
+template<typename ValueType>
+struct min_augmentation {
+	using summary_type = std::optional<ValueType>;
+
+	static summary_type identity() {
+		return std::nullopt;
+	}
+	template<typename KeyType>
+	static summary_type summarize(const KeyType& key, const ValueType& data) {
+		return data;
+	}
+	static summary_type combine(const summary_type& left, const summary_type& right) {
+		if (!left || (right && *right < *left)) {
+			return right;
+		}
+		return left;
+	}
+};
+
+// Biggest data of the elements, std::nullopt if there are none. Compared with <.
+template<typename ValueType>
+struct max_augmentation {
+	using summary_type = std::optional<ValueType>;
+
+	static summary_type identity() {
+		return std::nullopt;
+	}
+	template<typename KeyType>
+	static summary_type summarize(const KeyType& key, const ValueType& data) {
+		return data;
+	}
+	static summary_type combine(const summary_type& left, const summary_type& right) {
+		if (!left || (right && *left < *right)) {
+			return right;
+		}
+		return left;
+	}
+};
@@ -1,36 +1,65 @@
 #pragma once
+#include "node_allocator.hpp"
+#include "thread_pool.hpp"
+#include "key_compare.hpp"
+#include "augmentation.hpp"
+#include "instrumentation.hpp"
+#include "batched_search.hpp"
+#include "mapped_avl_tree.hpp"
+
 #include <concepts>
 #include <utility>
+#include <cstddef>
 #include <cstdint>
+#include <type_traits>
+#include <iterator>
+#include <algorithm>
+#include <vector>
+#include <bit>
+#include <stdexcept>
+#include <compare>
+#include <ranges>
+#include <string>
+#include <fstream>
+#include <new>
+#include <cstring>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <optional>
 
 
 
 // <<<-------------------------------------------------->>>
 // <<<----------- Class forward declarations ----------->>>
 // <<<-------------------------------------------------->>>
-template<typename KeyType, typename DataType>
-	requires (std::totally_ordered<KeyType>&& std::copyable<KeyType>
-			  && std::copyable<DataType>)
+template<typename KeyType, typename DataType, typename Augmentation = no_augmentation>
+	requires (std::copyable<KeyType> && std::movable<DataType>)
 class avl_tree_iterator;
-template<typename KeyType, typename DataType>
-	requires (std::totally_ordered<KeyType>&& std::copyable<KeyType>
-			  && std::copyable<DataType>)
+template<typename KeyType, typename DataType, typename Augmentation = no_augmentation>
+	requires (std::copyable<KeyType> && std::movable<DataType>)
+class avl_tree_range;
+template<typename DataType>
+struct avl_tree_cold_data;
+template<typename KeyType, typename DataType, bool IsDataCold = avl_tree_cold_data<DataType>::value, typename Augmentation = no_augmentation>
+	requires (std::copyable<KeyType> && std::movable<DataType>)
 class avl_tree_node;
-template<typename KeyType, typename DataType>
-	requires (std::totally_ordered<KeyType>&& std::copyable<KeyType>
-			  && std::copyable<DataType>)
+template<typename KeyType, typename DataType, template<typename> typename NodeAllocator = slab_allocator, typename Compare = three_way_key_compare,
+		 typename Augmentation = no_augmentation, typename Instrumentation = no_instrumentation>
+	requires (std::copyable<KeyType> && std::movable<DataType>
+			  && key_comparator_for<Compare, KeyType, KeyType> && augmentation_for<Augmentation, KeyType, DataType>
+			  && tree_instrumentation<Instrumentation>)
 class avl_tree;
 
 
 
 // An in-order traversal two way iterator.
 // end() iterator is nullptr.
-template<typename KeyType, typename DataType>
-	requires (std::totally_ordered<KeyType>&& std::copyable<KeyType>
-			  && std::copyable<DataType>)
+template<typename KeyType, typename DataType, typename Augmentation>
+	requires (std::copyable<KeyType> && std::movable<DataType>)
 class avl_tree_iterator {
 	using Iterator = typename avl_tree_iterator;
-	using Node = typename avl_tree_node<KeyType, DataType>;
+	using Node = typename avl_tree_node<KeyType, DataType, avl_tree_cold_data<DataType>::value, Augmentation>;
 public:
 	bool operator==(const Iterator& other) const {
 		return (this->ptr_ == other.ptr_);
@@ -39,6 +68,7 @@ public:
 		return (this->ptr_ != other.ptr_);
 	}
 
+	// Climbs by checking which child of its parent the node is, so a full traversal makes no key comparisons.
 	Iterator& operator++() {
 		if (!ptr_) {
 			return (*this);
@@ -52,45 +82,15 @@ public:
 			return *this;
 		}
 
-		while (ptr_->parent_) {
-			if (ptr_->key < ptr_->parent_->key) {
-				ptr_ = ptr_->parent_;
-				return *this;
-			}
-			else {
-				ptr_ = ptr_->parent_;
-			}
+		while (ptr_->parent_ && (ptr_ == ptr_->parent_->right_)) {
+			ptr_ = ptr_->parent_;
 		}
-
-		ptr_ = nullptr;
+		ptr_ = ptr_->parent_;
 		return *this;
 	}
 	Iterator operator++(int) {
 		Iterator temp = *this;
 		++(*this);
-		if (!temp.ptr_) {
-			return (temp);
-		}
-
-		if (temp.ptr_->right_) {
-			temp.ptr_ = temp.ptr_->right_;
-			while (temp.ptr_->left_) {
-				temp.ptr_ = temp.ptr_->left_;
-			}
-			return temp;
-		}
-
-		while (temp.ptr_->parent_) {
-			if (temp.ptr_->key < temp.ptr_->parent_->key) {
-				temp.ptr_ = temp.ptr_->parent_;
-				return temp;
-			}
-			else {
-				temp.ptr_ = temp.ptr_->parent_;
-			}
-		}
-
-		temp.ptr_ = nullptr;
 		return temp;
 	}
 
@@ -107,45 +107,15 @@ public:
 			return *this;
 		}
 
-		while (ptr_->parent_) {
-			if (ptr_->key > ptr_->parent_->key) {
-				ptr_ = ptr_->parent_;
-				return *this;
-			}
-			else {
-				ptr_ = ptr_->parent_;
-			}
+		while (ptr_->parent_ && (ptr_ == ptr_->parent_->left_)) {
+			ptr_ = ptr_->parent_;
 		}
-
-		ptr_ = nullptr;
+		ptr_ = ptr_->parent_;
 		return *this;
 	}
 	Iterator operator--(int) {
 		Iterator temp = *this;
-		++(*this);
-		if (!temp.ptr_) {
-			return (temp);
-		}
-
-		if (temp.ptr_->left_) {
-			temp.ptr_ = temp.ptr_->left_;
-			while (temp.ptr_->right_) {
-				temp.ptr_ = temp.ptr_->right_;
-			}
-			return temp;
-		}
-
-		while (temp.ptr_->parent_) {
-			if (temp.ptr_->key > temp.ptr_->parent_->key) {
-				temp.ptr_ = temp.ptr_->parent_;
-				return temp;
-			}
-			else {
-				temp.ptr_ = temp.ptr_->parent_;
-			}
-		}
-
-		temp.ptr_ = nullptr;
+		--(*this);
 		return temp;
 	}
 
@@ -159,91 +129,273 @@ public:
 	avl_tree_iterator(Node* node)
 		: ptr_(node) {}
 
-	friend avl_tree<KeyType, DataType>;
+	template<typename TreeKeyType, typename TreeDataType, template<typename> typename TreeNodeAllocator, typename TreeCompare, typename TreeAugmentation,
+			 typename TreeInstrumentation>
+		requires (std::copyable<TreeKeyType> && std::movable<TreeDataType>
+				  && key_comparator_for<TreeCompare, TreeKeyType, TreeKeyType> && augmentation_for<TreeAugmentation, TreeKeyType, TreeDataType>
+				  && tree_instrumentation<TreeInstrumentation>)
+	friend class avl_tree;
 private:
 	Node* ptr_;
 };
 
-// Holds a key-data pair and a balance integer.
-template<typename KeyType, typename DataType>
-	requires (std::totally_ordered<KeyType>&& std::copyable<KeyType>
-			  && std::copyable<DataType>)
-class avl_tree_node {
+// A pair of iterators marking a run of consecutive elements, see avl_tree::range().
+// Nodes are reached one increment at a time as the range is iterated, nothing is collected or allocated.
+template<typename KeyType, typename DataType, typename Augmentation>
+	requires (std::copyable<KeyType> && std::movable<DataType>)
+class avl_tree_range {
+	using Iterator = typename avl_tree_iterator<KeyType, DataType, Augmentation>;
+public:
+	Iterator begin() const {
+		return this->begin_;
+	}
+	Iterator end() const {
+		return this->end_;
+	}
+	bool empty() const {
+		return (this->begin_ == this->end_);
+	}
+
+	avl_tree_range(Iterator begin, Iterator end)
+		: begin_(begin)
+		, end_(end) {}
+private:
+	Iterator begin_;
+	Iterator end_;
+};
+
+// Whether avl_tree keeps the data of its nodes out of line, in cold slots allocated apart from the nodes.
+// The nodes then hold the key, the links and a reference to the data, so a search never reads a cache line of data
+// on the way down. On for data bigger than a cache line, specialize it to choose otherwise for a DataType.
+template<typename DataType>
+struct avl_tree_cold_data : std::bool_constant<(sizeof(DataType) > 64)> {};
+
+// Where avl_tree_node keeps the summary of its subtree for an augmented tree, see augmentation.hpp.
+// Empty without an augmentation, so the node doesn't grow.
+template<typename Augmentation>
+struct avl_tree_node_summary {
+	typename Augmentation::summary_type summary_;
+};
+template<>
+struct avl_tree_node_summary<no_augmentation> {};
+
+// Holds a key-data pair, a balance integer and the size of the subtree rooted at the node.
+// The key and the links come before the data, so the part of the node a search reads starts the node.
+// With IsDataCold, data is a reference to a slot the tree allocates separately, see avl_tree_cold_data.
+// With an Augmentation, the node also holds the summary of its subtree.
+template<typename KeyType, typename DataType, bool IsDataCold, typename Augmentation>
+	requires (std::copyable<KeyType> && std::movable<DataType>)
+class avl_tree_node : private avl_tree_node_summary<Augmentation> {
 	using Node = typename avl_tree_node;
 public:
-	DataType data;
 	KeyType key;
+private:
+	int_fast8_t balanceFactor_ = 0;
+	size_t subtreeSize_ = 1;
+	Node* parent_ = nullptr;
+	Node* left_ = nullptr;
+	Node* right_ = nullptr;
+public:
+	std::conditional_t<IsDataCold, DataType&, DataType> data;
 
-	avl_tree_node(const KeyType& key_, DataType&& data_)
+	avl_tree_node(const KeyType& key_, DataType&& data_) requires (!IsDataCold)
 		: key(key_)
 		, data(DataType(std::forward<DataType>(data_))) {}
 	template <typename... ArgTypes>
-	avl_tree_node(const KeyType& key_, ArgTypes&&... args)
+	avl_tree_node(const KeyType& key_, ArgTypes&&... args) requires (!IsDataCold)
 		: key(key_)
 		, data(DataType(std::forward<ArgTypes>(args)...)) {}
-
-	friend avl_tree_iterator<KeyType, DataType>;
-	friend avl_tree<KeyType, DataType>;
-private: 
-	int_fast8_t balanceFactor_ = 0;
-	Node* parent_ = nullptr;
-	Node* left_ = nullptr;
-	Node* right_ = nullptr;
+	// Binds the node to data constructed in a cold slot.
+	avl_tree_node(const KeyType& key_, DataType& coldData) requires (IsDataCold)
+		: key(key_)
+		, data(coldData) {}
+
+	friend avl_tree_iterator<KeyType, DataType, Augmentation>;
+	template<typename TreeKeyType, typename TreeDataType, template<typename> typename TreeNodeAllocator, typename TreeCompare, typename TreeAugmentation,
+			 typename TreeInstrumentation>
+		requires (std::copyable<TreeKeyType> && std::movable<TreeDataType>
+				  && key_comparator_for<TreeCompare, TreeKeyType, TreeKeyType> && augmentation_for<TreeAugmentation, TreeKeyType, TreeDataType>
+				  && tree_instrumentation<TreeInstrumentation>)
+	friend class avl_tree;
+	// Walks the links and summaries of interval trees, see interval_tree.hpp.
+	template<typename TreePointType, typename TreeDataType>
+		requires (std::copyable<TreePointType> && std::totally_ordered<TreePointType> && std::movable<TreeDataType>)
+	friend class interval_tree_iterator;
 };
 
 // An AVL tree implementation.
 // The key is a seperate member from the data, this means the DataType 
 // doesn't have to have comparison operators implemented.
-// KeyType must be copyable and totally_ordered.
-// DataType must be copyable.
-template<typename KeyType, typename DataType>
-	requires (std::totally_ordered<KeyType>&& std::copyable<KeyType>
-			  && std::copyable<DataType>)
+// KeyType must be copyable.
+// DataType must be movable. Copying the tree needs it to be copyable.
+// NodeAllocator is the node allocation policy, see node_allocator.hpp. 
+// The default slab_allocator carves nodes out of large blocks and lets clear() drop them all at once.
+// Data bigger than a cache line is kept out of line in slots from a second NodeAllocator, see avl_tree_cold_data.
+// Compare orders the keys, see key_compare.hpp. The default compares with <=>, or with < if KeyType has no <=>.
+// Lookups (search(), remove(), the bound queries and rank()) take any key type a transparent Compare can compare with KeyType,
+// so a tree with std::string keys can be searched with a std::string_view or a const char* without building a std::string.
+// Augmentation keeps a summary of every subtree in its root, so aggregate() folds a key range in O(logn), see augmentation.hpp.
+// The default no_augmentation keeps nothing.
+// Instrumentation counts comparisons, visited nodes, rotations, rebalancing steps and allocations, see instrumentation.hpp.
+// The default no_instrumentation counts nothing and costs nothing.
+template<typename KeyType, typename DataType, template<typename> typename NodeAllocator, typename Compare, typename Augmentation, typename Instrumentation>
+	requires (std::copyable<KeyType> && std::movable<DataType>
+			  && key_comparator_for<Compare, KeyType, KeyType> && augmentation_for<Augmentation, KeyType, DataType>
+			  && tree_instrumentation<Instrumentation>)
 class avl_tree {
-	using Iterator = typename avl_tree_iterator<KeyType, DataType>;
-	using Node = typename avl_tree_node<KeyType, DataType>;
+	using Iterator = typename avl_tree_iterator<KeyType, DataType, Augmentation>;
+	using Range = typename avl_tree_range<KeyType, DataType, Augmentation>;
+	using Node = typename avl_tree_node<KeyType, DataType, avl_tree_cold_data<DataType>::value, Augmentation>;
+	using Summary = typename Augmentation::summary_type;
+	static constexpr bool is_augmented_ = !std::same_as<Augmentation, no_augmentation>;
+	using Allocator = typename NodeAllocator<Node>;
+	static constexpr bool is_data_cold_ = avl_tree_cold_data<DataType>::value;
+	// Stands in for the cold slot allocator when the data is kept in the nodes.
+	struct NoColdSlots {};
+	using ColdAllocator = typename std::conditional_t<is_data_cold_, NodeAllocator<DataType>, NoColdSlots>;
 public:
+	// Like every call that hands out nodes or iterators of a non-const tree, gives a copy-on-write copy its own nodes first.
+	// @return nullptr if key is not present in the tree.
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	Node* search(const LookupKeyType& key) {
+		this->unshare();
+		this->instrumentation_.on_lookup();
+		return this->root_ ? this->search_subtree(to_lookup_key<Compare, KeyType>(key), this->root_) : nullptr;
+	}
+	// Read-only lookup, keeps sharing the nodes of a copy-on-write copy, see set_copy_on_write().
 	// @return nullptr if key is not present in the tree.
-	Node* search(const KeyType& key) {
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	const Node* search(const LookupKeyType& key) const {
+		this->instrumentation_.on_lookup();
 		if (root_) {
-			return search_subtree(key, root_);
+			return this->search_subtree(to_lookup_key<Compare, KeyType>(key), root_);
 		}
 		else {
 			return nullptr;
 		}
 	}
+	// Looks up every key of keys, writing the node found for keys[i], or nullptr, to out[i].
+	// The lookups are interleaved so the cache misses of many of them are waited on at once, see batched_search.hpp.
+	// For keys that aren't cached that is several times the throughput of calling search() in a loop.
+	// @return Number of keys found.
+	template<std::ranges::random_access_range KeyRange, std::random_access_iterator OutputIterator>
+		requires transparent_lookup_key_for<std::ranges::range_value_t<KeyRange>, Compare, KeyType>
+	size_t search_many(const KeyRange& keys, OutputIterator out) {
+		this->unshare();
+		return interleaved_search(this->root_, keys, out, [this](const auto& key, Node* node) {
+			// Every lookup starts at the root.
+			if (node == this->root_) {
+				this->instrumentation_.on_lookup();
+			}
+			this->instrumentation_.on_visit();
+			const std::weak_ordering order = this->compare_keys(key, node->key);
+			if (order == 0) {
+				return search_step<Node>{ node, true };
+			}
+			Node* child = (order < 0) ? node->left_ : node->right_;
+			return search_step<Node>{ child, child == nullptr };
+		});
+	}
+
+	// @return Iterator to the first element with a key not smaller than key, end() if there is none. O(logn).
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	Iterator lower_bound(const LookupKeyType& key) {
+		this->unshare();
+		this->instrumentation_.on_lookup();
+		const auto& lookupKey = to_lookup_key<Compare, KeyType>(key);
+		Node* bound = nullptr;
+		Node* node = this->root_;
+		while (node) {
+			this->instrumentation_.on_visit();
+			if (this->compare_keys(node->key, lookupKey) < 0) {
+				node = node->right_;
+			}
+			else {
+				bound = node;
+				node = node->left_;
+			}
+		}
+		return Iterator(bound);
+	}
+	// @return Iterator to the first element with a key bigger than key, end() if there is none. O(logn).
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	Iterator upper_bound(const LookupKeyType& key) {
+		this->unshare();
+		this->instrumentation_.on_lookup();
+		const auto& lookupKey = to_lookup_key<Compare, KeyType>(key);
+		Node* bound = nullptr;
+		Node* node = this->root_;
+		while (node) {
+			this->instrumentation_.on_visit();
+			if (this->compare_keys(lookupKey, node->key) < 0) {
+				bound = node;
+				node = node->left_;
+			}
+			else {
+				node = node->right_;
+			}
+		}
+		return Iterator(bound);
+	}
+	// @return lower_bound() and upper_bound() of key. Keys are unique, so the range holds at most one element.
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	std::pair<Iterator, Iterator> equal_range(const LookupKeyType& key) {
+		const auto& lookupKey = to_lookup_key<Compare, KeyType>(key);
+		return std::make_pair(this->lower_bound(lookupKey), this->upper_bound(lookupKey));
+	}
+	// @return The elements with keys in [low, high) as a lazily iterated range. 
+	// Finding the ends is O(logn), iterating k elements on top of that is O(k).
+	template<lookup_key_for<Compare, KeyType> LowKeyType, lookup_key_for<Compare, KeyType> HighKeyType>
+	Range range(const LowKeyType& low, const HighKeyType& high) {
+		const auto& lowKey = to_lookup_key<Compare, KeyType>(low);
+		const auto& highKey = to_lookup_key<Compare, KeyType>(high);
+		if (!(this->compare_keys(lowKey, highKey) < 0)) {
+			return Range(this->end(), this->end());
+		}
+		return Range(this->lower_bound(lowKey), this->lower_bound(highKey));
+	}
 
 	// Creates a node on the tree. Does a copy operation on the data.
 	// @return false if key is already in tree.
 	bool insert(const KeyType& key_, const DataType& data_) {
+		this->instrumentation_.on_insert();
+		if (this->is_shared_with_key(key_)) {
+			return false;
+		}
+		this->unshare();
 		if (this->root_) {
-			Node* parent = find_parent_for_key_in_subtree(key_, this->root_);
-			if (parent) {
-				this->insert_node_at(parent, new Node(key_, std::move(data_)));
+			InsertPosition position = this->find_insert_position(key_);
+			if (position.parent) {
+				this->insert_node_at(position, this->create_node(key_, std::move(data_)));
 			}
 			else {
 				return false;
 			}
 		}
 		else {
-			this->root_ = new Node(key_, std::move(data_));
+			this->root_ = this->create_node(key_, std::move(data_));
 		}
 		return true;
 	}
 	// Creates a newNode on the tree. Does a move operation on the data.
 	// @return false if key is already in tree.
 	bool insert(const KeyType& key_, DataType&& data_) {
+		this->instrumentation_.on_insert();
+		if (this->is_shared_with_key(key_)) {
+			return false;
+		}
+		this->unshare();
 		if (this->root_) {
-			Node* parent = find_parent_for_key_in_subtree(key_, this->root_);
-			if (parent) {
-				this->insert_node_at(parent, new Node(key_, std::forward<DataType>(data_)));
+			InsertPosition position = this->find_insert_position(key_);
+			if (position.parent) {
+				this->insert_node_at(position, this->create_node(key_, std::forward<DataType>(data_)));
 			}
 			else {
 				return false;
 			}
 		}
 		else {
-			this->root_ = new Node(key_, std::forward<DataType>(data_));
+			this->root_ = this->create_node(key_, std::forward<DataType>(data_));
 		}
 		return true;
 	}
@@ -252,99 +404,154 @@ public:
 	// @return false if key is already in tree.
 	template <typename... ArgTypes>
 	bool emplace(const KeyType key_, ArgTypes... args) {
+		this->instrumentation_.on_insert();
+		if (this->is_shared_with_key(key_)) {
+			return false;
+		}
+		this->unshare();
 		if (this->root_) {
-			Node* parent = find_parent_for_key_in_subtree(key_, this->root_);
-			if (parent) {
-				this->insert_node_at(parent, new Node(key_, std::forward<ArgTypes>(args)...));
+			InsertPosition position = this->find_insert_position(key_);
+			if (position.parent) {
+				this->insert_node_at(position, this->create_node(key_, std::forward<ArgTypes>(args)...));
 			}
 			else {
 				return false;
 			}
 		}
 		else {
-			this->root_ = new Node(key_, std::forward<ArgTypes>(args)...);
+			this->root_ = this->create_node(key_, std::forward<ArgTypes>(args)...);
 		}
 		return true;
 	}
 
+	// Creates a newNode on the tree if key is not in it, with one search for both the lookup and the insert.
+	// The DataType object is only constructed if key is absent, args are left untouched otherwise.
+	// @param[...args] args are passed to the DataType constructor.
+	// @return The node with key, and whether it was inserted.
+	template <typename... ArgTypes>
+	std::pair<Node*, bool> try_emplace(const KeyType& key_, ArgTypes&&... args) {
+		this->instrumentation_.on_insert();
+		return this->find_or_create(key_, [&]() { return this->create_node(key_, std::forward<ArgTypes>(args)...); });
+	}
+	// Creates a newNode on the tree, or assigns data_ to the data of key if it is already in the tree. One search either way.
+	// @return The node with key, and whether it was inserted.
+	template <typename ValueType>
+		requires (std::constructible_from<DataType, ValueType&&> && std::assignable_from<DataType&, ValueType&&>)
+	std::pair<Node*, bool> insert_or_assign(const KeyType& key_, ValueType&& data_) {
+		this->instrumentation_.on_insert();
+		std::pair<Node*, bool> result = this->find_or_create(key_, [&]() { return this->create_node(key_, std::forward<ValueType>(data_)); });
+		if (!result.second) {
+			result.first->data = std::forward<ValueType>(data_);
+			if constexpr (is_augmented_) {
+				this->refresh_summaries(result.first);
+			}
+		}
+		return result;
+	}
+	// Returns the node of key, creating it with the data makeData() returns if key is not in the tree. One search either way.
+	// makeData is only called if key is absent, so data that is expensive to build is only built when it is needed.
+	// @return The node with key, and whether it was inserted.
+	template <typename Factory>
+		requires std::constructible_from<DataType, std::invoke_result_t<Factory&>>
+	std::pair<Node*, bool> find_or_insert(const KeyType& key_, Factory&& makeData) {
+		this->instrumentation_.on_insert();
+		return this->find_or_create(key_, [&]() { return this->create_node(key_, makeData()); });
+	}
+
+	// Creates a newNode on the tree like emplace(), but searches for its place starting at hint instead of the root.
+	// The search climbs up from hint only until it reaches a subtree the key belongs in, so a key that goes next to hint 
+	// takes O(1) key comparisons instead of O(logn). end() as the hint starts the search at max().
+	// @param[...args] args are passed to the DataType constructor.
+	// @return Iterator to the new element, or to the element that already had the key.
+	template <typename... ArgTypes>
+	Iterator emplace_hint(Iterator hint, const KeyType& key_, ArgTypes&&... args) {
+		this->instrumentation_.on_insert();
+		if (hint.ptr_ && this->unshare()) {
+			// The hint points into the nodes the tree was just cloned from.
+			hint = Iterator(this->search_subtree(hint.ptr_->key, this->root_));
+		}
+		if (!this->root_) {
+			this->root_ = this->create_node(key_, std::forward<ArgTypes>(args)...);
+			return Iterator(this->root_);
+		}
+		Node* const start = this->climb_to_cover(key_, hint.ptr_ ? hint.ptr_ : find_max_in_subtree(this->root_));
+		InsertPosition position = this->find_insert_position_in_subtree(key_, start);
+		if (!position.parent) {
+			return Iterator(position.match);
+		}
+		Node* node = this->create_node(key_, std::forward<ArgTypes>(args)...);
+		this->insert_node_at(position, node);
+		return Iterator(node);
+	}
+
+	// Turns finger search on or off. While it's on, insert() and emplace() search for the new key's place 
+	// starting at the last inserted element the way emplace_hint() does. Meant for mostly sorted streams of keys.
+	void set_finger_search(bool isEnabled) {
+		this->isFingerSearchEnabled_ = isEnabled;
+	}
+	// Turns copy-on-write on or off. While it's on, copies of the tree share its nodes instead of cloning them, in O(1),
+	// and copies of those copies do too. The first update of a tree whose nodes are still shared clones them, in O(n),
+	// so a tree handed out to many mostly read-only consumers is only cloned by the ones that change it.
+	// Nodes can't be shared a path at a time since they link to their parents, see persistent_avl_tree for that.
+	// Handing out a node or iterator through a non-const tree counts as an update, since data can be changed in place through it,
+	// so copies only read through const references, with the const search() and the other const members, keep sharing.
+	// Inserts of keys already in the tree and removes of keys not in it change nothing, and don't clone.
+	// Copying writes to the copied tree, so a tree can't be copied from more than one thread at once.
+	void set_copy_on_write(bool isEnabled) {
+		this->isCopyOnWriteEnabled_ = isEnabled;
+	}
+	// @return true if the tree's nodes are shared with copies of it, so that its next update clones them.
+	bool is_shared() const {
+		return this->sharedNodes_ && this->sharedNodes_.use_count() > 1;
+	}
+
 	// Removes an element from the tree and calls the destructor on its data. 
-	// If the removed element has 2 children, copies the max() in left subtree to the element's place then deletes the original copy.
+	// If the removed element has 2 children, the max() in its left subtree is relinked into its place first,
+	// so no key or data is copied or moved and every other node keeps its address.
 	// Then does the rebalancing.
-	bool remove(const KeyType& key_) {
-		Node* node = this->search(key_);
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	bool remove(const LookupKeyType& key_) {
+		this->instrumentation_.on_remove();
+		const auto& lookupKey = to_lookup_key<Compare, KeyType>(key_);
+		// Searched before unsharing, so removing a key that isn't there doesn't clone shared nodes.
+		Node* node = this->root_ ? this->search_subtree(lookupKey, this->root_) : nullptr;
+		if (node && this->unshare()) {
+			// The node found belongs to the trees the nodes were just cloned from.
+			node = this->search_subtree(lookupKey, this->root_);
+		}
 
 		if (node) {
+			if (this->finger_ == node) {
+				this->finger_ = nullptr;
+			}
+			if (node->left_ && node->right_) {
+				this->swap_with_predecessor(node);
+			}
 			if (node != this->root_) {
+				const bool isLeftChild = (node->parent_->left_ == node);
+				Node*& parentsCorrectPointer = isLeftChild ? node->parent_->left_ : node->parent_->right_;
 				if (!(node->left_ || node->right_)) {
-					Node*& parentsCorrectPointer = (node->key < node->parent_->key) ? node->parent_->left_ : node->parent_->right_;
 					parentsCorrectPointer = nullptr;
-					balance_parents_after_remove(node->parent_, key_);
-					delete node;
 				}
-				else  if (!node->left_ != !node->right_) {
-					Node*& parentsCorrectPointer = (node->key < node->parent_->key) ? node->parent_->left_ : node->parent_->right_;
-					if (node->left_) {
-						parentsCorrectPointer = node->left_;
-						node->left_->parent_ = node->parent_;
-						balance_parents_after_remove(node->parent_, key_);
-						delete node;
-					}
-					else {
-						parentsCorrectPointer = node->right_;
-						node->right_->parent_ = node->parent_;
-						balance_parents_after_remove(node->parent_, key_);
-						delete node;
-					}
+				else if (node->left_) {
+					parentsCorrectPointer = node->left_;
+					node->left_->parent_ = node->parent_;
 				}
-				else if (node->left_ && node->right_) {
-					Node* replacementNode = find_max_in_subtree(node->left_);
-					Node*& parentsCorrectPointer = (replacementNode->key < replacementNode->parent_->key) ? replacementNode->parent_->left_ : replacementNode->parent_->right_;
-					node->key = std::move(replacementNode->key);
-					node->data = std::move(replacementNode->data);
-					if (replacementNode->left_) {
-						replacementNode->left_->parent_ = replacementNode->parent_;
-						parentsCorrectPointer = replacementNode->left_;
-					}
-					else {
-						parentsCorrectPointer = nullptr;
-					}
-					balance_parents_after_remove(replacementNode->parent_, node->key);
-					delete replacementNode;
+				else {
+					parentsCorrectPointer = node->right_;
+					node->right_->parent_ = node->parent_;
 				}
+				add_to_subtree_sizes(node->parent_, -1);
+				balance_parents_after_remove(node->parent_, isLeftChild);
 			}
 			else {
-				if (!(node->left_ || node->right_)) {
-					this->root_ = nullptr;
-					delete node;
-				}
-				else  if (!node->left_ != !node->right_) {
-					if (node->left_) {
-						this->root_ = node->left_;
-						root_->parent_ = nullptr;
-						delete node;
-					}
-					else {
-						this->root_ = node->right_;
-						root_->parent_ = nullptr;
-						delete node;
-					}
-				}
-				else if (node->left_ && node->right_) {
-					Node* replacementNode = find_max_in_subtree(node->left_);
-					Node*& parentsCorrectPointer = (replacementNode->key < replacementNode->parent_->key) ? replacementNode->parent_->left_ : replacementNode->parent_->right_;
-					node->key = std::move(replacementNode->key);
-					node->data = std::move(replacementNode->data);
-					if (replacementNode->left_) {
-						replacementNode->left_->parent_ = replacementNode->parent_;
-						parentsCorrectPointer = replacementNode->left_;
-					}
-					else {
-						parentsCorrectPointer = nullptr;
-					}
-					balance_parents_after_remove(replacementNode->parent_, node->key);
-					delete replacementNode;
+				this->root_ = node->left_ ? node->left_ : node->right_;
+				if (this->root_) {
+					this->root_->parent_ = nullptr;
 				}
 			}
+			this->destroy_node(node);
+			this->reanchor_root();
 			return true;
 		}
 		else {
@@ -353,20 +560,136 @@ public:
 	}
 
 	// Removes all elements from the tree.
+	// If the allocator can release in bulk and the nodes don't need their destructors called, 
+	// this is O(number of allocator blocks). Otherwise every node is destructed on the way.
 	void clear() {
+		if (this->sharedNodes_) {
+			// The nodes are destructed by the last tree sharing them.
+			this->root_ = nullptr;
+			this->sharedNodes_.reset();
+		}
 		if (this->root_) {
-			std::vector<Node*> allNodes;
-			for (Node& node : *this) {
-				allNodes.push_back(&node);
+			if constexpr (!(Allocator::releases_in_bulk && std::is_trivially_destructible_v<KeyType> && std::is_trivially_destructible_v<DataType>)) {
+				this->destroy_subtree(this->root_);
 			}
-			for (Node* node : allNodes) {
-				delete node;
+			else {
+				this->instrumentation_.on_deallocations(this->size());
 			}
 			this->root_ = nullptr;
 		}
+		this->finger_ = nullptr;
+		this->allocator_.release();
+		if constexpr (is_data_cold_) {
+			this->coldAllocator_.release();
+		}
 	}
 	
+	// Replaces the contents of the tree with the key-data pairs in [first, last) in O(n).
+	// Elements are anything std::get<0>/std::get<1> work on, like std::pair or std::tuple.
+	// The nodes are allocated in one batch and linked into a perfectly balanced tree, no rotations are done.
+	// If the range isn't strictly increasing by key it is sorted first (O(nlogn)), keeping the first element of equal keys.
+	// Single pass ranges are always buffered into a vector of key-data pairs first.
+	template<std::input_iterator PairIterator>
+	void assign(PairIterator first, PairIterator last) {
+		this->clear();
+
+		if constexpr (std::random_access_iterator<PairIterator>) {
+			const auto isOutOfOrder = [this](const auto& left, const auto& right) {
+				return !(this->compare_keys(std::get<0>(left), std::get<0>(right)) < 0);
+			};
+			if (std::adjacent_find(first, last, isOutOfOrder) == last) {
+				const size_t count = static_cast<size_t>(last - first);
+				this->reserve_nodes(count);
+				this->root_ = this->build_subtree([&first](size_t index) -> decltype(auto) { return first[index]; }, 0, count, nullptr);
+				return;
+			}
+		}
+
+		if constexpr (std::forward_iterator<PairIterator>) {
+			std::vector<PairIterator> elements;
+			for (PairIterator it = first; it != last; ++it) {
+				elements.push_back(it);
+			}
+			this->sort_and_remove_duplicates(elements, [](const PairIterator& element) -> decltype(auto) { return std::get<0>(*element); });
+
+			this->reserve_nodes(elements.size());
+			this->root_ = this->build_subtree([&elements](size_t index) -> decltype(auto) { return *elements[index]; }, 0, elements.size(), nullptr);
+		}
+		else {
+			std::vector<std::pair<KeyType, DataType>> elements;
+			for (; first != last; ++first) {
+				decltype(auto) element = *first;
+				elements.emplace_back(std::get<0>(element), std::get<1>(std::forward<decltype(element)>(element)));
+			}
+			this->sort_and_remove_duplicates(elements, [](const std::pair<KeyType, DataType>& element) -> const KeyType& { return element.first; });
+
+			this->reserve_nodes(elements.size());
+			this->root_ = this->build_subtree([&elements](size_t index) -> decltype(auto) { return std::move(elements[index]); }, 0, elements.size(), nullptr);
+		}
+	}
+
+	// Writes the tree to path as an image mapped_avl_tree can serve lookups from without loading it, see mapped_avl_tree.hpp. O(n).
+	// Nodes are written in key order and link to their children by index, computed from the subtree sizes.
+	// @exception std::runtime_error if the file can't be written.
+	// @exception std::length_error if the tree has 2^32 - 1 elements or more.
+	void save(const std::string& path) const requires (std::is_trivially_copyable_v<KeyType> && std::is_trivially_copyable_v<DataType>) {
+		using MappedNode = mapped_avl_tree_node<KeyType, DataType>;
+		using Header = avl_tree_image_header;
+		if (this->size() >= Header::null_index) {
+			throw std::length_error("Tree images hold less than 2^32 - 1 elements.");
+		}
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			throw std::runtime_error("Couldn't open " + path + " for writing.");
+		}
+
+		Header header = {};
+		std::memcpy(header.magic, Header::format_magic, sizeof(header.magic));
+		header.version = Header::format_version;
+		header.byteOrder = Header::byte_order_mark;
+		header.keySize = sizeof(KeyType);
+		header.dataSize = sizeof(DataType);
+		header.nodeSize = sizeof(MappedNode);
+		header.nodeAlignment = alignof(MappedNode);
+		header.size = this->size();
+		header.root = this->root_ ? static_cast<uint32_t>(subtree_size(this->root_->left_)) : Header::null_index;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+		// Records are laid out in a zeroed batch, so padding bytes don't leak into the image.
+		constexpr size_t batchSize = 4096;
+		std::vector<std::byte> batch(batchSize * sizeof(MappedNode));
+		size_t batched = 0;
+		uint32_t index = 0;
+		for (Iterator it(this->root_ ? find_min_in_subtree(this->root_) : nullptr); it != Iterator(nullptr); ++it, index++) {
+			const Node* node = it.ptr_;
+			// In-order neighbours of node in its subtree are its children's inner subtrees away from it.
+			const uint32_t left = node->left_ ? index - 1 - static_cast<uint32_t>(subtree_size(node->left_->right_)) : Header::null_index;
+			const uint32_t right = node->right_ ? index + 1 + static_cast<uint32_t>(subtree_size(node->right_->left_)) : Header::null_index;
+			new (batch.data() + batched * sizeof(MappedNode)) MappedNode(node->key, node->data, left, right);
+			if (++batched == batchSize) {
+				file.write(reinterpret_cast<const char*>(batch.data()), batched * sizeof(MappedNode));
+				batched = 0;
+			}
+		}
+		file.write(reinterpret_cast<const char*>(batch.data()), batched * sizeof(MappedNode));
+		if (!file.flush()) {
+			throw std::runtime_error("Couldn't write " + path + ".");
+		}
+	}
+	// Replaces the contents of the tree with an image written by save(). O(n), the image is already sorted and
+	// the nodes are linked into a perfectly balanced tree like assign() does, no keys are compared.
+	// For lookups only, a mapped_avl_tree serves the image without building a tree at all.
+	// @exception std::runtime_error if path can't be mapped or isn't an image of a tree with these key and data types.
+	void load(const std::string& path) requires (std::is_trivially_copyable_v<KeyType> && std::is_trivially_copyable_v<DataType>) {
+		const mapped_avl_tree<KeyType, DataType, Compare> image(path, this->compare_);
+		this->clear();
+		this->reserve_nodes(image.size());
+		const mapped_avl_tree_node<KeyType, DataType>* nodes = image.begin();
+		this->root_ = this->build_subtree([nodes](size_t index) { return std::pair<const KeyType&, const DataType&>(nodes[index].key, nodes[index].data); }, 0, image.size(), nullptr);
+	}
+
 	Node* min() {
+		this->unshare();
 		if (root_) {
 			return find_min_in_subtree(root_);
 		}
@@ -375,6 +698,7 @@ public:
 		}
 	}
 	Node* max() {
+		this->unshare();
 		if (root_) {
 			return find_max_in_subtree(root_);
 
@@ -384,6 +708,211 @@ public:
 		}
 	}
 
+	// @return Number of elements in the tree. O(1).
+	size_t size() const {
+		return subtree_size(this->root_);
+	}
+
+	// @return Number of elements with keys smaller than key. O(logn).
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	size_t rank(const LookupKeyType& key) const {
+		const auto& lookupKey = to_lookup_key<Compare, KeyType>(key);
+		this->instrumentation_.on_lookup();
+		size_t smallerCount = 0;
+		const Node* node = this->root_;
+		while (node) {
+			this->instrumentation_.on_visit();
+			if (this->compare_keys(lookupKey, node->key) <= 0) {
+				node = node->left_;
+			}
+			else {
+				smallerCount += subtree_size(node->left_) + 1;
+				node = node->right_;
+			}
+		}
+		return smallerCount;
+	}
+	// @return Number of elements with keys in [low, high). O(logn).
+	template<lookup_key_for<Compare, KeyType> LowKeyType, lookup_key_for<Compare, KeyType> HighKeyType>
+	size_t count(const LowKeyType& low, const HighKeyType& high) const {
+		const size_t lowRank = this->rank(low);
+		const size_t highRank = this->rank(high);
+		return (highRank > lowRank) ? (highRank - lowRank) : 0;
+	}
+
+	// @return The summary of the elements with keys in [low, high), the same keys range() covers. O(logn).
+	// Only the nodes on the search paths of low and high are visited, the subtrees between them are taken whole from their summaries.
+	template<lookup_key_for<Compare, KeyType> LowKeyType, lookup_key_for<Compare, KeyType> HighKeyType>
+	Summary aggregate(const LowKeyType& low, const HighKeyType& high) const requires (is_augmented_) {
+		const auto& lowKey = to_lookup_key<Compare, KeyType>(low);
+		const auto& highKey = to_lookup_key<Compare, KeyType>(high);
+		this->instrumentation_.on_lookup();
+		// The topmost node in range has every other node in range in its subtree.
+		const Node* top = this->root_;
+		while (top) {
+			this->instrumentation_.on_visit();
+			if (this->compare_keys(top->key, lowKey) < 0) {
+				top = top->right_;
+			}
+			else if (this->compare_keys(top->key, highKey) >= 0) {
+				top = top->left_;
+			}
+			else {
+				break;
+			}
+		}
+		if (!top) {
+			return Augmentation::identity();
+		}
+		// Every node not smaller than low on the way down to low is in range, along with its right subtree.
+		Summary lowPart = Augmentation::identity();
+		for (const Node* node = top->left_; node; ) {
+			this->instrumentation_.on_visit();
+			if (this->compare_keys(node->key, lowKey) < 0) {
+				node = node->right_;
+			}
+			else {
+				lowPart = Augmentation::combine(Augmentation::combine(Augmentation::summarize(node->key, node->data), subtree_summary(node->right_)), lowPart);
+				node = node->left_;
+			}
+		}
+		// Every node smaller than high on the way down to high is in range, along with its left subtree.
+		Summary highPart = Augmentation::identity();
+		for (const Node* node = top->right_; node; ) {
+			this->instrumentation_.on_visit();
+			if (this->compare_keys(node->key, highKey) >= 0) {
+				node = node->left_;
+			}
+			else {
+				highPart = Augmentation::combine(highPart, Augmentation::combine(subtree_summary(node->left_), Augmentation::summarize(node->key, node->data)));
+				node = node->right_;
+			}
+		}
+		return Augmentation::combine(Augmentation::combine(lowPart, Augmentation::summarize(top->key, top->data)), highPart);
+	}
+	// @return The summary of every element in the tree. O(1).
+	Summary summary() const requires (is_augmented_) {
+		return subtree_summary(this->root_);
+	}
+	// Recomputes the summaries that cover node. Has to be called after the data of a node is changed in place. O(logn).
+	void refresh_summaries(Node* node) requires (is_augmented_) {
+		for (; node; node = node->parent_) {
+			update_summary(node);
+		}
+	}
+
+	// @return The element at index in sorted order, index 0 being min(). O(logn).
+	// @return nullptr if index >= size().
+	Node* select(size_t index) {
+		this->unshare();
+		this->instrumentation_.on_lookup();
+		Node* node = this->root_;
+		while (node) {
+			this->instrumentation_.on_visit();
+			const size_t leftSize = subtree_size(node->left_);
+			if (index < leftSize) {
+				node = node->left_;
+			}
+			else if (index > leftSize) {
+				index -= leftSize + 1;
+				node = node->right_;
+			}
+			else {
+				return node;
+			}
+		}
+		return nullptr;
+	}
+	// @return Number of increments needed to get from first to last, negative if last comes before first. O(logn).
+	ptrdiff_t distance(Iterator first, Iterator last) const {
+		return static_cast<ptrdiff_t>(this->index_of(last.ptr_)) - static_cast<ptrdiff_t>(this->index_of(first.ptr_));
+	}
+
+	// Splits the tree into the elements with keys smaller than key and the rest, leaving this tree empty. O(logn).
+	// Both trees keep using the nodes of this tree, their allocators share the memory of this one.
+	std::pair<avl_tree, avl_tree> split(const KeyType& key) {
+		this->unshare();
+		SplitSubtrees parts = this->split_subtree(this->take_subtree(), key);
+		if (parts.match) {
+			parts.greater = join_subtrees(Subtree(), parts.match, parts.greater);
+		}
+
+		std::pair<avl_tree, avl_tree> trees(avl_tree(this->compare_), avl_tree(this->compare_));
+		trees.first.allocator_ = std::move(this->allocator_);
+		trees.first.coldAllocator_ = std::move(this->coldAllocator_);
+		trees.second.share_allocators(trees.first);
+		trees.first.isFingerSearchEnabled_ = trees.second.isFingerSearchEnabled_ = this->isFingerSearchEnabled_;
+		trees.first.isCopyOnWriteEnabled_ = trees.second.isCopyOnWriteEnabled_ = this->isCopyOnWriteEnabled_;
+		trees.first.root_ = parts.less.root;
+		trees.second.root_ = parts.greater.root;
+		return trees;
+	}
+	// Joins left, a new element and right into one tree, leaving left and right empty. O(logn).
+	// Every key in left has to be smaller than key, and every key in right bigger.
+	// @exception std::invalid_argument if the keys aren't ordered like that. The trees are left untouched.
+	static avl_tree join(avl_tree&& left, const KeyType& key, DataType&& data, avl_tree&& right) {
+		if ((left.root_ && !(left.compare_keys(find_max_in_subtree(left.root_)->key, key) < 0))
+			|| (right.root_ && !(left.compare_keys(key, find_min_in_subtree(right.root_)->key) < 0))) {
+			throw std::invalid_argument("Keys of the joined trees overlap.");
+		}
+		left.unshare();
+		right.unshare();
+		avl_tree tree(std::move(left));
+		tree.share_allocators(right);
+		Node* pivot = tree.create_node(key, std::forward<DataType>(data));
+		tree.root_ = tree.join_subtrees(tree.take_subtree(), pivot, right.take_subtree()).root;
+		right.clear();
+		return tree;
+	}
+	// Joins left and right into one tree, leaving them empty. O(logn).
+	// Every key in left has to be smaller than every key in right.
+	// @exception std::invalid_argument if the keys aren't ordered like that. The trees are left untouched.
+	static avl_tree join(avl_tree&& left, avl_tree&& right) {
+		if (left.root_ && right.root_ && !(left.compare_keys(find_max_in_subtree(left.root_)->key, find_min_in_subtree(right.root_)->key) < 0)) {
+			throw std::invalid_argument("Keys of the joined trees overlap.");
+		}
+		left.unshare();
+		right.unshare();
+		avl_tree tree(std::move(left));
+		tree.share_allocators(right);
+		tree.root_ = tree.join_subtrees(tree.take_subtree(), right.take_subtree()).root;
+		right.clear();
+		return tree;
+	}
+
+	// Set operations built on split and join. They take over the nodes of other instead of copying them, and leave other empty.
+	// For m <= n elements they do O(mlog(n/m + 1)) work, and the recursive halves run in parallel on pool once they get big enough.
+	// Adds the elements of other with keys that aren't in this tree. For keys in both trees the element of this tree is kept.
+	void union_with(avl_tree&& other, thread_pool& pool = thread_pool::shared()) {
+		this->unshare();
+		other.unshare();
+		this->share_allocators(other);
+		DroppedNodes dropped;
+		this->root_ = this->union_subtrees(this->take_subtree(), other.take_subtree(), dropped, pool).root;
+		other.clear();
+		this->destroy_dropped(dropped);
+	}
+	// Removes the elements with keys that aren't in other.
+	void intersect_with(avl_tree&& other, thread_pool& pool = thread_pool::shared()) {
+		this->unshare();
+		other.unshare();
+		this->share_allocators(other);
+		DroppedNodes dropped;
+		this->root_ = this->intersect_subtrees(this->take_subtree(), other.take_subtree(), dropped, pool).root;
+		other.clear();
+		this->destroy_dropped(dropped);
+	}
+	// Removes the elements with keys that are in other.
+	void difference_with(avl_tree&& other, thread_pool& pool = thread_pool::shared()) {
+		this->unshare();
+		other.unshare();
+		this->share_allocators(other);
+		DroppedNodes dropped;
+		this->root_ = this->difference_subtrees(this->take_subtree(), other.take_subtree(), dropped, pool).root;
+		other.clear();
+		this->destroy_dropped(dropped);
+	}
+
 	// @return An in-order traversal iterator pointing at the smallest element of the tree.
 	Iterator begin() {
 		if (!this->root_) {
@@ -396,34 +925,159 @@ public:
 		return Iterator(nullptr);
 	}
 
-	avl_tree(const avl_tree& other) {
+	const Allocator& get_allocator() const {
+		return this->allocator_;
+	}
+	const Compare& key_comp() const {
+		return this->compare_;
+	}
+	// @return The instrumentation policy the tree reports its work to, see instrumentation.hpp.
+	Instrumentation& instrumentation() const {
+		return this->instrumentation_;
+	}
+
+	// Calls function(node) for every node, visiting subtrees of parallel_cutoff_ nodes or more in parallel on pool.
+	// function is called from several threads at once and in no particular order, it may change the data of the node it's given.
+	// Summaries of an augmented tree are recomputed on the way back up, so they take in the changed data. O(n) work.
+	template<typename Function>
+	void for_each(Function&& function, thread_pool& pool = thread_pool::shared()) {
+		this->unshare();
+		if (this->root_) {
+			for_each_in_subtree(this->root_, function, pool);
+		}
+	}
+	// @return reduce(init, transform(first node), ..., transform(last node)) with the nodes in key order, 
+	// where the transforms of subtrees of parallel_cutoff_ nodes or more run in parallel on pool and are reduced as they come back.
+	// Only neighbouring results are reduced with each other, left one first, so reduce has to be associative but not commutative.
+	// transform and reduce are called from several threads at once. O(n) work.
+	template<typename ValueType, typename Reduce, typename Transform>
+	ValueType transform_reduce(ValueType init, Reduce&& reduce, Transform&& transform, thread_pool& pool = thread_pool::shared()) const {
+		if (!this->root_) {
+			return init;
+		}
+		return reduce(std::move(init), *transform_reduce_subtree<ValueType>(this->root_, reduce, transform, pool));
+	}
+	// @return Number of nodes predicate(node) is true for, counted in parallel on pool like transform_reduce() does.
+	template<typename Predicate>
+	size_t count_if(Predicate&& predicate, thread_pool& pool = thread_pool::shared()) const {
+		return this->transform_reduce(size_t(0), std::plus<size_t>(),
+									  [&predicate](const Node& node) { return predicate(node) ? size_t(1) : size_t(0); }, pool);
+	}
+
+	// @return Size, height, average depth and memory footprint of the tree. O(n).
+	// Every node adds one to the depth of each node in its subtree, so the depths are summed from the subtree sizes in one traversal.
+	tree_stats stats() const {
+		tree_stats stats;
+		stats.size = this->size();
+		stats.height = static_cast<size_t>(subtree_height(this->root_));
+		size_t depthSum = 0;
+		for (Iterator it(this->root_ ? find_min_in_subtree(this->root_) : nullptr); it != Iterator(nullptr); ++it) {
+			depthSum += it.ptr_->subtreeSize_;
+		}
+		stats.averageDepth = (stats.size > 0) ? (static_cast<double>(depthSum) / static_cast<double>(stats.size)) : 0.0;
+		stats.memoryBytes = sizeof(avl_tree) + stats.size * (sizeof(Node) + (is_data_cold_ ? sizeof(DataType) : 0));
+		return stats;
+	}
+
+	avl_tree(const avl_tree& other) requires std::copyable<DataType>
+		: avl_tree(other, thread_pool::shared()) {}
+	// Copies other, splitting the copy of a big tree across pool. O(n) work.
+	// O(1) if other has copy-on-write on, see set_copy_on_write().
+	avl_tree(const avl_tree& other, thread_pool& pool) requires std::copyable<DataType>
+		: compare_(other.compare_)
+		, isFingerSearchEnabled_(other.isFingerSearchEnabled_)
+		, isCopyOnWriteEnabled_(other.isCopyOnWriteEnabled_) {
 		this->root_ = nullptr;
-		if (other.root_)
-			clone_subtree(nullptr, this->root_, other.root_);
+		if (other.root_ && other.isCopyOnWriteEnabled_)
+			this->share_nodes(other);
+		else if (other.root_)
+			clone_subtree(nullptr, this->root_, other.root_, this->allocator_, this->coldAllocator_, pool);
+		this->instrumentation_.on_allocations(this->sharedNodes_ ? 0 : this->size());
 	}
-	avl_tree& operator=(const avl_tree& other) {
+	avl_tree& operator=(const avl_tree& other) requires std::copyable<DataType> {
 		this->clear();
-		if (other.root_)
-			clone_subtree(nullptr, this->root_, other.root_);
+		this->compare_ = other.compare_;
+		this->isFingerSearchEnabled_ = other.isFingerSearchEnabled_;
+		this->isCopyOnWriteEnabled_ = other.isCopyOnWriteEnabled_;
+		if (other.root_ && other.isCopyOnWriteEnabled_)
+			this->share_nodes(other);
+		else if (other.root_)
+			clone_subtree(nullptr, this->root_, other.root_, this->allocator_, this->coldAllocator_, thread_pool::shared());
+		this->instrumentation_.on_allocations(this->sharedNodes_ ? 0 : this->size());
 		return *this;
 	}
-	avl_tree(avl_tree&& other) noexcept {
+	avl_tree(avl_tree&& other) noexcept 
+		: allocator_(std::move(other.allocator_))
+		, coldAllocator_(std::move(other.coldAllocator_))
+		, compare_(other.compare_)
+		, isFingerSearchEnabled_(other.isFingerSearchEnabled_)
+		, isCopyOnWriteEnabled_(other.isCopyOnWriteEnabled_)
+		, sharedNodes_(std::move(other.sharedNodes_)) {
 		this->root_ = other.root_;
+		this->finger_ = other.finger_;
 		other.root_ = nullptr;
+		other.finger_ = nullptr;
 	}
 	avl_tree& operator=(avl_tree&& other) noexcept {
 		this->clear();
+		this->allocator_ = std::move(other.allocator_);
+		this->coldAllocator_ = std::move(other.coldAllocator_);
+		this->compare_ = other.compare_;
+		this->isFingerSearchEnabled_ = other.isFingerSearchEnabled_;
+		this->isCopyOnWriteEnabled_ = other.isCopyOnWriteEnabled_;
+		this->sharedNodes_ = std::move(other.sharedNodes_);
 		this->root_ = other.root_;
+		this->finger_ = other.finger_;
 		other.root_ = nullptr;
+		other.finger_ = nullptr;
+		return *this;
 	}
 	~avl_tree() {
 		this->clear();
 	}
 
+	// Bulk loads the tree from a range of key-data pairs in O(n), see assign().
+	template<std::input_iterator PairIterator>
+	avl_tree(PairIterator first, PairIterator last, const Compare& compare = Compare())
+		: root_(nullptr)
+		, compare_(compare) {
+		this->assign(first, last);
+	}
+	explicit avl_tree(const Compare& compare)
+		: root_(nullptr)
+		, compare_(compare) {}
 	avl_tree() 
 		: root_(nullptr) {}
+
+	// Starts its overlap queries at root_, see interval_tree.hpp.
+	template<typename TreePointType, typename TreeDataType, template<typename> typename TreeNodeAllocator>
+		requires (std::copyable<TreePointType> && std::totally_ordered<TreePointType> && std::movable<TreeDataType>)
+	friend class interval_tree;
 private:
-	bool rotate_left(Node* root) {
+	// Where a new key goes: under parent, as its left or right child. 
+	// parent is nullptr if the key is already in the tree, match is then the node holding it.
+	struct InsertPosition {
+		Node* parent = nullptr;
+		bool isLeftChild = false;
+		Node* match = nullptr;
+	};
+	// A node clone_subtree() still has to copy, and the link its copy goes in.
+	struct PendingClone {
+		const Node* source;
+		Node* destinationParent;
+		Node** destination;
+	};
+
+	// One call to compare_ per pair of keys, see three_way_compare().
+	template<typename LeftType, typename RightType>
+	std::weak_ordering compare_keys(const LeftType& left, const RightType& right) const {
+		this->instrumentation_.on_comparison();
+		return three_way_compare(this->compare_, left, right);
+	}
+
+	// Rotations don't update root_ when they rotate the root of the tree, the root just ends up as the child of the new root.
+	// This lets them work on subtrees that are detached from the tree. Callers use reanchor_root() when they are done rebalancing.
+	static bool rotate_left(Node* root) {
 		Node* const pivot = root->right_;
 		bool isHeightReduced = (pivot->balanceFactor_ == -1);
 
@@ -431,10 +1085,7 @@ private:
 		Node* pivotLeft = pivot->left_;
 
 		if (root->parent_) {
-			(root->key < root->parent_->key) ? root->parent_->left_ = pivot : root->parent_->right_ = pivot;
-		}
-		else {
-			this->root_ = pivot;
+			(root->parent_->left_ == root) ? root->parent_->left_ = pivot : root->parent_->right_ = pivot;
 		}
 		pivot->parent_ = root->parent_;
 		
@@ -447,6 +1098,10 @@ private:
 			pivotLeft->parent_ = root;
 		}
 
+		//set subtree sizes and summaries.
+		take_over_subtree(pivot, root);
+		update_subtree(root);
+
 		//set balance factors.
 		if (pivot->balanceFactor_ == -1) {
 			root->balanceFactor_ = 0;
@@ -459,7 +1114,7 @@ private:
 
 		return isHeightReduced;
 	}
-	bool rotate_right_left(Node* root) {
+	static bool rotate_right_left(Node* root) {
 		Node* pivot = root->right_;
 		Node* secondary = pivot->left_;
 
@@ -468,10 +1123,7 @@ private:
 		Node* secondaryRight = secondary->right_;
 
 		if (root->parent_) {
-			(root->key < root->parent_->key) ? root->parent_->left_ = secondary : root->parent_->right_ = secondary;
-		}
-		else {
-			this->root_ = secondary;
+			(root->parent_->left_ == root) ? root->parent_->left_ = secondary : root->parent_->right_ = secondary;
 		}
 		secondary->parent_ = root->parent_;
 
@@ -491,6 +1143,11 @@ private:
 			secondaryRight->parent_ = pivot;
 		}
 
+		//set subtree sizes and summaries.
+		take_over_subtree(secondary, root);
+		update_subtree(root);
+		update_subtree(pivot);
+
 		//set balance factors.
 		if (secondary->balanceFactor_ == -1) {
 			root->balanceFactor_ = 1;
@@ -510,7 +1167,7 @@ private:
 
 		return true;
 	}
-	bool rotate_right(Node* root) {
+	static bool rotate_right(Node* root) {
 		Node* const pivot = root->left_;
 		bool isHeightReduced = (pivot->balanceFactor_ == 1);
 
@@ -518,10 +1175,7 @@ private:
 		Node* pivotRight = pivot->right_;
 
 		if (root->parent_) {
-			(root->key < root->parent_->key) ? root->parent_->left_ = pivot : root->parent_->right_ = pivot;
-		}
-		else {
-			this->root_ = pivot;
+			(root->parent_->left_ == root) ? root->parent_->left_ = pivot : root->parent_->right_ = pivot;
 		}
 		pivot->parent_ = root->parent_;
 
@@ -533,8 +1187,11 @@ private:
 			pivotRight->parent_ = root;
 		}
 
-		//set balance factors.
+		//set subtree sizes and summaries.
+		take_over_subtree(pivot, root);
+		update_subtree(root);
 
+		//set balance factors.
 		if (pivot->balanceFactor_ == 0) {
 			root->balanceFactor_ = 1;
 			pivot->balanceFactor_ = -1;
@@ -546,7 +1203,7 @@ private:
 
 		return isHeightReduced;
 	}
-	bool rotate_left_right(Node* root) {
+	static bool rotate_left_right(Node* root) {
 		Node* pivot = root->left_;
 		Node* secondary = pivot->right_;
 
@@ -555,10 +1212,7 @@ private:
 		Node* secondaryRight = secondary->right_;
 
 		if (root->parent_) {
-			(root->key < root->parent_->key) ? root->parent_->left_ = secondary : root->parent_->right_ = secondary;
-		}
-		else {
-			this->root_ = secondary;
+			(root->parent_->left_ == root) ? root->parent_->left_ = secondary : root->parent_->right_ = secondary;
 		}
 		secondary->parent_ = root->parent_;
 
@@ -578,6 +1232,11 @@ private:
 			secondaryRight->parent_ = root;
 		}
 
+		//set subtree sizes and summaries.
+		take_over_subtree(secondary, root);
+		update_subtree(root);
+		update_subtree(pivot);
+
 		//set balance factors.
 		if (secondary->balanceFactor_ == -1) {
 			root->balanceFactor_ = 0;
@@ -598,94 +1257,171 @@ private:
 		return true;
 	}
 	// Decides which rotation to do depending on the balance factors of the root and its children.
-	bool decide_and_do_rotation(Node* root) {
+	bool decide_and_do_rotation(Node* root) const {
 		if (root->balanceFactor_ == -2) {
 			if (root->right_->balanceFactor_ == 1) {
-				return this->rotate_right_left(root);
+				this->instrumentation_.on_rotation(tree_rotation::right_left);
+				return rotate_right_left(root);
 			}
 			else {
-				return this->rotate_left(root);
+				this->instrumentation_.on_rotation(tree_rotation::left);
+				return rotate_left(root);
 			}
 		}
 		else {
 			if (root->left_->balanceFactor_ == -1) {
-				return this->rotate_left_right(root);
+				this->instrumentation_.on_rotation(tree_rotation::left_right);
+				return rotate_left_right(root);
 			}
 			else {
-				return this->rotate_right(root);
+				this->instrumentation_.on_rotation(tree_rotation::right);
+				return rotate_right(root);
 			}
 		}
 	}
 
 	// Tail recursive method that balances all parents of the inserted node.
-	void balance_parents_after_insert(Node* parent, const KeyType& insertedKey) {
-		const int bfChange = (insertedKey < parent->key) ? 1 : -1; // If insert was to the left root bfChange = +1 else -1
+	// Which side grew is told by which child of parent child is, no keys are compared.
+	void balance_parents_after_insert(Node* parent, const Node* child) const {
+		this->instrumentation_.on_rebalance_step();
+		const int bfChange = (parent->left_ == child) ? 1 : -1; // If insert was to the left root bfChange = +1 else -1
 		parent->balanceFactor_ += bfChange;
 		if (parent->balanceFactor_ == 0) {
 			return;
 		}
 		else if ((parent->balanceFactor_ == 2) || (parent->balanceFactor_ == -2)) {
-			this->decide_and_do_rotation(parent);
+			decide_and_do_rotation(parent);
 		}
 		else {
 			if (parent->parent_) {
-				this->balance_parents_after_insert(parent->parent_, insertedKey);
+				balance_parents_after_insert(parent->parent_, parent);
 			}
 		}
 	}
 	// Tail recursive method that balances all parents of the removed node.
-	void balance_parents_after_remove(Node* parent, const KeyType& removedKey) {
-		const int bfChange = (removedKey <= parent->key) ? -1 : 1; // If pivot is left of root BF change = -1 else +1
+	// isLeftShorter tells which subtree of parent lost height.
+	void balance_parents_after_remove(Node* parent, bool isLeftShorter) const {
+		this->instrumentation_.on_rebalance_step();
+		const int bfChange = isLeftShorter ? -1 : 1;
 		parent->balanceFactor_ += bfChange;
 		if ((parent->balanceFactor_ == -1) || (parent->balanceFactor_ == 1)) {
 			return;
 		}
 		else if ((parent->balanceFactor_ == 2) || (parent->balanceFactor_ == -2)) {
 			Node* grandParent = parent->parent_;
-			if (this->decide_and_do_rotation(parent)) {
+			const bool isParentLeftChild = grandParent && (grandParent->left_ == parent);
+			if (decide_and_do_rotation(parent)) {
 				if (grandParent) {
-					this->balance_parents_after_remove(grandParent, removedKey);
+					balance_parents_after_remove(grandParent, isParentLeftChild);
 				}
 			}
 		}
 		else {
 			if (parent->parent_) {
-				this->balance_parents_after_remove(parent->parent_, removedKey);
+				balance_parents_after_remove(parent->parent_, parent->parent_->left_ == parent);
 			}
 		}
 	}
 
-	// Inserts the node into the tree at the specified parent and does the rebalancing.
-	void insert_node_at(Node* parent, Node* node) {
-		node->parent_ = parent;
-		if (node->key < parent->key) {
-			parent->left_ = node;
+	// Inserts the node into the tree at the specified position and does the rebalancing.
+	void insert_node_at(InsertPosition position, Node* node) {
+		node->parent_ = position.parent;
+		if (position.isLeftChild) {
+			position.parent->left_ = node;
 		}
 		else {
-			parent->right_ = node;
+			position.parent->right_ = node;
 		}
-		this->balance_parents_after_insert(parent, node->key);
+		add_to_subtree_sizes(position.parent, 1);
+		balance_parents_after_insert(position.parent, node);
+		this->reanchor_root();
+		this->finger_ = node;
 	}
 
-	// @return nullptr if key is already in the tree.
-	static Node* find_parent_for_key_in_subtree(const KeyType& key, Node* root) {
-		if (root->key == key) {
-			return nullptr;
+	// Searches for key once, and links in the node makeNode() creates if key is not in the tree.
+	// @return The node with key, and whether it was created.
+	template<typename NodeFactory>
+	std::pair<Node*, bool> find_or_create(const KeyType& key, NodeFactory&& makeNode) {
+		this->unshare();
+		if (!this->root_) {
+			this->root_ = makeNode();
+			return { this->root_, true };
 		}
-		else if (key < root->key) {
-			if (!root->left_) {
-				return root;
-			}
-			else {
-				return find_parent_for_key_in_subtree(key, root->left_);
+		InsertPosition position = this->find_insert_position(key);
+		if (!position.parent) {
+			return { position.match, false };
+		}
+		Node* node = makeNode();
+		this->insert_node_at(position, node);
+		return { node, true };
+	}
+
+	// A rotation at the root leaves the old root as the child of the new one, so this moves root_ up a level if needed.
+	void reanchor_root() {
+		if (this->root_ && this->root_->parent_) {
+			this->root_ = this->root_->parent_;
+		}
+	}
+
+	// Starts at the finger if finger search is on, at the root otherwise.
+	InsertPosition find_insert_position(const KeyType& key) {
+		Node* const start = (this->isFingerSearchEnabled_ && this->finger_) ? this->climb_to_cover(key, this->finger_) : this->root_;
+		return this->find_insert_position_in_subtree(key, start);
+	}
+	// Climbs up from node to the first node whose subtree's key range covers key. 
+	// Runs of left (or right) child links are climbed without looking at keys, only the ancestor at the end of each run is compared.
+	// @return The node to start searching for key from.
+	Node* climb_to_cover(const KeyType& key, Node* node) const {
+		if (this->compare_keys(key, node->key) < 0) {
+			while (true) {
+				Node* child = node;
+				Node* lowerBound = node->parent_;
+				while (lowerBound && lowerBound->left_ == child) {
+					this->instrumentation_.on_visit();
+					child = lowerBound;
+					lowerBound = lowerBound->parent_;
+				}
+				if (!lowerBound || this->compare_keys(lowerBound->key, key) < 0) {
+					return node;
+				}
+				node = lowerBound;
 			}
 		}
 		else {
-			if (!root->right_) {
-				return root;
+			while (true) {
+				Node* child = node;
+				Node* upperBound = node->parent_;
+				while (upperBound && upperBound->right_ == child) {
+					this->instrumentation_.on_visit();
+					child = upperBound;
+					upperBound = upperBound->parent_;
+				}
+				if (!upperBound || this->compare_keys(key, upperBound->key) < 0) {
+					return node;
+				}
+				node = upperBound;
+			}
+		}
+	}
+	// Searches a subtree for the place to attach key at, with one comparison per node on the way.
+	InsertPosition find_insert_position_in_subtree(const KeyType& key, Node* node) const {
+		while (true) {
+			this->instrumentation_.on_visit();
+			const std::weak_ordering order = this->compare_keys(key, node->key);
+			if (order < 0) {
+				if (!node->left_) {
+					return { node, true, nullptr };
+				}
+				node = node->left_;
+			}
+			else if (order > 0) {
+				if (!node->right_) {
+					return { node, false, nullptr };
+				}
+				node = node->right_;
 			}
 			else {
-				return find_parent_for_key_in_subtree(key, root->right_);
+				return { nullptr, false, node };
 			}
 		}
 	}
@@ -704,22 +1440,65 @@ private:
 		}
 		return largestNode;
 	}
+	// Trades the tree positions of a node with two children and the max() of its left subtree, which has no right child.
+	// Links, balance factors, subtree sizes and summaries change places, the keys and data stay in their nodes.
+	// The summaries on the path between the two are left stale for the removal to recompute.
+	// Afterwards node has at most one child, and the predecessor sits where node was. Used by remove().
+	void swap_with_predecessor(Node* node) {
+		Node* const predecessor = find_max_in_subtree(node->left_);
+		Node* const parent = node->parent_;
+		Node* const predecessorLeft = predecessor->left_;
+
+		if (parent) {
+			(parent->left_ == node) ? parent->left_ = predecessor : parent->right_ = predecessor;
+		}
+		else {
+			this->root_ = predecessor;
+		}
+		if (predecessor == node->left_) {
+			predecessor->left_ = node;
+			node->parent_ = predecessor;
+		}
+		else {
+			predecessor->left_ = node->left_;
+			node->left_->parent_ = predecessor;
+			predecessor->parent_->right_ = node;
+			node->parent_ = predecessor->parent_;
+		}
+		predecessor->parent_ = parent;
+		predecessor->right_ = node->right_;
+		node->right_->parent_ = predecessor;
+		node->left_ = predecessorLeft;
+		if (predecessorLeft) {
+			predecessorLeft->parent_ = node;
+		}
+		node->right_ = nullptr;
+
+		std::swap(node->balanceFactor_, predecessor->balanceFactor_);
+		std::swap(node->subtreeSize_, predecessor->subtreeSize_);
+		if constexpr (is_augmented_) {
+			std::swap(node->summary_, predecessor->summary_);
+		}
+	}
 
 	// Tail recursive method that searches a subtree for key.
 	// Used by search() and remove() methods.
 	// @return nullptr if key is not present in the tree.
-	static Node* search_subtree(const KeyType& key, Node* node) {
-		if (key < node->key) {
+	template<typename LookupKeyType>
+	Node* search_subtree(const LookupKeyType& key, Node* node) const {
+		this->instrumentation_.on_visit();
+		const std::weak_ordering order = this->compare_keys(key, node->key);
+		if (order < 0) {
 			if (node->left_) {
-				return search_subtree(key, node->left_);
+				return this->search_subtree(key, node->left_);
 			}
 			else {
 				return nullptr;
 			}
 		}
-		else if (key > node->key) {
+		else if (order > 0) {
 			if (node->right_) {
-				return search_subtree(key, node->right_);
+				return this->search_subtree(key, node->right_);
 			}
 			else {
 				return nullptr;
@@ -730,17 +1509,672 @@ private:
 		}
 	}
 
-	// Recursive method that copies a subtree to destination. 
-	// May overflow the stack if used on trees too big. Too bad.
-	// Used by the copy constructor and the copy assign operator.
-	static void clone_subtree(Node* destinationParent, Node*& destination, Node*& source) {
-		destination = new Node(*source);
+	static size_t subtree_size(const Node* node) {
+		return node ? node->subtreeSize_ : 0;
+	}
+	static Summary subtree_summary(const Node* node) {
+		if constexpr (is_augmented_) {
+			return node ? node->summary_ : Augmentation::identity();
+		}
+		else {
+			return Summary();
+		}
+	}
+	// Recomputes the summary of node from its children. Does nothing if the tree isn't augmented.
+	static void update_summary(Node* node) {
+		if constexpr (is_augmented_) {
+			node->summary_ = Augmentation::combine(Augmentation::combine(subtree_summary(node->left_), Augmentation::summarize(node->key, node->data)),
+												   subtree_summary(node->right_));
+		}
+	}
+	// Recomputes the subtree size and the summary of node from its children.
+	static void update_subtree(Node* node) {
+		node->subtreeSize_ = subtree_size(node->left_) + subtree_size(node->right_) + 1;
+		update_summary(node);
+	}
+	// A rotation's new subtree root holds the same nodes the old one did, so it takes over its size and summary.
+	static void take_over_subtree(Node* newRoot, const Node* oldRoot) {
+		newRoot->subtreeSize_ = oldRoot->subtreeSize_;
+		if constexpr (is_augmented_) {
+			newRoot->summary_ = oldRoot->summary_;
+		}
+	}
+	// Adds change to the subtree sizes of node and all of its parents, and recomputes their summaries.
+	// Used when a node is attached to or detached from the tree, before any rebalancing.
+	static void add_to_subtree_sizes(Node* node, ptrdiff_t change) {
+		while (node) {
+			node->subtreeSize_ += change;
+			update_summary(node);
+			node = node->parent_;
+		}
+	}
+	// @return Index of node in sorted order by climbing to the root. size() for nullptr (the end() iterator).
+	size_t index_of(const Node* node) const {
+		if (!node) {
+			return this->size();
+		}
+		size_t index = subtree_size(node->left_);
+		while (node->parent_) {
+			if (node->parent_->right_ == node) {
+				index += subtree_size(node->parent_->left_) + 1;
+			}
+			node = node->parent_;
+		}
+		return index;
+	}
+
+	// Every node goes through these, so out of line data gets its cold slot allocated and freed with the node.
+	template <typename... ArgTypes>
+	Node* create_node(const KeyType& key, ArgTypes&&... args) {
+		Node* node = create_node_in(this->allocator_, this->coldAllocator_, key, std::forward<ArgTypes>(args)...);
+		this->instrumentation_.on_allocations(1);
+		return node;
+	}
+	// Same as create_node() with allocators other than the tree's own, see clone_subtree().
+	template <typename... ArgTypes>
+	static Node* create_node_in(Allocator& allocator, ColdAllocator& coldAllocator, const KeyType& key, ArgTypes&&... args) {
+		Node* node;
+		if constexpr (is_data_cold_) {
+			DataType* data = coldAllocator.create(std::forward<ArgTypes>(args)...);
+			try {
+				node = allocator.create(key, *data);
+			}
+			catch (...) {
+				coldAllocator.destroy(data);
+				throw;
+			}
+		}
+		else {
+			node = allocator.create(key, std::forward<ArgTypes>(args)...);
+		}
+		if constexpr (is_augmented_) {
+			node->summary_ = Augmentation::summarize(node->key, node->data);
+		}
+		return node;
+	}
+	void destroy_node(Node* node) {
+		this->instrumentation_.on_deallocations(1);
+		if constexpr (is_data_cold_) {
+			DataType* data = &node->data;
+			this->allocator_.destroy(node);
+			this->coldAllocator_.destroy(data);
+		}
+		else {
+			this->allocator_.destroy(node);
+		}
+	}
+	void reserve_nodes(size_t count) {
+		this->allocator_.reserve(count);
+		if constexpr (is_data_cold_) {
+			this->coldAllocator_.reserve(count);
+		}
+	}
+	// Lets this tree destroy and keep alive nodes (and cold slots) created by other.
+	// Makes the tree a copy-on-write copy of other. The first copy of other moves its nodes under an owner tree, 
+	// which shares the allocators of other and destructs the nodes once the last tree sharing them lets go.
+	void share_nodes(const avl_tree& other) {
+		if (!other.sharedNodes_) {
+			other.sharedNodes_ = std::make_shared<avl_tree>(other.compare_);
+			other.sharedNodes_->root_ = other.root_;
+			other.sharedNodes_->share_allocators(other);
+		}
+		this->sharedNodes_ = other.sharedNodes_;
+		this->root_ = other.root_;
+		this->share_allocators(other);
+	}
+	// @return true if key is in the nodes the tree shares with copies of it.
+	// Inserts check this before unshare(), so inserting a key that is already there doesn't clone the nodes.
+	bool is_shared_with_key(const KeyType& key) const {
+		return this->is_shared() && this->search_subtree(key, this->root_);
+	}
+	// Gives the tree its nodes to itself before an update, see set_copy_on_write().
+	// Nodes that no other tree shares anymore are taken back as they are, otherwise they are cloned. O(n) if cloned.
+	// @return true if the nodes were cloned, nodes and iterators from before the call then belong to the other trees.
+	bool unshare() {
+		if constexpr (std::copyable<DataType>) {
+			if (!this->sharedNodes_) {
+				return false;
+			}
+			if (this->sharedNodes_.use_count() == 1) {
+				// Copies may have let go on other threads, their reads of the nodes have to happen before the updates to them.
+				std::atomic_thread_fence(std::memory_order_acquire);
+				this->sharedNodes_->root_ = nullptr;
+				this->sharedNodes_.reset();
+				return false;
+			}
+			// The old allocators keep referencing the shared nodes' memory, fresh ones let it go with the last sharing tree.
+			Node* const source = this->root_;
+			this->root_ = nullptr;
+			this->finger_ = nullptr;
+			this->allocator_ = Allocator();
+			this->coldAllocator_ = ColdAllocator();
+			clone_subtree(nullptr, this->root_, source, this->allocator_, this->coldAllocator_, thread_pool::shared());
+			this->instrumentation_.on_allocations(this->size());
+			this->sharedNodes_.reset();
+			return true;
+		}
+		else {
+			// Trees of move-only data can't be copied, so their nodes are never shared.
+			return false;
+		}
+	}
+	void share_allocators(const avl_tree& other) {
+		this->allocator_.share(other.allocator_);
+		if constexpr (is_data_cold_) {
+			this->coldAllocator_.share(other.coldAllocator_);
+		}
+	}
+
+	// Destructs all nodes of a subtree without recursion by climbing back up through parent pointers.
+	// Used by clear() when the nodes can't just be dropped with the allocator's blocks.
+	void destroy_subtree(Node* node) {
+		Node* const stop = node->parent_;
+		while (node != stop) {
+			if (node->left_) {
+				node = node->left_;
+			}
+			else if (node->right_) {
+				node = node->right_;
+			}
+			else {
+				Node* parent = node->parent_;
+				if (parent) {
+					(parent->left_ == node) ? parent->left_ = nullptr : parent->right_ = nullptr;
+				}
+				this->destroy_node(node);
+				node = parent;
+			}
+		}
+	}
+
+	// <<<----------- Split/join internals ----------->>>
+	// Subtrees passed around here are detached, their root has no parent.
+	// Carrying heights along keeps split and join O(logn) without storing heights in the nodes.
+	struct Subtree {
+		Node* root = nullptr;
+		int height = 0;
+	};
+	struct SplitSubtrees {
+		Subtree less;
+		Node* match = nullptr;
+		Subtree greater;
+	};
+	// Nodes dropped by the set operations, chained through the parent pointers of the dropped subtree roots.
+	// They are destroyed after the operation is done, so the parallel halves never touch the allocator.
+	struct DroppedNodes {
+		Node* head = nullptr;
+		Node* tail = nullptr;
+
+		void push(Node* subtreeRoot) {
+			if (!subtreeRoot) {
+				return;
+			}
+			subtreeRoot->parent_ = nullptr;
+			if (this->tail) {
+				this->tail->parent_ = subtreeRoot;
+			}
+			else {
+				this->head = subtreeRoot;
+			}
+			this->tail = subtreeRoot;
+		}
+		void append(DroppedNodes& other) {
+			if (!other.head) {
+				return;
+			}
+			if (this->tail) {
+				this->tail->parent_ = other.head;
+			}
+			else {
+				this->head = other.head;
+			}
+			this->tail = other.tail;
+		}
+	};
+	// Subtrees with at least this many nodes between the two operands of a set operation, in a copy, or in a parallel traversal, are split across the thread pool.
+	static constexpr size_t parallel_cutoff_ = 1 << 14;
+
+	// Detaches the whole tree from root_.
+	Subtree take_subtree() {
+		Subtree tree = { this->root_, subtree_height(this->root_) };
+		this->root_ = nullptr;
+		this->finger_ = nullptr;
+		return tree;
+	}
+	void destroy_dropped(DroppedNodes& dropped) {
+		Node* subtreeRoot = dropped.head;
+		while (subtreeRoot) {
+			Node* next = subtreeRoot->parent_;
+			subtreeRoot->parent_ = nullptr;
+			this->destroy_subtree(subtreeRoot);
+			subtreeRoot = next;
+		}
+	}
+
+	// @return Height of a subtree by following the taller child down. O(logn).
+	static int subtree_height(const Node* node) {
+		int height = 0;
+		while (node) {
+			height++;
+			node = (node->balanceFactor_ < 0) ? node->right_ : node->left_;
+		}
+		return height;
+	}
+	static Subtree detach_left(Subtree tree) {
+		Node* const left = tree.root->left_;
+		if (left) {
+			left->parent_ = nullptr;
+		}
+		return { left, (tree.root->balanceFactor_ >= 0) ? (tree.height - 1) : (tree.height - 2) };
+	}
+	static Subtree detach_right(Subtree tree) {
+		Node* const right = tree.root->right_;
+		if (right) {
+			right->parent_ = nullptr;
+		}
+		return { right, (tree.root->balanceFactor_ <= 0) ? (tree.height - 1) : (tree.height - 2) };
+	}
+	// Turns node into a lone leaf. The caller has to have taken care of its children.
+	static Node* isolate(Node* node) {
+		node->parent_ = nullptr;
+		node->left_ = nullptr;
+		node->right_ = nullptr;
+		node->balanceFactor_ = 0;
+		update_subtree(node);
+		return node;
+	}
+	// Makes left and right the children of node. Their heights can differ by at most one.
+	static void link_children(Node* node, Subtree left, Subtree right) {
+		node->left_ = left.root;
+		if (left.root) {
+			left.root->parent_ = node;
+		}
+		node->right_ = right.root;
+		if (right.root) {
+			right.root->parent_ = node;
+		}
+		node->balanceFactor_ = static_cast<int_fast8_t>(left.height - right.height);
+		update_subtree(node);
+	}
+
+	// Joins left, pivot and right into one subtree. Every key in left has to be smaller than pivot's and every key in right bigger.
+	// O(difference in height of left and right).
+	Subtree join_subtrees(Subtree left, Node* pivot, Subtree right) const {
+		if (left.height > right.height + 1) {
+			return join_into_right_spine(left, pivot, right);
+		}
+		else if (right.height > left.height + 1) {
+			return join_into_left_spine(left, pivot, right);
+		}
+		else {
+			link_children(pivot, left, right);
+			pivot->parent_ = nullptr;
+			return { pivot, ((left.height > right.height) ? left.height : right.height) + 1 };
+		}
+	}
+	// Walks down the right spine of the taller left subtree until it finds a node at most a level taller than right, 
+	// replaces it with pivot, hangs it and right under pivot, then rebalances upwards like an insert would.
+	Subtree join_into_right_spine(Subtree left, Node* pivot, Subtree right) const {
+		Node* parent = nullptr;
+		Subtree spine = left;
+		while (spine.height > right.height + 1) {
+			parent = spine.root;
+			spine = { spine.root->right_, (spine.root->balanceFactor_ <= 0) ? (spine.height - 1) : (spine.height - 2) };
+		}
+		link_children(pivot, spine, right);
+		pivot->parent_ = parent;
+		parent->right_ = pivot;
+		add_to_subtree_sizes(parent, subtree_size(right.root) + 1);
+
+		const bool isHeightIncreased = balance_parents_after_growth(parent, pivot);
+		return { left.root->parent_ ? left.root->parent_ : left.root, left.height + (isHeightIncreased ? 1 : 0) };
+	}
+	// Mirror of join_into_right_spine().
+	Subtree join_into_left_spine(Subtree left, Node* pivot, Subtree right) const {
+		Node* parent = nullptr;
+		Subtree spine = right;
+		while (spine.height > left.height + 1) {
+			parent = spine.root;
+			spine = { spine.root->left_, (spine.root->balanceFactor_ >= 0) ? (spine.height - 1) : (spine.height - 2) };
+		}
+		link_children(pivot, left, spine);
+		pivot->parent_ = parent;
+		parent->left_ = pivot;
+		add_to_subtree_sizes(parent, subtree_size(left.root) + 1);
+
+		const bool isHeightIncreased = balance_parents_after_growth(parent, pivot);
+		return { right.root->parent_ ? right.root->parent_ : right.root, right.height + (isHeightIncreased ? 1 : 0) };
+	}
+	// Joins two subtrees without a pivot by splitting the smallest node off of right and using it as one. O(logn).
+	Subtree join_subtrees(Subtree left, Subtree right) const {
+		if (!left.root) {
+			return right;
+		}
+		if (!right.root) {
+			return left;
+		}
+		Node* pivot = nullptr;
+		right = split_off_min(right, pivot);
+		return join_subtrees(left, pivot, right);
+	}
+	// Recursive method that removes the smallest node of a subtree and hands it back through min.
+	Subtree split_off_min(Subtree tree, Node*& min) const {
+		Node* const node = tree.root;
+		Subtree right = detach_right(tree);
+		if (!node->left_) {
+			min = isolate(node);
+			return right;
+		}
+		Subtree rest = split_off_min(detach_left(tree), min);
+		return join_subtrees(rest, node, right);
+	}
+
+	// Propagates a one level height increase of child up through its parents, rotating where needed.
+	// Unlike balance_parents_after_insert(), keeps going after a rotation that doesn't bring the height back down.
+	// @return true if the increase made it past the topmost parent.
+	bool balance_parents_after_growth(Node* parent, Node* child) const {
+		while (parent) {
+			this->instrumentation_.on_rebalance_step();
+			parent->balanceFactor_ += (parent->left_ == child) ? 1 : -1;
+			if (parent->balanceFactor_ == 0) {
+				return false;
+			}
+			else if ((parent->balanceFactor_ == 2) || (parent->balanceFactor_ == -2)) {
+				if (decide_and_do_rotation(parent)) {
+					return false;
+				}
+				child = parent->parent_;
+			}
+			else {
+				child = parent;
+			}
+			parent = child->parent_;
+		}
+		return true;
+	}
+
+	// Recursive method that splits a subtree into the keys smaller than key, the node with key if there is one, and the keys bigger than key.
+	// O(logn) since the heights of the joins on the way back up telescope.
+	SplitSubtrees split_subtree(Subtree tree, const KeyType& key) const {
+		if (!tree.root) {
+			return SplitSubtrees();
+		}
+		Node* const node = tree.root;
+		Subtree left = detach_left(tree);
+		Subtree right = detach_right(tree);
+		const std::weak_ordering order = this->compare_keys(key, node->key);
+		if (order < 0) {
+			SplitSubtrees parts = this->split_subtree(left, key);
+			parts.greater = join_subtrees(parts.greater, node, right);
+			return parts;
+		}
+		else if (order > 0) {
+			SplitSubtrees parts = this->split_subtree(right, key);
+			parts.less = join_subtrees(left, node, parts.less);
+			return parts;
+		}
+		else {
+			return { left, isolate(node), right };
+		}
+	}
+
+	// Recursive set operations, see union_with(), intersect_with() and difference_with().
+	// The first operand's root splits the second one, then the halves are handled on their own and joined back.
+	Subtree union_subtrees(Subtree tree, Subtree other, DroppedNodes& dropped, thread_pool& pool) const {
+		if (!tree.root) {
+			return other;
+		}
+		if (!other.root) {
+			return tree;
+		}
+		Node* const node = tree.root;
+		const bool isParallel = (node->subtreeSize_ + other.root->subtreeSize_ >= parallel_cutoff_);
+		Subtree treeLeft = detach_left(tree);
+		Subtree treeRight = detach_right(tree);
+		SplitSubtrees otherParts = this->split_subtree(other, node->key);
+		dropped.push(otherParts.match);
+
+		Subtree left, right;
+		DroppedNodes leftDropped;
+		run_halves(pool, isParallel,
+			[&]() { left = this->union_subtrees(treeLeft, otherParts.less, leftDropped, pool); },
+			[&]() { right = this->union_subtrees(treeRight, otherParts.greater, dropped, pool); });
+		dropped.append(leftDropped);
+		return join_subtrees(left, node, right);
+	}
+	Subtree intersect_subtrees(Subtree tree, Subtree other, DroppedNodes& dropped, thread_pool& pool) const {
+		if (!tree.root || !other.root) {
+			dropped.push(tree.root);
+			dropped.push(other.root);
+			return Subtree();
+		}
+		Node* const node = tree.root;
+		const bool isParallel = (node->subtreeSize_ + other.root->subtreeSize_ >= parallel_cutoff_);
+		Subtree treeLeft = detach_left(tree);
+		Subtree treeRight = detach_right(tree);
+		SplitSubtrees otherParts = this->split_subtree(other, node->key);
+
+		Subtree left, right;
+		DroppedNodes leftDropped;
+		run_halves(pool, isParallel,
+			[&]() { left = this->intersect_subtrees(treeLeft, otherParts.less, leftDropped, pool); },
+			[&]() { right = this->intersect_subtrees(treeRight, otherParts.greater, dropped, pool); });
+		dropped.append(leftDropped);
+		if (otherParts.match) {
+			dropped.push(otherParts.match);
+			return join_subtrees(left, node, right);
+		}
+		else {
+			dropped.push(isolate(node));
+			return join_subtrees(left, right);
+		}
+	}
+	Subtree difference_subtrees(Subtree tree, Subtree other, DroppedNodes& dropped, thread_pool& pool) const {
+		if (!tree.root || !other.root) {
+			dropped.push(other.root);
+			return tree;
+		}
+		Node* const node = other.root;
+		const bool isParallel = (tree.root->subtreeSize_ + node->subtreeSize_ >= parallel_cutoff_);
+		Subtree otherLeft = detach_left(other);
+		Subtree otherRight = detach_right(other);
+		SplitSubtrees treeParts = this->split_subtree(tree, node->key);
+
+		Subtree left, right;
+		DroppedNodes leftDropped;
+		run_halves(pool, isParallel,
+			[&]() { left = this->difference_subtrees(treeParts.less, otherLeft, leftDropped, pool); },
+			[&]() { right = this->difference_subtrees(treeParts.greater, otherRight, dropped, pool); });
+		dropped.append(leftDropped);
+		dropped.push(isolate(node));
+		dropped.push(treeParts.match);
+		return join_subtrees(left, right);
+	}
+	// Runs both halves of a set operation, the left one on the pool if isParallel is set.
+	template<typename LeftFunction, typename RightFunction>
+	static void run_halves(thread_pool& pool, bool isParallel, LeftFunction&& leftFunction, RightFunction&& rightFunction) {
+		if (isParallel) {
+			pool.fork_join(std::forward<LeftFunction>(leftFunction), std::forward<RightFunction>(rightFunction));
+		}
+		else {
+			leftFunction();
+			rightFunction();
+		}
+	}
+
+	// Stable sorts elements by key and drops all but the first of equal keys.
+	// Used by assign().
+	template<typename ElementType, typename KeyOf>
+	void sort_and_remove_duplicates(std::vector<ElementType>& elements, const KeyOf& keyOf) const {
+		std::stable_sort(elements.begin(), elements.end(), [this, &keyOf](const ElementType& left, const ElementType& right) {
+			return this->compare_keys(keyOf(left), keyOf(right)) < 0;
+		});
+		const auto newEnd = std::unique(elements.begin(), elements.end(), [this, &keyOf](const ElementType& left, const ElementType& right) {
+			return this->compare_keys(keyOf(left), keyOf(right)) == 0;
+		});
+		elements.erase(newEnd, elements.end());
+	}
+
+	// Recursive method that builds a perfectly balanced subtree from the sorted elements in [begin, end).
+	// Recursion depth is O(logn). Nodes are created in pre-order, so a subtree ends up contiguous in a reserved block.
+	// The left half gets the smaller half of the elements, so balance factors follow from the subtree sizes alone.
+	// Used by assign().
+	template<typename ElementAt>
+	Node* build_subtree(const ElementAt& elementAt, size_t begin, size_t end, Node* parent) {
+		if (begin == end) {
+			return nullptr;
+		}
+		const size_t middle = begin + (end - begin) / 2;
+		decltype(auto) element = elementAt(middle);
+		Node* node = this->create_node(std::get<0>(element), std::get<1>(std::forward<decltype(element)>(element)));
+		node->parent_ = parent;
+		node->subtreeSize_ = end - begin;
+		node->balanceFactor_ = static_cast<int_fast8_t>(std::bit_width(middle - begin) - std::bit_width(end - middle - 1));
+		node->left_ = this->build_subtree(elementAt, begin, middle, node);
+		node->right_ = this->build_subtree(elementAt, middle + 1, end, node);
+		update_summary(node);
+		return node;
+	}
+
+	// Visits a subtree for for_each(). A node with parallel_cutoff_ nodes or more under it has both children,
+	// its left subtree is visited on pool while the calling thread visits the node and its right subtree.
+	template<typename Function>
+	static void for_each_in_subtree(Node* node, Function& function, thread_pool& pool) {
+		if (node->subtreeSize_ < parallel_cutoff_) {
+			visit_in_order(node, function);
+			if constexpr (is_augmented_) {
+				update_subtree_summaries(node);
+			}
+			return;
+		}
+		pool.fork_join(
+			[&]() { for_each_in_subtree(node->left_, function, pool); },
+			[&]() {
+				function(*node);
+				for_each_in_subtree(node->right_, function, pool);
+			});
+		update_summary(node);
+	}
+	// Calls function on every node of a subtree in key order, keeping the path to the next node on a stack.
+	// Cheaper than following parent pointers from one node to the next, and the stack is only as deep as the subtree is high.
+	template<typename Function>
+	static void visit_in_order(Node* node, Function&& function) {
+		std::vector<Node*> path;
+		while (node || !path.empty()) {
+			while (node) {
+				path.push_back(node);
+				node = node->left_;
+			}
+			node = path.back();
+			path.pop_back();
+			function(*node);
+			node = node->right_;
+		}
+	}
+	// Recomputes every summary of a subtree, children first. Recursion depth is the subtree's height.
+	static void update_subtree_summaries(Node* node) {
+		if (node) {
+			update_subtree_summaries(node->left_);
+			update_subtree_summaries(node->right_);
+			update_summary(node);
+		}
+	}
+	// Reduces a subtree in key order for transform_reduce(). Subtrees are split like for_each_in_subtree() splits them.
+	// @return std::nullopt for an empty subtree.
+	template<typename ValueType, typename Reduce, typename Transform>
+	static std::optional<ValueType> transform_reduce_subtree(Node* node, Reduce& reduce, Transform& transform, thread_pool& pool) {
+		if (!node) {
+			return std::nullopt;
+		}
+		if (node->subtreeSize_ < parallel_cutoff_) {
+			std::optional<ValueType> result;
+			visit_in_order(node, [&](const Node& visited) {
+				if (result) {
+					result = reduce(std::move(*result), transform(visited));
+				}
+				else {
+					result.emplace(transform(visited));
+				}
+			});
+			return result;
+		}
+		std::optional<ValueType> left;
+		std::optional<ValueType> right;
+		pool.fork_join(
+			[&]() { left = transform_reduce_subtree<ValueType>(node->left_, reduce, transform, pool); },
+			[&]() { right = transform_reduce_subtree<ValueType>(node->right_, reduce, transform, pool); });
+		ValueType result = reduce(std::move(*left), transform(static_cast<const Node&>(*node)));
+		return reduce(std::move(result), std::move(*right));
+	}
+
+	// Copies a subtree to destination. Used by the copy constructor and the copy assign operator.
+	// Subtrees of parallel_cutoff_ nodes or more have their left half copied on pool while the calling thread copies the right one.
+	// A forked half takes its nodes from allocators of its own, which allocator and coldAllocator share once it's done.
+	static void clone_subtree(Node* destinationParent, Node*& destination, const Node* source,
+							  Allocator& allocator, ColdAllocator& coldAllocator, thread_pool& pool) {
+		if (source->subtreeSize_ < parallel_cutoff_) {
+			clone_subtree(destinationParent, destination, source, allocator, coldAllocator);
+			return;
+		}
+		Node* const copy = clone_node(destinationParent, destination, source, allocator, coldAllocator);
+		Allocator leftAllocator;
+		ColdAllocator leftColdAllocator;
+		auto shareLeftAllocators = [&]() {
+			allocator.share(leftAllocator);
+			if constexpr (is_data_cold_) {
+				coldAllocator.share(leftColdAllocator);
+			}
+		};
+		try {
+			pool.fork_join(
+				[&]() { clone_subtree(copy, copy->left_, source->left_, leftAllocator, leftColdAllocator, pool); },
+				[&]() { clone_subtree(copy, copy->right_, source->right_, allocator, coldAllocator, pool); });
+		}
+		catch (...) {
+			shareLeftAllocators();
+			throw;
+		}
+		shareLeftAllocators();
+	}
+	// Copies a subtree to destination without recursion, in preorder with the children still to be copied kept on a stack.
+	// Copies are allocated in preorder, so a slab allocator packs each subtree's top levels into the same blocks.
+	// Every copy is linked to its parent as soon as it's made, so a copy that throws halfway leaves a tree clear() can destroy.
+	static void clone_subtree(Node* destinationParent, Node*& destination, const Node* source,
+							  Allocator& allocator, ColdAllocator& coldAllocator) {
+		std::vector<PendingClone> pending;
+		pending.push_back({ source, destinationParent, &destination });
+		while (!pending.empty()) {
+			const PendingClone next = pending.back();
+			pending.pop_back();
+			Node* const copy = clone_node(next.destinationParent, *next.destination, next.source, allocator, coldAllocator);
+			if (next.source->right_) {
+				pending.push_back({ next.source->right_, copy, &copy->right_ });
+			}
+			if (next.source->left_) {
+				pending.push_back({ next.source->left_, copy, &copy->left_ });
+			}
+		}
+	}
+	// Copies a single node, without its children, to destination.
+	static Node* clone_node(Node* destinationParent, Node*& destination, const Node* source,
+							Allocator& allocator, ColdAllocator& coldAllocator) {
+		destination = create_node_in(allocator, coldAllocator, source->key, source->data);
+		destination->balanceFactor_ = source->balanceFactor_;
+		take_over_subtree(destination, source);
 		destination->parent_ = destinationParent;
-		if (source->left_)
-			clone_subtree(destination, destination->left_, source->left_);
-		if (source->right_)
-			clone_subtree(destination, destination->right_, source->right_);
+		return destination;
 	}
 
 	Node* root_;
+	Allocator allocator_;
+	ColdAllocator coldAllocator_;
+	Compare compare_;
+	// Last inserted node, where finger search starts from.
+	Node* finger_ = nullptr;
+	bool isFingerSearchEnabled_ = false;
+	bool isCopyOnWriteEnabled_ = false;
+	// Owner of the nodes while they are shared with copy-on-write copies, see share_nodes(). Set by copying, so mutable.
+	mutable std::shared_ptr<avl_tree> sharedNodes_;
+	// Hooks are called from const members too, counting doesn't change the tree.
+	mutable Instrumentation instrumentation_;
 };
\ No newline at end of file
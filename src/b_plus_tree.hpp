@@ -0,0 +1,1043 @@
+#pragma once
+#include "node_allocator.hpp"
+#include "key_compare.hpp"
+#include "instrumentation.hpp"
+
+#include <concepts>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <cstring>
+#include <bit>
+#include <array>
+#include <compare>
+
+#if defined(__AVX2__)
+#define B_PLUS_TREE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define B_PLUS_TREE_SSE2
+#include <emmintrin.h>
+#if defined(__SSE4_2__)
+#define B_PLUS_TREE_SSE42
+#include <nmmintrin.h>
+#endif
+#endif
+
+
+
+// <<<-------------------------------------------------->>>
+// <<<----------- Class forward declarations ----------->>>
+// <<<-------------------------------------------------->>>
+template<typename KeyType, typename DataType, typename LeafType>
+class b_plus_tree_iterator;
+template<typename KeyType, typename DataType, typename LeafType>
+class b_plus_tree_range;
+template<typename KeyType, typename DataType, size_t Capacity, size_t KeySlots>
+class b_plus_tree_leaf;
+template<typename KeyType, size_t Capacity, size_t KeySlots>
+class b_plus_tree_inner_node;
+template<typename KeyType, typename DataType, template<typename> typename NodeAllocator = slab_allocator, typename Compare = three_way_key_compare,
+		 size_t NodeCacheLines = 4>
+	requires (std::copyable<KeyType> && std::movable<DataType>
+			  && key_comparator_for<Compare, KeyType, KeyType> && (NodeCacheLines > 0))
+class b_plus_tree;
+
+
+
+// An element of a b_plus_tree, as seen through an iterator.
+// Keys and data are kept in separate arrays of a leaf, so an element is a pair of references into them.
+template<typename KeyType, typename DataType>
+struct b_plus_tree_entry {
+	const KeyType& key;
+	DataType& data;
+};
+
+// Raw storage for the keys or the data of a node. The node constructs and destroys the objects in it one at a time.
+// Starts zeroed, so vector loads past the last key read defined bytes.
+template<typename ValueType, size_t Capacity>
+struct b_plus_tree_slots {
+	alignas(ValueType) std::byte bytes[sizeof(ValueType) * Capacity] = {};
+
+	ValueType* data() {
+		return std::launder(reinterpret_cast<ValueType*>(this->bytes));
+	}
+	const ValueType* data() const {
+		return std::launder(reinterpret_cast<const ValueType*>(this->bytes));
+	}
+	ValueType& operator[](size_t index) {
+		return this->data()[index];
+	}
+	const ValueType& operator[](size_t index) const {
+		return this->data()[index];
+	}
+};
+
+// In-node search for integral keys ordered by the default comparator.
+// Instead of branching through a binary search, every key of the node is compared with the searched key at once
+// and the keys below it are counted, a few vector compares for a node that spans a handful of cache lines.
+// Key arrays are padded to a multiple of lanes, the padding is loaded and masked out.
+template<typename KeyType>
+struct b_plus_tree_integral_search {
+	// Keys in the widest vector used.
+	static constexpr size_t lanes = 32 / sizeof(KeyType);
+
+	// @return Number of keys in keys[0, count) smaller than key, or not bigger than key if IsInclusive.
+	template<bool IsInclusive>
+	static size_t count_below(const KeyType* keys, size_t count, KeyType key) {
+#if defined(B_PLUS_TREE_AVX2)
+		if constexpr (sizeof(KeyType) == 4 || sizeof(KeyType) == 8) {
+			const __m256i bias = broadcast_256(sign_bias());
+			const __m256i needle = _mm256_xor_si256(broadcast_256(key), bias);
+			size_t matchCount = 0;
+			for (size_t i = 0; i < count; i += lanes) {
+				const __m256i chunk = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), bias);
+				// Keys below without IsInclusive are the ones key is greater than, with it the ones that aren't greater than key.
+				const __m256i isGreater = IsInclusive ? compare_greater_256(chunk, needle) : compare_greater_256(needle, chunk);
+				matchCount += count_lanes(static_cast<uint32_t>(_mm256_movemask_epi8(isGreater)), count - i, lanes);
+			}
+			return IsInclusive ? (count - matchCount) : matchCount;
+		}
+#elif defined(B_PLUS_TREE_SSE2)
+#if defined(B_PLUS_TREE_SSE42)
+		constexpr bool hasVectorCompare = (sizeof(KeyType) == 4 || sizeof(KeyType) == 8);
+#else
+		constexpr bool hasVectorCompare = (sizeof(KeyType) == 4);
+#endif
+		if constexpr (hasVectorCompare) {
+			constexpr size_t sseLanes = 16 / sizeof(KeyType);
+			const __m128i bias = broadcast_128(sign_bias());
+			const __m128i needle = _mm_xor_si128(broadcast_128(key), bias);
+			size_t matchCount = 0;
+			for (size_t i = 0; i < count; i += sseLanes) {
+				const __m128i chunk = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), bias);
+				const __m128i isGreater = IsInclusive ? compare_greater_128(chunk, needle) : compare_greater_128(needle, chunk);
+				matchCount += count_lanes(static_cast<uint32_t>(_mm_movemask_epi8(isGreater)), count - i, sseLanes);
+			}
+			return IsInclusive ? (count - matchCount) : matchCount;
+		}
+#endif
+		size_t belowCount = 0;
+		for (size_t i = 0; i < count; i++) {
+			belowCount += IsInclusive ? !(key < keys[i]) : (keys[i] < key);
+		}
+		return belowCount;
+	}
+private:
+	// Vector compares are signed, flipping the sign bit of unsigned keys maps their order onto the signed one.
+	static KeyType sign_bias() {
+		if constexpr (std::is_signed_v<KeyType>) {
+			return 0;
+		}
+		else {
+			return static_cast<KeyType>(KeyType(1) << (sizeof(KeyType) * 8 - 1));
+		}
+	}
+	// @return Number of set lanes in a byte mask, looking only at the first remaining lanes.
+	static size_t count_lanes(uint32_t byteMask, size_t remaining, size_t vectorLanes) {
+		if (remaining < vectorLanes) {
+			byteMask &= (uint32_t(1) << (remaining * sizeof(KeyType))) - 1;
+		}
+		return static_cast<size_t>(std::popcount(byteMask)) / sizeof(KeyType);
+	}
+#if defined(B_PLUS_TREE_AVX2)
+	static __m256i broadcast_256(KeyType value) {
+		if constexpr (sizeof(KeyType) == 4) {
+			return _mm256_set1_epi32(static_cast<int32_t>(value));
+		}
+		else {
+			return _mm256_set1_epi64x(static_cast<int64_t>(value));
+		}
+	}
+	static __m256i compare_greater_256(__m256i left, __m256i right) {
+		if constexpr (sizeof(KeyType) == 4) {
+			return _mm256_cmpgt_epi32(left, right);
+		}
+		else {
+			return _mm256_cmpgt_epi64(left, right);
+		}
+	}
+#elif defined(B_PLUS_TREE_SSE2)
+	static __m128i broadcast_128(KeyType value) {
+		if constexpr (sizeof(KeyType) == 4) {
+			return _mm_set1_epi32(static_cast<int32_t>(value));
+		}
+		else {
+			return _mm_set1_epi64x(static_cast<int64_t>(value));
+		}
+	}
+	static __m128i compare_greater_128(__m128i left, __m128i right) {
+		if constexpr (sizeof(KeyType) == 4) {
+			return _mm_cmpgt_epi32(left, right);
+		}
+#if defined(B_PLUS_TREE_SSE42)
+		else {
+			return _mm_cmpgt_epi64(left, right);
+		}
+#endif
+	}
+#endif
+};
+
+// Works out how many elements and keys fit in nodes of NodeCacheLines cache lines.
+// Sizes follow the member order of b_plus_tree_leaf and b_plus_tree_inner_node, the tree checks them with a static_assert.
+// Nodes never get less than min_capacity slots, which splitting and merging need, even if that takes more cache lines.
+template<typename KeyType, typename DataType, size_t NodeCacheLines, bool IsDefaultCompare>
+struct b_plus_tree_layout {
+	static constexpr bool has_integral_search = std::integral<KeyType> && !std::same_as<KeyType, bool> && IsDefaultCompare;
+	static constexpr size_t node_bytes = NodeCacheLines * 64;
+	static constexpr size_t min_capacity = 4;
+
+	static constexpr size_t round_up(size_t value, size_t multiple) {
+		return (value + multiple - 1) / multiple * multiple;
+	}
+	// Key arrays searched with vector compares are padded to whole 32 byte vectors.
+	static constexpr size_t key_slots(size_t capacity) {
+		return has_integral_search ? round_up(capacity, 32 / sizeof(KeyType)) : capacity;
+	}
+	static constexpr size_t leaf_bytes(size_t capacity) {
+		size_t bytes = sizeof(size_t) + 2 * sizeof(void*);
+		bytes = round_up(bytes, alignof(KeyType)) + key_slots(capacity) * sizeof(KeyType);
+		bytes = round_up(bytes, alignof(DataType)) + capacity * sizeof(DataType);
+		return round_up(bytes, 64);
+	}
+	static constexpr size_t inner_bytes(size_t capacity) {
+		size_t bytes = sizeof(size_t);
+		bytes = round_up(bytes, alignof(KeyType)) + key_slots(capacity) * sizeof(KeyType);
+		bytes = round_up(bytes, alignof(void*)) + (capacity + 1) * sizeof(void*);
+		return round_up(bytes, 64);
+	}
+	static constexpr size_t leaf_capacity_fitting() {
+		size_t capacity = min_capacity;
+		while (leaf_bytes(capacity + 1) <= node_bytes) {
+			capacity++;
+		}
+		return capacity;
+	}
+	static constexpr size_t inner_capacity_fitting() {
+		size_t capacity = min_capacity;
+		while (inner_bytes(capacity + 1) <= node_bytes) {
+			capacity++;
+		}
+		return capacity;
+	}
+
+	static constexpr size_t leaf_capacity = leaf_capacity_fitting();
+	static constexpr size_t inner_capacity = inner_capacity_fitting();
+};
+
+// A two way iterator over the elements of a b_plus_tree, in key order.
+// Walks a leaf's arrays and then follows its link to the next leaf, so a scan never goes back up the tree.
+// Dereferences to a b_plus_tree_entry. end() iterator is nullptr.
+template<typename KeyType, typename DataType, typename LeafType>
+class b_plus_tree_iterator {
+	using Iterator = typename b_plus_tree_iterator;
+	using Entry = typename b_plus_tree_entry<KeyType, DataType>;
+	// Holds the entry operator->() points at.
+	struct EntryPointer {
+		Entry entry;
+
+		Entry* operator->() {
+			return &this->entry;
+		}
+	};
+public:
+	bool operator==(const Iterator& other) const {
+		return (this->leaf_ == other.leaf_) && (this->index_ == other.index_);
+	}
+	bool operator!=(const Iterator& other) const {
+		return !(*this == other);
+	}
+
+	Iterator& operator++() {
+		if (!this->leaf_) {
+			return *this;
+		}
+		if (++this->index_ == this->leaf_->count_) {
+			this->leaf_ = this->leaf_->next_;
+			this->index_ = 0;
+		}
+		return *this;
+	}
+	Iterator operator++(int) {
+		Iterator temp = *this;
+		++(*this);
+		return temp;
+	}
+
+	Iterator& operator--() {
+		if (!this->leaf_) {
+			return *this;
+		}
+		if (this->index_ == 0) {
+			this->leaf_ = this->leaf_->prev_;
+			this->index_ = this->leaf_ ? (this->leaf_->count_ - 1) : 0;
+		}
+		else {
+			this->index_--;
+		}
+		return *this;
+	}
+	Iterator operator--(int) {
+		Iterator temp = *this;
+		--(*this);
+		return temp;
+	}
+
+	Entry operator*() const {
+		return { this->leaf_->keys_[this->index_], this->leaf_->data_[this->index_] };
+	}
+	EntryPointer operator->() const {
+		return { **this };
+	}
+
+	// Entries are references made on the fly, so the iterator is only an input iterator to code that wants real references.
+	using iterator_concept = std::bidirectional_iterator_tag;
+	using iterator_category = std::input_iterator_tag;
+	using value_type = Entry;
+	using difference_type = std::ptrdiff_t;
+	using pointer = EntryPointer;
+	using reference = Entry;
+
+	b_plus_tree_iterator()
+		: leaf_(nullptr)
+		, index_(0) {}
+	b_plus_tree_iterator(LeafType* leaf, size_t index)
+		: leaf_(leaf)
+		, index_(index) {}
+private:
+	LeafType* leaf_;
+	size_t index_;
+};
+
+// A pair of iterators marking a run of consecutive elements, see b_plus_tree::range().
+template<typename KeyType, typename DataType, typename LeafType>
+class b_plus_tree_range {
+	using Iterator = typename b_plus_tree_iterator<KeyType, DataType, LeafType>;
+public:
+	Iterator begin() const {
+		return this->begin_;
+	}
+	Iterator end() const {
+		return this->end_;
+	}
+	bool empty() const {
+		return (this->begin_ == this->end_);
+	}
+
+	b_plus_tree_range(Iterator begin, Iterator end)
+		: begin_(begin)
+		, end_(end) {}
+private:
+	Iterator begin_;
+	Iterator end_;
+};
+
+// Holds up to Capacity elements in key order, with the keys and the data in separate arrays.
+// Searching a leaf only reads its keys, which sit together at its start. KeySlots is Capacity padded for vector loads.
+// Leaves are linked to their neighbours in key order.
+template<typename KeyType, typename DataType, size_t Capacity, size_t KeySlots>
+class alignas(64) b_plus_tree_leaf {
+	using Leaf = typename b_plus_tree_leaf;
+public:
+	b_plus_tree_leaf(const Leaf& other) = delete;
+	b_plus_tree_leaf& operator=(const Leaf& other) = delete;
+	~b_plus_tree_leaf() {
+		std::destroy_n(this->keys_.data(), this->count_);
+		std::destroy_n(this->data_.data(), this->count_);
+	}
+
+	b_plus_tree_leaf() = default;
+
+	template<typename TreeKeyType, typename TreeDataType, typename TreeLeafType>
+	friend class b_plus_tree_iterator;
+	template<typename TreeKeyType, typename TreeDataType, template<typename> typename TreeNodeAllocator, typename TreeCompare, size_t TreeNodeCacheLines>
+		requires (std::copyable<TreeKeyType> && std::movable<TreeDataType>
+				  && key_comparator_for<TreeCompare, TreeKeyType, TreeKeyType> && (TreeNodeCacheLines > 0))
+	friend class b_plus_tree;
+private:
+	size_t count_ = 0;
+	Leaf* prev_ = nullptr;
+	Leaf* next_ = nullptr;
+	b_plus_tree_slots<KeyType, KeySlots> keys_;
+	b_plus_tree_slots<DataType, Capacity> data_;
+};
+
+// Holds up to Capacity separator keys and Capacity + 1 children. keys_[i] is the smallest key under children_[i + 1],
+// or was when it was put there, so the child to descend into is the number of keys not bigger than the searched key.
+// Children are leaves on the level above the leaves and inner nodes everywhere else, the tree knows which from its height.
+template<typename KeyType, size_t Capacity, size_t KeySlots>
+class alignas(64) b_plus_tree_inner_node {
+	using InnerNode = typename b_plus_tree_inner_node;
+public:
+	b_plus_tree_inner_node(const InnerNode& other) = delete;
+	b_plus_tree_inner_node& operator=(const InnerNode& other) = delete;
+	~b_plus_tree_inner_node() {
+		std::destroy_n(this->keys_.data(), this->count_);
+	}
+
+	b_plus_tree_inner_node() = default;
+
+	template<typename TreeKeyType, typename TreeDataType, template<typename> typename TreeNodeAllocator, typename TreeCompare, size_t TreeNodeCacheLines>
+		requires (std::copyable<TreeKeyType> && std::movable<TreeDataType>
+				  && key_comparator_for<TreeCompare, TreeKeyType, TreeKeyType> && (TreeNodeCacheLines > 0))
+	friend class b_plus_tree;
+private:
+	size_t count_ = 0;
+	b_plus_tree_slots<KeyType, KeySlots> keys_;
+	std::array<void*, Capacity + 1> children_ = {};
+};
+
+// A B+tree implementation, for big trees where a binary tree's cache miss per level is what lookups wait on.
+// Nodes span NodeCacheLines cache lines and start on a cache line boundary. Each one holds as many keys as fit, so a lookup
+// misses the cache about once per node on a path that is log(fanout) times shorter than an AVL tree's.
+// Elements live in the leaves. Inner nodes only hold separator keys, and the leaves are linked so range scans walk them in order.
+// Integral keys with the default comparator are searched inside a node with vector compares, see b_plus_tree_integral_search.
+// Other keys are binary searched with Compare.
+// Compared to avl_tree: search() returns an iterator rather than a node pointer, iterators dereference to a b_plus_tree_entry,
+// emplace() constructs the data before moving it into its leaf, and insert() and remove() invalidate iterators,
+// since elements move around inside and between leaves.
+// KeyType must be copyable.
+// DataType must be movable. Copying the tree needs it to be copyable.
+// NodeAllocator is the node allocation policy, see node_allocator.hpp.
+// Compare orders the keys, see key_compare.hpp. Lookups take any key type a transparent Compare can compare with KeyType.
+template<typename KeyType, typename DataType, template<typename> typename NodeAllocator, typename Compare, size_t NodeCacheLines>
+	requires (std::copyable<KeyType> && std::movable<DataType>
+			  && key_comparator_for<Compare, KeyType, KeyType> && (NodeCacheLines > 0))
+class b_plus_tree {
+	using Layout = typename b_plus_tree_layout<KeyType, DataType, NodeCacheLines, std::same_as<Compare, three_way_key_compare>>;
+	using IntegralSearch = typename b_plus_tree_integral_search<std::conditional_t<Layout::has_integral_search, KeyType, int>>;
+public:
+	// Most elements a leaf holds.
+	static constexpr size_t leaf_capacity = Layout::leaf_capacity;
+	// Most keys an inner node holds, it has one more child than keys.
+	static constexpr size_t inner_capacity = Layout::inner_capacity;
+private:
+	using Leaf = typename b_plus_tree_leaf<KeyType, DataType, leaf_capacity, Layout::key_slots(leaf_capacity)>;
+	using InnerNode = typename b_plus_tree_inner_node<KeyType, inner_capacity, Layout::key_slots(inner_capacity)>;
+	using Iterator = typename b_plus_tree_iterator<KeyType, DataType, Leaf>;
+	using Range = typename b_plus_tree_range<KeyType, DataType, Leaf>;
+	using LeafAllocator = typename NodeAllocator<Leaf>;
+	using InnerAllocator = typename NodeAllocator<InnerNode>;
+	// Nodes below these fill levels take elements from a sibling or merge with it. The root is exempt.
+	static constexpr size_t leaf_min_ = leaf_capacity / 2;
+	static constexpr size_t inner_min_ = inner_capacity / 2;
+	// Every node but the root has at least 2 children, so 64 levels hold more elements than memory does.
+	static constexpr size_t max_height_ = 64;
+	static_assert(sizeof(Leaf) == Layout::leaf_bytes(leaf_capacity) && sizeof(InnerNode) == Layout::inner_bytes(inner_capacity),
+				  "b_plus_tree_layout is out of step with the members of the nodes.");
+public:
+	// @return Iterator to the element with key, end() if key is not present in the tree. O(logn).
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	Iterator search(const LookupKeyType& key) {
+		const auto& lookupKey = to_lookup_key<Compare, KeyType>(key);
+		if (!this->root_) {
+			return this->end();
+		}
+		Leaf* leaf = this->find_leaf(lookupKey);
+		const size_t index = this->count_keys_below<false>(leaf->keys_.data(), leaf->count_, lookupKey);
+		if (index < leaf->count_ && this->compare_keys(leaf->keys_[index], lookupKey) == 0) {
+			return Iterator(leaf, index);
+		}
+		return this->end();
+	}
+
+	// @return Iterator to the first element with a key not smaller than key, end() if there is none. O(logn).
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	Iterator lower_bound(const LookupKeyType& key) {
+		return this->bound<false>(to_lookup_key<Compare, KeyType>(key));
+	}
+	// @return Iterator to the first element with a key bigger than key, end() if there is none. O(logn).
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	Iterator upper_bound(const LookupKeyType& key) {
+		return this->bound<true>(to_lookup_key<Compare, KeyType>(key));
+	}
+	// @return The elements with keys in [low, high) as a lazily iterated range.
+	// Finding the ends is O(logn), iterating k elements on top of that walks O(k / leaf_capacity) linked leaves.
+	template<lookup_key_for<Compare, KeyType> LowKeyType, lookup_key_for<Compare, KeyType> HighKeyType>
+	Range range(const LowKeyType& low, const HighKeyType& high) {
+		const auto& lowKey = to_lookup_key<Compare, KeyType>(low);
+		const auto& highKey = to_lookup_key<Compare, KeyType>(high);
+		if (!(this->compare_keys(lowKey, highKey) < 0)) {
+			return Range(this->end(), this->end());
+		}
+		return Range(this->lower_bound(lowKey), this->lower_bound(highKey));
+	}
+
+	// Adds an element to the tree. Does a copy operation on the data.
+	// @return false if key is already in tree.
+	bool insert(const KeyType& key_, const DataType& data_) {
+		return this->insert_element(key_, data_);
+	}
+	// Adds an element to the tree. Does a move operation on the data.
+	// @return false if key is already in tree.
+	bool insert(const KeyType& key_, DataType&& data_) {
+		return this->insert_element(key_, std::move(data_));
+	}
+	// Adds an element to the tree. Constructs the DataType object from args, then moves it into its leaf.
+	// @param[...args] args are passed to the DataType constructor.
+	// @return false if key is already in tree.
+	template <typename... ArgTypes>
+	bool emplace(const KeyType& key_, ArgTypes&&... args) {
+		return this->insert_element(key_, DataType(std::forward<ArgTypes>(args)...));
+	}
+
+	// Removes an element from the tree and calls the destructor on its data.
+	// A leaf left less than half full takes an element from a sibling, or merges with it if the sibling can't spare one,
+	// and the same goes for the inner nodes above it.
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	bool remove(const LookupKeyType& key_) {
+		const auto& key = to_lookup_key<Compare, KeyType>(key_);
+		if (!this->root_) {
+			return false;
+		}
+		Path path;
+		Leaf* leaf = this->find_leaf(key, &path);
+		const size_t index = this->count_keys_below<false>(leaf->keys_.data(), leaf->count_, key);
+		if (index == leaf->count_ || this->compare_keys(leaf->keys_[index], key) != 0) {
+			return false;
+		}
+		std::destroy_at(&leaf->keys_[index]);
+		std::destroy_at(&leaf->data_[index]);
+		relocate(&leaf->keys_[index], &leaf->keys_[index + 1], leaf->count_ - index - 1);
+		relocate(&leaf->data_[index], &leaf->data_[index + 1], leaf->count_ - index - 1);
+		leaf->count_--;
+		this->size_--;
+
+		if (this->height_ == 1) {
+			if (leaf->count_ == 0) {
+				this->destroy_leaf(leaf);
+				this->root_ = nullptr;
+				this->height_ = 0;
+				this->first_ = nullptr;
+				this->last_ = nullptr;
+			}
+		}
+		else if (leaf->count_ < leaf_min_) {
+			this->rebalance_leaf(leaf, path);
+		}
+		return true;
+	}
+
+	// Removes all elements from the tree.
+	// If the allocator can release in bulk and the elements don't need their destructors called,
+	// this is O(number of allocator blocks). Otherwise every node is destructed on the way.
+	void clear() {
+		if (this->root_) {
+			if constexpr (!(LeafAllocator::releases_in_bulk && InnerAllocator::releases_in_bulk
+						   && std::is_trivially_destructible_v<KeyType> && std::is_trivially_destructible_v<DataType>)) {
+				this->destroy_subtree(this->root_, this->height_);
+			}
+		}
+		this->root_ = nullptr;
+		this->first_ = nullptr;
+		this->last_ = nullptr;
+		this->height_ = 0;
+		this->size_ = 0;
+		this->leafAllocator_.release();
+		this->innerAllocator_.release();
+	}
+
+	// @return Number of elements in the tree. O(1).
+	size_t size() const {
+		return this->size_;
+	}
+	bool empty() const {
+		return (this->size_ == 0);
+	}
+	// @return Number of levels, the leaves included. 0 for an empty tree.
+	size_t height() const {
+		return this->height_;
+	}
+
+	// @return Size, height, average depth and memory footprint of the tree. O(number of nodes).
+	// Every element is in a leaf, so its depth is the height of the tree.
+	tree_stats stats() const {
+		tree_stats stats;
+		stats.size = this->size_;
+		stats.height = this->height_;
+		stats.averageDepth = (this->size_ > 0) ? static_cast<double>(this->height_) : 0.0;
+		stats.memoryBytes = sizeof(b_plus_tree);
+		if (this->root_) {
+			this->add_node_bytes(this->root_, this->height_, stats.memoryBytes);
+		}
+		return stats;
+	}
+
+	// @return An iterator pointing at the smallest element of the tree.
+	Iterator begin() {
+		return this->first_ ? Iterator(this->first_, 0) : this->end();
+	}
+	// @return An iterator pointing at nullptr.
+	Iterator end() {
+		return Iterator();
+	}
+
+	const Compare& key_comp() const {
+		return this->compare_;
+	}
+
+	// Copies other node by node, keeping its shape and relinking the leaves of the copy. O(n).
+	b_plus_tree(const b_plus_tree& other) requires std::copyable<DataType>
+		: compare_(other.compare_) {
+		this->copy_from(other);
+	}
+	b_plus_tree& operator=(const b_plus_tree& other) requires std::copyable<DataType> {
+		if (this != &other) {
+			this->clear();
+			this->compare_ = other.compare_;
+			this->copy_from(other);
+		}
+		return *this;
+	}
+	b_plus_tree(b_plus_tree&& other) noexcept
+		: leafAllocator_(std::move(other.leafAllocator_))
+		, innerAllocator_(std::move(other.innerAllocator_))
+		, compare_(other.compare_)
+		, root_(std::exchange(other.root_, nullptr))
+		, first_(std::exchange(other.first_, nullptr))
+		, last_(std::exchange(other.last_, nullptr))
+		, height_(std::exchange(other.height_, 0))
+		, size_(std::exchange(other.size_, 0)) {}
+	b_plus_tree& operator=(b_plus_tree&& other) noexcept {
+		this->clear();
+		this->leafAllocator_ = std::move(other.leafAllocator_);
+		this->innerAllocator_ = std::move(other.innerAllocator_);
+		this->compare_ = other.compare_;
+		this->root_ = std::exchange(other.root_, nullptr);
+		this->first_ = std::exchange(other.first_, nullptr);
+		this->last_ = std::exchange(other.last_, nullptr);
+		this->height_ = std::exchange(other.height_, 0);
+		this->size_ = std::exchange(other.size_, 0);
+		return *this;
+	}
+	~b_plus_tree() {
+		this->clear();
+	}
+
+	explicit b_plus_tree(const Compare& compare)
+		: compare_(compare) {}
+	b_plus_tree() = default;
+private:
+	// The inner nodes on the way down to a leaf, and which of their children the way went through.
+	struct PathStep {
+		InnerNode* node;
+		size_t childIndex;
+	};
+	struct Path {
+		std::array<PathStep, max_height_> steps;
+		size_t length = 0;
+	};
+
+	// One call to compare_ per pair of keys, see three_way_compare().
+	template<typename LeftType, typename RightType>
+	std::weak_ordering compare_keys(const LeftType& left, const RightType& right) const {
+		return three_way_compare(this->compare_, left, right);
+	}
+	// @return Number of keys in keys[0, count) smaller than key, or not bigger than key if IsInclusive.
+	template<bool IsInclusive, typename LookupKeyType>
+	size_t count_keys_below(const KeyType* keys, size_t count, const LookupKeyType& key) const {
+		if constexpr (Layout::has_integral_search && std::same_as<LookupKeyType, KeyType>) {
+			return IntegralSearch::template count_below<IsInclusive>(keys, count, key);
+		}
+		else {
+			size_t low = 0;
+			size_t high = count;
+			while (low < high) {
+				const size_t middle = low + (high - low) / 2;
+				const std::weak_ordering order = this->compare_keys(keys[middle], key);
+				if (order < 0 || (IsInclusive && order == 0)) {
+					low = middle + 1;
+				}
+				else {
+					high = middle;
+				}
+			}
+			return low;
+		}
+	}
+
+	// Descends from the root to the leaf key belongs in, recording the way down in path if one is given.
+	template<typename LookupKeyType>
+	Leaf* find_leaf(const LookupKeyType& key, Path* path = nullptr) const {
+		void* node = this->root_;
+		for (size_t level = this->height_; level > 1; level--) {
+			InnerNode* inner = static_cast<InnerNode*>(node);
+			const size_t childIndex = this->count_keys_below<true>(inner->keys_.data(), inner->count_, key);
+			if (path) {
+				path->steps[path->length++] = { inner, childIndex };
+			}
+			node = inner->children_[childIndex];
+		}
+		return static_cast<Leaf*>(node);
+	}
+	// Shared by lower_bound() and upper_bound(). A key past the end of its leaf has its bound at the start of the next one.
+	template<bool IsUpper, typename LookupKeyType>
+	Iterator bound(const LookupKeyType& key) {
+		if (!this->root_) {
+			return this->end();
+		}
+		Leaf* leaf = this->find_leaf(key);
+		const size_t index = this->count_keys_below<IsUpper>(leaf->keys_.data(), leaf->count_, key);
+		if (index == leaf->count_) {
+			return leaf->next_ ? Iterator(leaf->next_, 0) : this->end();
+		}
+		return Iterator(leaf, index);
+	}
+
+	// Moves count objects to the uninitialized slots at destination, leaving the slots at source uninitialized.
+	// The ranges may overlap. Trivially copyable objects are moved as bytes.
+	template<typename ValueType>
+	static void relocate(ValueType* destination, ValueType* source, size_t count) {
+		if (count == 0 || destination == source) {
+			return;
+		}
+		if constexpr (std::is_trivially_copyable_v<ValueType>) {
+			std::memmove(static_cast<void*>(destination), static_cast<const void*>(source), count * sizeof(ValueType));
+		}
+		else if (destination < source) {
+			for (size_t i = 0; i < count; i++) {
+				std::construct_at(destination + i, std::move(source[i]));
+				std::destroy_at(source + i);
+			}
+		}
+		else {
+			for (size_t i = count; i > 0; i--) {
+				std::construct_at(destination + i - 1, std::move(source[i - 1]));
+				std::destroy_at(source + i - 1);
+			}
+		}
+	}
+
+	// Finds the leaf key goes in and puts the element there, splitting the leaf and its ancestors if they are full.
+	template<typename ValueType>
+	bool insert_element(const KeyType& key, ValueType&& data) {
+		if (!this->root_) {
+			Leaf* leaf = this->create_leaf();
+			std::construct_at(&leaf->keys_[0], key);
+			std::construct_at(&leaf->data_[0], std::forward<ValueType>(data));
+			leaf->count_ = 1;
+			this->root_ = leaf;
+			this->first_ = leaf;
+			this->last_ = leaf;
+			this->height_ = 1;
+			this->size_ = 1;
+			return true;
+		}
+		Path path;
+		Leaf* leaf = this->find_leaf(key, &path);
+		size_t index = this->count_keys_below<false>(leaf->keys_.data(), leaf->count_, key);
+		if (index < leaf->count_ && this->compare_keys(leaf->keys_[index], key) == 0) {
+			return false;
+		}
+		if (leaf->count_ == leaf_capacity) {
+			Leaf* right = this->split_leaf(leaf, index);
+			if (index > leaf->count_ || leaf->count_ == leaf_capacity) {
+				index -= leaf->count_;
+				leaf = right;
+			}
+			this->put_in_leaf(leaf, index, key, std::forward<ValueType>(data));
+			this->insert_into_parent(path, right->keys_[0], right);
+		}
+		else {
+			this->put_in_leaf(leaf, index, key, std::forward<ValueType>(data));
+		}
+		this->size_++;
+		return true;
+	}
+	template<typename ValueType>
+	static void put_in_leaf(Leaf* leaf, size_t index, const KeyType& key, ValueType&& data) {
+		relocate(&leaf->keys_[index + 1], &leaf->keys_[index], leaf->count_ - index);
+		relocate(&leaf->data_[index + 1], &leaf->data_[index], leaf->count_ - index);
+		std::construct_at(&leaf->keys_[index], key);
+		std::construct_at(&leaf->data_[index], std::forward<ValueType>(data));
+		leaf->count_++;
+	}
+	// Moves the upper half of a full leaf to a new leaf linked in after it. index is where the new element is going.
+	// An element going past the end of the last leaf, as in ascending inserts, leaves the full leaf as it is
+	// and starts the new leaf with just the new element, so sorted loads fill their leaves completely.
+	Leaf* split_leaf(Leaf* leaf, size_t index) {
+		Leaf* right = this->create_leaf();
+		const size_t keep = (leaf == this->last_ && index == leaf->count_) ? leaf->count_ : (leaf->count_ + 1) / 2;
+		relocate(right->keys_.data(), &leaf->keys_[keep], leaf->count_ - keep);
+		relocate(right->data_.data(), &leaf->data_[keep], leaf->count_ - keep);
+		right->count_ = leaf->count_ - keep;
+		leaf->count_ = keep;
+
+		right->prev_ = leaf;
+		right->next_ = leaf->next_;
+		if (leaf->next_) {
+			leaf->next_->prev_ = right;
+		}
+		else {
+			this->last_ = right;
+		}
+		leaf->next_ = right;
+		return right;
+	}
+	// Puts separator and right into the parent of the node split in two at the end of path, splitting full parents on the way up.
+	// A split root gets a new root above it, which is the only way the tree grows taller.
+	void insert_into_parent(Path& path, KeyType separator, void* right) {
+		void* left = path.length ? path.steps[path.length - 1].node->children_[path.steps[path.length - 1].childIndex] : this->root_;
+		while (path.length > 0) {
+			const PathStep step = path.steps[--path.length];
+			InnerNode* parent = step.node;
+			size_t index = step.childIndex;
+			if (parent->count_ < inner_capacity) {
+				put_in_inner_node(parent, index, std::move(separator), right);
+				return;
+			}
+			InnerNode* parentRight = this->create_inner_node();
+			KeyType promoted = this->split_inner_node(parent, parentRight);
+			if (index <= parent->count_) {
+				put_in_inner_node(parent, index, std::move(separator), right);
+			}
+			else {
+				put_in_inner_node(parentRight, index - parent->count_ - 1, std::move(separator), right);
+			}
+			separator = std::move(promoted);
+			right = parentRight;
+			left = parent;
+		}
+		InnerNode* root = this->create_inner_node();
+		std::construct_at(&root->keys_[0], std::move(separator));
+		root->children_[0] = left;
+		root->children_[1] = right;
+		root->count_ = 1;
+		this->root_ = root;
+		this->height_++;
+	}
+	// Inserts key at index and child right after it, at index + 1.
+	static void put_in_inner_node(InnerNode* node, size_t index, KeyType&& key, void* child) {
+		relocate(&node->keys_[index + 1], &node->keys_[index], node->count_ - index);
+		std::construct_at(&node->keys_[index], std::move(key));
+		std::copy_backward(node->children_.begin() + index + 1, node->children_.begin() + node->count_ + 1, node->children_.begin() + node->count_ + 2);
+		node->children_[index + 1] = child;
+		node->count_++;
+	}
+	// Moves the keys and children above the middle key of a full inner node to right.
+	// @return The middle key, which moves up to the parent.
+	static KeyType split_inner_node(InnerNode* node, InnerNode* right) {
+		const size_t middle = node->count_ / 2;
+		KeyType promoted = std::move(node->keys_[middle]);
+		std::destroy_at(&node->keys_[middle]);
+		relocate(right->keys_.data(), &node->keys_[middle + 1], node->count_ - middle - 1);
+		std::copy(node->children_.begin() + middle + 1, node->children_.begin() + node->count_ + 1, right->children_.begin());
+		right->count_ = node->count_ - middle - 1;
+		node->count_ = middle;
+		return promoted;
+	}
+
+	// Refills a leaf that fell below leaf_min_ from a sibling under the same parent, or merges the two.
+	void rebalance_leaf(Leaf* leaf, Path& path) {
+		const PathStep step = path.steps[path.length - 1];
+		InnerNode* parent = step.node;
+		const size_t index = step.childIndex;
+		Leaf* left = (index > 0) ? static_cast<Leaf*>(parent->children_[index - 1]) : nullptr;
+		Leaf* right = (index < parent->count_) ? static_cast<Leaf*>(parent->children_[index + 1]) : nullptr;
+
+		if (left && left->count_ > leaf_min_) {
+			relocate(&leaf->keys_[1], &leaf->keys_[0], leaf->count_);
+			relocate(&leaf->data_[1], &leaf->data_[0], leaf->count_);
+			relocate(&leaf->keys_[0], &left->keys_[left->count_ - 1], 1);
+			relocate(&leaf->data_[0], &left->data_[left->count_ - 1], 1);
+			left->count_--;
+			leaf->count_++;
+			parent->keys_[index - 1] = leaf->keys_[0];
+		}
+		else if (right && right->count_ > leaf_min_) {
+			relocate(&leaf->keys_[leaf->count_], &right->keys_[0], 1);
+			relocate(&leaf->data_[leaf->count_], &right->data_[0], 1);
+			relocate(&right->keys_[0], &right->keys_[1], right->count_ - 1);
+			relocate(&right->data_[0], &right->data_[1], right->count_ - 1);
+			right->count_--;
+			leaf->count_++;
+			parent->keys_[index] = right->keys_[0];
+		}
+		else if (left) {
+			this->merge_leaves(left, leaf);
+			this->remove_from_inner_node(parent, index - 1);
+			this->rebalance_inner_node(path);
+		}
+		else {
+			this->merge_leaves(leaf, right);
+			this->remove_from_inner_node(parent, index);
+			this->rebalance_inner_node(path);
+		}
+	}
+	// Moves every element of right to the end of left, unlinks right and destroys it.
+	void merge_leaves(Leaf* left, Leaf* right) {
+		relocate(&left->keys_[left->count_], right->keys_.data(), right->count_);
+		relocate(&left->data_[left->count_], right->data_.data(), right->count_);
+		left->count_ += right->count_;
+		right->count_ = 0;
+		left->next_ = right->next_;
+		if (right->next_) {
+			right->next_->prev_ = left;
+		}
+		else {
+			this->last_ = left;
+		}
+		this->destroy_leaf(right);
+	}
+	// Removes the key at index and the child right after it, the one that was merged away.
+	static void remove_from_inner_node(InnerNode* node, size_t index) {
+		std::destroy_at(&node->keys_[index]);
+		relocate(&node->keys_[index], &node->keys_[index + 1], node->count_ - index - 1);
+		std::copy(node->children_.begin() + index + 2, node->children_.begin() + node->count_ + 1, node->children_.begin() + index + 1);
+		node->count_--;
+	}
+	// Refills the inner node at the end of path if it fell below inner_min_, rotating a key through the parent
+	// or merging with a sibling around the parent's separator, and goes on up while merges leave parents short.
+	// A root left with a single child is replaced by it, which is the only way the tree gets shorter.
+	void rebalance_inner_node(Path& path) {
+		while (path.length > 0) {
+			InnerNode* node = path.steps[--path.length].node;
+			if (path.length == 0) {
+				if (node->count_ == 0) {
+					this->root_ = node->children_[0];
+					this->height_--;
+					this->destroy_inner_node(node);
+				}
+				return;
+			}
+			if (node->count_ >= inner_min_) {
+				return;
+			}
+			const PathStep step = path.steps[path.length - 1];
+			InnerNode* parent = step.node;
+			const size_t index = step.childIndex;
+			InnerNode* left = (index > 0) ? static_cast<InnerNode*>(parent->children_[index - 1]) : nullptr;
+			InnerNode* right = (index < parent->count_) ? static_cast<InnerNode*>(parent->children_[index + 1]) : nullptr;
+
+			if (left && left->count_ > inner_min_) {
+				relocate(&node->keys_[1], &node->keys_[0], node->count_);
+				std::copy_backward(node->children_.begin(), node->children_.begin() + node->count_ + 1, node->children_.begin() + node->count_ + 2);
+				relocate(&node->keys_[0], &parent->keys_[index - 1], 1);
+				node->children_[0] = left->children_[left->count_];
+				relocate(&parent->keys_[index - 1], &left->keys_[left->count_ - 1], 1);
+				left->count_--;
+				node->count_++;
+				return;
+			}
+			if (right && right->count_ > inner_min_) {
+				relocate(&node->keys_[node->count_], &parent->keys_[index], 1);
+				node->children_[node->count_ + 1] = right->children_[0];
+				relocate(&parent->keys_[index], &right->keys_[0], 1);
+				relocate(&right->keys_[0], &right->keys_[1], right->count_ - 1);
+				std::copy(right->children_.begin() + 1, right->children_.begin() + right->count_ + 1, right->children_.begin());
+				right->count_--;
+				node->count_++;
+				return;
+			}
+			if (left) {
+				this->merge_inner_nodes(left, parent, index - 1, node);
+			}
+			else {
+				this->merge_inner_nodes(node, parent, index, right);
+			}
+		}
+	}
+	// Pulls the separator at index of parent down into left, moves right's keys and children after it, and destroys right.
+	void merge_inner_nodes(InnerNode* left, InnerNode* parent, size_t index, InnerNode* right) {
+		relocate(&left->keys_[left->count_], &parent->keys_[index], 1);
+		relocate(&left->keys_[left->count_ + 1], right->keys_.data(), right->count_);
+		std::copy(right->children_.begin(), right->children_.begin() + right->count_ + 1, left->children_.begin() + left->count_ + 1);
+		left->count_ += right->count_ + 1;
+		right->count_ = 0;
+		// The separator is already gone from parent, only the slot has to be closed.
+		relocate(&parent->keys_[index], &parent->keys_[index + 1], parent->count_ - index - 1);
+		std::copy(parent->children_.begin() + index + 2, parent->children_.begin() + parent->count_ + 1, parent->children_.begin() + index + 1);
+		parent->count_--;
+		this->destroy_inner_node(right);
+	}
+
+	Leaf* create_leaf() {
+		return this->leafAllocator_.create();
+	}
+	InnerNode* create_inner_node() {
+		return this->innerAllocator_.create();
+	}
+	void destroy_leaf(Leaf* leaf) {
+		this->leafAllocator_.destroy(leaf);
+	}
+	void destroy_inner_node(InnerNode* node) {
+		this->innerAllocator_.destroy(node);
+	}
+	// Recursive method that destroys a subtree of the given height. Recursion depth is the height of the tree.
+	void destroy_subtree(void* node, size_t height) {
+		if (height == 1) {
+			this->destroy_leaf(static_cast<Leaf*>(node));
+			return;
+		}
+		InnerNode* inner = static_cast<InnerNode*>(node);
+		for (size_t i = 0; i <= inner->count_; i++) {
+			this->destroy_subtree(inner->children_[i], height - 1);
+		}
+		this->destroy_inner_node(inner);
+	}
+	void add_node_bytes(const void* node, size_t height, size_t& bytes) const {
+		if (height == 1) {
+			bytes += sizeof(Leaf);
+			return;
+		}
+		const InnerNode* inner = static_cast<const InnerNode*>(node);
+		bytes += sizeof(InnerNode);
+		for (size_t i = 0; i <= inner->count_; i++) {
+			this->add_node_bytes(inner->children_[i], height - 1, bytes);
+		}
+	}
+
+	// Copies the nodes of other into this empty tree.
+	void copy_from(const b_plus_tree& other) {
+		if (!other.root_) {
+			return;
+		}
+		this->root_ = this->copy_subtree(other.root_, other.height_);
+		this->height_ = other.height_;
+		this->size_ = other.size_;
+	}
+	// Recursive method that copies a subtree of the given height, appending its leaves to the leaf list in order.
+	void* copy_subtree(const void* node, size_t height) {
+		if (height == 1) {
+			const Leaf* source = static_cast<const Leaf*>(node);
+			Leaf* leaf = this->create_leaf();
+			leaf->prev_ = this->last_;
+			if (this->last_) {
+				this->last_->next_ = leaf;
+			}
+			else {
+				this->first_ = leaf;
+			}
+			this->last_ = leaf;
+			for (; leaf->count_ < source->count_; leaf->count_++) {
+				std::construct_at(&leaf->keys_[leaf->count_], source->keys_[leaf->count_]);
+				std::construct_at(&leaf->data_[leaf->count_], source->data_[leaf->count_]);
+			}
+			return leaf;
+		}
+		const InnerNode* source = static_cast<const InnerNode*>(node);
+		InnerNode* inner = this->create_inner_node();
+		for (; inner->count_ < source->count_; inner->count_++) {
+			std::construct_at(&inner->keys_[inner->count_], source->keys_[inner->count_]);
+		}
+		for (size_t i = 0; i <= source->count_; i++) {
+			inner->children_[i] = this->copy_subtree(source->children_[i], height - 1);
+		}
+		return inner;
+	}
+
+	LeafAllocator leafAllocator_;
+	InnerAllocator innerAllocator_;
+	Compare compare_;
+	// Leaves when height_ is 1, inner nodes otherwise.
+	void* root_ = nullptr;
+	Leaf* first_ = nullptr;
+	Leaf* last_ = nullptr;
+	size_t height_ = 0;
+	size_t size_ = 0;
+};
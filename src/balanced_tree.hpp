@@ -0,0 +1,611 @@
+#pragma once
+#include "node_allocator.hpp"
+#include "key_compare.hpp"
+#include "balancing.hpp"
+#include "instrumentation.hpp"
+
+#include <concepts>
+#include <utility>
+#include <cstddef>
+#include <type_traits>
+#include <iterator>
+#include <vector>
+#include <compare>
+
+
+
+// <<<-------------------------------------------------->>>
+// <<<----------- Class forward declarations ----------->>>
+// <<<-------------------------------------------------->>>
+template<typename KeyType, typename DataType, typename RankType>
+	requires (std::copyable<KeyType> && std::movable<DataType>)
+class balanced_tree_iterator;
+template<typename KeyType, typename DataType, typename RankType>
+	requires (std::copyable<KeyType> && std::movable<DataType>)
+class balanced_tree_node;
+template<typename KeyType, typename DataType, typename Balancing = avl_balancing, template<typename> typename NodeAllocator = slab_allocator,
+		 typename Compare = three_way_key_compare, typename Instrumentation = no_instrumentation>
+	requires (std::copyable<KeyType> && std::movable<DataType> && balancing_policy<Balancing>
+			  && key_comparator_for<Compare, KeyType, KeyType> && tree_instrumentation<Instrumentation>)
+class balanced_tree;
+
+
+
+// An in-order traversal two way iterator.
+// end() iterator is nullptr.
+template<typename KeyType, typename DataType, typename RankType>
+	requires (std::copyable<KeyType> && std::movable<DataType>)
+class balanced_tree_iterator {
+	using Iterator = typename balanced_tree_iterator;
+	using Node = typename balanced_tree_node<KeyType, DataType, RankType>;
+public:
+	bool operator==(const Iterator& other) const {
+		return (this->ptr_ == other.ptr_);
+	}
+	bool operator!=(const Iterator& other) const {
+		return (this->ptr_ != other.ptr_);
+	}
+
+	// Climbs by checking which child of its parent the node is, so a full traversal makes no key comparisons.
+	Iterator& operator++() {
+		if (!ptr_) {
+			return (*this);
+		}
+
+		if (ptr_->right_) {
+			ptr_ = ptr_->right_;
+			while (ptr_->left_) {
+				ptr_ = ptr_->left_;
+			}
+			return *this;
+		}
+
+		while (ptr_->parent_ && (ptr_ == ptr_->parent_->right_)) {
+			ptr_ = ptr_->parent_;
+		}
+		ptr_ = ptr_->parent_;
+		return *this;
+	}
+	Iterator operator++(int) {
+		Iterator temp = *this;
+		++(*this);
+		return temp;
+	}
+
+	Iterator& operator--() {
+		if (!ptr_) {
+			return (*this);
+		}
+
+		if (ptr_->left_) {
+			ptr_ = ptr_->left_;
+			while (ptr_->right_) {
+				ptr_ = ptr_->right_;
+			}
+			return *this;
+		}
+
+		while (ptr_->parent_ && (ptr_ == ptr_->parent_->left_)) {
+			ptr_ = ptr_->parent_;
+		}
+		ptr_ = ptr_->parent_;
+		return *this;
+	}
+	Iterator operator--(int) {
+		Iterator temp = *this;
+		--(*this);
+		return temp;
+	}
+
+	Node* operator->() {
+		return this->ptr_;
+	}
+	Node& operator*() {
+		return *(this->ptr_);
+	}
+
+	balanced_tree_iterator(Node* node)
+		: ptr_(node) {}
+private:
+	Node* ptr_;
+};
+
+// Holds a key-data pair and the rank its tree's balancing policy keeps for it, see balancing.hpp.
+// The key and the links come before the data, so the part of the node a search reads starts the node.
+template<typename KeyType, typename DataType, typename RankType>
+	requires (std::copyable<KeyType> && std::movable<DataType>)
+class balanced_tree_node {
+	using Node = typename balanced_tree_node;
+public:
+	KeyType key;
+private:
+	RankType rank_;
+	Node* parent_ = nullptr;
+	Node* left_ = nullptr;
+	Node* right_ = nullptr;
+public:
+	DataType data;
+
+	balanced_tree_node(const KeyType& key_, DataType&& data_)
+		: key(key_)
+		, data(DataType(std::forward<DataType>(data_))) {}
+	template <typename... ArgTypes>
+	balanced_tree_node(const KeyType& key_, ArgTypes&&... args)
+		: key(key_)
+		, data(DataType(std::forward<ArgTypes>(args)...)) {}
+
+	friend balanced_tree_iterator<KeyType, DataType, RankType>;
+	template<typename TreeKeyType, typename TreeDataType, typename TreeBalancing, template<typename> typename TreeNodeAllocator, typename TreeCompare,
+			 typename TreeInstrumentation>
+		requires (std::copyable<TreeKeyType> && std::movable<TreeDataType> && balancing_policy<TreeBalancing>
+				  && key_comparator_for<TreeCompare, TreeKeyType, TreeKeyType> && tree_instrumentation<TreeInstrumentation>)
+	friend class balanced_tree;
+};
+
+// A binary search tree that leaves keeping itself balanced to a policy, see balancing.hpp.
+// Nodes, iterators, searching, linking new nodes and unlinking removed ones are the same for every policy.
+// The policy only decides what rank a node keeps and which rotations to do after an insert or a remove.
+// The policies trade search speed against rebalancing work: AVL keeps the tree the shortest but may rotate all the way up on a remove,
+// red-black and WAVL rotate a constant number of times per update, and weight balancing rarely rotates big subtrees.
+// KeyType must be copyable.
+// DataType must be movable. Copying the tree needs it to be copyable.
+// Balancing is avl_balancing, red_black_balancing, wavl_balancing or weight_balancing.
+// NodeAllocator is the node allocation policy, see node_allocator.hpp.
+// Compare orders the keys, see key_compare.hpp. search() and remove() take any key type a transparent Compare can compare with KeyType.
+// Instrumentation counts comparisons, visited nodes, rotations, rebalancing steps and allocations, see instrumentation.hpp.
+template<typename KeyType, typename DataType, typename Balancing, template<typename> typename NodeAllocator, typename Compare, typename Instrumentation>
+	requires (std::copyable<KeyType> && std::movable<DataType> && balancing_policy<Balancing>
+			  && key_comparator_for<Compare, KeyType, KeyType> && tree_instrumentation<Instrumentation>)
+class balanced_tree {
+	using RankType = typename Balancing::rank_type;
+	using Iterator = typename balanced_tree_iterator<KeyType, DataType, RankType>;
+	using Node = typename balanced_tree_node<KeyType, DataType, RankType>;
+	using Allocator = typename NodeAllocator<Node>;
+public:
+	// @return nullptr if key is not present in the tree.
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	Node* search(const LookupKeyType& key) {
+		this->instrumentation_.on_lookup();
+		return this->search_subtree(to_lookup_key<Compare, KeyType>(key), this->root_);
+	}
+
+	// @return Iterator to the first element with a key not smaller than key, end() if there is none. O(logn).
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	Iterator lower_bound(const LookupKeyType& key) {
+		this->instrumentation_.on_lookup();
+		return Iterator(this->bound(to_lookup_key<Compare, KeyType>(key), false));
+	}
+	// @return Iterator to the first element with a key bigger than key, end() if there is none. O(logn).
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	Iterator upper_bound(const LookupKeyType& key) {
+		this->instrumentation_.on_lookup();
+		return Iterator(this->bound(to_lookup_key<Compare, KeyType>(key), true));
+	}
+
+	// Creates a node on the tree. Does a copy operation on the data.
+	// @return false if key is already in tree.
+	bool insert(const KeyType& key_, const DataType& data_) {
+		return this->insert_node(key_, data_);
+	}
+	// Creates a node on the tree. Does a move operation on the data.
+	// @return false if key is already in tree.
+	bool insert(const KeyType& key_, DataType&& data_) {
+		return this->insert_node(key_, std::move(data_));
+	}
+	// Creates a node on the tree. Constructs the DataType object in place (avoids copy/move operations).
+	// @param[...args] args are passed to the DataType constructor.
+	// @return false if key is already in tree.
+	template <typename... ArgTypes>
+	bool emplace(const KeyType& key_, ArgTypes&&... args) {
+		return this->insert_node(key_, std::forward<ArgTypes>(args)...);
+	}
+
+	// Removes an element from the tree and calls the destructor on its data.
+	// If the removed element has 2 children, the max() in its left subtree is relinked into its place first,
+	// so no key or data is copied or moved and every other node keeps its address.
+	// Then the node, which has at most one child by now, is unlinked and the policy rebalances.
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	bool remove(const LookupKeyType& key_) {
+		this->instrumentation_.on_remove();
+		Node* const node = this->search_subtree(to_lookup_key<Compare, KeyType>(key_), this->root_);
+		if (!node) {
+			return false;
+		}
+		if (node->left_ && node->right_) {
+			this->swap_with_predecessor(node);
+		}
+		Node* const parent = node->parent_;
+		Node* const child = node->left_ ? node->left_ : node->right_;
+		const bool isLeft = parent && (parent->left_ == node);
+		if (child) {
+			child->parent_ = parent;
+		}
+		if (!parent) {
+			this->root_ = child;
+		}
+		else if (isLeft) {
+			parent->left_ = child;
+		}
+		else {
+			parent->right_ = child;
+		}
+		const RankType removedRank = node->rank_;
+		this->allocator_.destroy(node);
+		this->instrumentation_.on_deallocations(1);
+		this->size_--;
+		Balancing::after_remove(*this, parent, child, isLeft, removedRank);
+		return true;
+	}
+
+	// Removes all elements from the tree.
+	// If the allocator can release in bulk and the nodes don't need their destructors called,
+	// this is O(number of allocator blocks). Otherwise every node is destructed on the way.
+	void clear() {
+		if (this->root_) {
+			if constexpr (!(Allocator::releases_in_bulk && std::is_trivially_destructible_v<KeyType> && std::is_trivially_destructible_v<DataType>)) {
+				this->destroy_subtree(this->root_);
+			}
+			this->instrumentation_.on_deallocations(this->size_);
+			this->root_ = nullptr;
+		}
+		this->size_ = 0;
+		this->allocator_.release();
+	}
+
+	Node* min() {
+		return this->root_ ? find_min_in_subtree(this->root_) : nullptr;
+	}
+	Node* max() {
+		return this->root_ ? find_max_in_subtree(this->root_) : nullptr;
+	}
+
+	// @return Number of elements in the tree. O(1).
+	size_t size() const {
+		return this->size_;
+	}
+	bool empty() const {
+		return (this->size_ == 0);
+	}
+
+	// @return An in-order traversal iterator pointing at the smallest element of the tree.
+	Iterator begin() {
+		return Iterator(this->min());
+	}
+	// @return An in-order traversal iterator pointing at nullptr.
+	Iterator end() {
+		return Iterator(nullptr);
+	}
+
+	const Compare& key_comp() const {
+		return this->compare_;
+	}
+
+	// @return The instrumentation policy the tree reports its work to, see instrumentation.hpp.
+	// Rotations are counted as the balancing policy does them, a double rotation counting once as its own kind.
+	Instrumentation& instrumentation() const {
+		return this->instrumentation_;
+	}
+
+	// @return Size, height, average depth and memory footprint of the tree. O(n).
+	tree_stats stats() const {
+		tree_stats stats;
+		stats.size = this->size_;
+		size_t depthSum = 0;
+		std::vector<std::pair<const Node*, size_t>> stack;
+		if (this->root_) {
+			stack.emplace_back(this->root_, 1);
+		}
+		while (!stack.empty()) {
+			const auto [node, depth] = stack.back();
+			stack.pop_back();
+			depthSum += depth;
+			stats.height = std::max(stats.height, depth);
+			if (node->left_) {
+				stack.emplace_back(node->left_, depth + 1);
+			}
+			if (node->right_) {
+				stack.emplace_back(node->right_, depth + 1);
+			}
+		}
+		stats.averageDepth = (stats.size > 0) ? (static_cast<double>(depthSum) / static_cast<double>(stats.size)) : 0.0;
+		stats.memoryBytes = sizeof(balanced_tree) + stats.size * sizeof(Node);
+		return stats;
+	}
+
+	// Copies other node by node, keeping its shape and ranks. O(n), without recursion.
+	balanced_tree(const balanced_tree& other) requires std::copyable<DataType>
+		: compare_(other.compare_) {
+		this->copy_from(other);
+	}
+	balanced_tree& operator=(const balanced_tree& other) requires std::copyable<DataType> {
+		if (this != &other) {
+			this->clear();
+			this->compare_ = other.compare_;
+			this->copy_from(other);
+		}
+		return *this;
+	}
+	balanced_tree(balanced_tree&& other) noexcept
+		: allocator_(std::move(other.allocator_))
+		, compare_(other.compare_)
+		, root_(std::exchange(other.root_, nullptr))
+		, size_(std::exchange(other.size_, 0)) {}
+	balanced_tree& operator=(balanced_tree&& other) noexcept {
+		this->clear();
+		this->allocator_ = std::move(other.allocator_);
+		this->compare_ = other.compare_;
+		this->root_ = std::exchange(other.root_, nullptr);
+		this->size_ = std::exchange(other.size_, 0);
+		return *this;
+	}
+	~balanced_tree() {
+		this->clear();
+	}
+
+	explicit balanced_tree(const Compare& compare)
+		: compare_(compare) {}
+	balanced_tree() = default;
+
+	friend Balancing;
+private:
+	// One call to compare_ per pair of keys, see three_way_compare().
+	template<typename LeftType, typename RightType>
+	std::weak_ordering compare_keys(const LeftType& left, const RightType& right) const {
+		this->instrumentation_.on_comparison();
+		return three_way_compare(this->compare_, left, right);
+	}
+
+	// @return nullptr if key is not present in the subtree.
+	template<typename LookupKeyType>
+	Node* search_subtree(const LookupKeyType& key, Node* node) const {
+		while (node) {
+			this->instrumentation_.on_visit();
+			const std::weak_ordering order = this->compare_keys(key, node->key);
+			if (order == 0) {
+				return node;
+			}
+			node = (order < 0) ? node->left_ : node->right_;
+		}
+		return nullptr;
+	}
+	// @return The first node with a key bigger than key if isUpper, not smaller than key otherwise. nullptr if there is none.
+	template<typename LookupKeyType>
+	Node* bound(const LookupKeyType& key, bool isUpper) const {
+		Node* node = this->root_;
+		Node* candidate = nullptr;
+		while (node) {
+			this->instrumentation_.on_visit();
+			const std::weak_ordering order = this->compare_keys(node->key, key);
+			if (order > 0 || (!isUpper && order == 0)) {
+				candidate = node;
+				node = node->left_;
+			}
+			else {
+				node = node->right_;
+			}
+		}
+		return candidate;
+	}
+
+	// Searches for the place of key, links a new node there as a leaf and lets the policy rebalance.
+	template<typename... ArgTypes>
+	bool insert_node(const KeyType& key, ArgTypes&&... args) {
+		this->instrumentation_.on_insert();
+		Node* parent = nullptr;
+		bool isLeft = false;
+		for (Node* node = this->root_; node; node = isLeft ? node->left_ : node->right_) {
+			this->instrumentation_.on_visit();
+			const std::weak_ordering order = this->compare_keys(key, node->key);
+			if (order == 0) {
+				return false;
+			}
+			parent = node;
+			isLeft = (order < 0);
+		}
+		Node* const node = this->allocator_.create(key, std::forward<ArgTypes>(args)...);
+		this->instrumentation_.on_allocations(1);
+		node->rank_ = Balancing::new_node_rank;
+		node->parent_ = parent;
+		if (!parent) {
+			this->root_ = node;
+		}
+		else if (isLeft) {
+			parent->left_ = node;
+		}
+		else {
+			parent->right_ = node;
+		}
+		this->size_++;
+		Balancing::after_insert(*this, node);
+		return true;
+	}
+
+	// Trades the tree positions of a node with two children and the max() of its left subtree, which has no right child.
+	// Links and ranks change places, the keys and data stay in their nodes.
+	// Afterwards node has at most one child, and the predecessor sits where node was. Used by remove().
+	void swap_with_predecessor(Node* node) {
+		Node* const predecessor = find_max_in_subtree(node->left_);
+		Node* const parent = node->parent_;
+		Node* const predecessorLeft = predecessor->left_;
+
+		if (parent) {
+			(parent->left_ == node) ? parent->left_ = predecessor : parent->right_ = predecessor;
+		}
+		else {
+			this->root_ = predecessor;
+		}
+		if (predecessor == node->left_) {
+			predecessor->left_ = node;
+			node->parent_ = predecessor;
+		}
+		else {
+			predecessor->left_ = node->left_;
+			node->left_->parent_ = predecessor;
+			predecessor->parent_->right_ = node;
+			node->parent_ = predecessor->parent_;
+		}
+		predecessor->parent_ = parent;
+		predecessor->right_ = node->right_;
+		node->right_->parent_ = predecessor;
+		node->left_ = predecessorLeft;
+		if (predecessorLeft) {
+			predecessorLeft->parent_ = node;
+		}
+		node->right_ = nullptr;
+
+		std::swap(node->rank_, predecessor->rank_);
+	}
+
+	// The interface balancing policies work through, see balancing.hpp.
+	static Node* left_child(Node* node) {
+		return node->left_;
+	}
+	static Node* right_child(Node* node) {
+		return node->right_;
+	}
+	static Node* parent_of(Node* node) {
+		return node->parent_;
+	}
+	static RankType& rank(Node* node) {
+		return node->rank_;
+	}
+	void on_rebalance_step() const {
+		this->instrumentation_.on_rebalance_step();
+	}
+	// Rotations update root_ when they rotate the root of the tree.
+	// @return The node that took root's place.
+	Node* rotate_left(Node* root) {
+		this->instrumentation_.on_rotation(tree_rotation::left);
+		return this->rotate_left_unrecorded(root);
+	}
+	Node* rotate_right(Node* root) {
+		this->instrumentation_.on_rotation(tree_rotation::right);
+		return this->rotate_right_unrecorded(root);
+	}
+	Node* rotate_left_right(Node* root) {
+		this->instrumentation_.on_rotation(tree_rotation::left_right);
+		this->rotate_left_unrecorded(root->left_);
+		return this->rotate_right_unrecorded(root);
+	}
+	Node* rotate_right_left(Node* root) {
+		this->instrumentation_.on_rotation(tree_rotation::right_left);
+		this->rotate_right_unrecorded(root->right_);
+		return this->rotate_left_unrecorded(root);
+	}
+	Node* rotate_left_unrecorded(Node* root) {
+		Node* const pivot = root->right_;
+		this->replace_child(root, pivot);
+		root->right_ = pivot->left_;
+		if (pivot->left_) {
+			pivot->left_->parent_ = root;
+		}
+		pivot->left_ = root;
+		root->parent_ = pivot;
+		Balancing::after_rotation(*this, root, pivot);
+		return pivot;
+	}
+	Node* rotate_right_unrecorded(Node* root) {
+		Node* const pivot = root->left_;
+		this->replace_child(root, pivot);
+		root->left_ = pivot->right_;
+		if (pivot->right_) {
+			pivot->right_->parent_ = root;
+		}
+		pivot->right_ = root;
+		root->parent_ = pivot;
+		Balancing::after_rotation(*this, root, pivot);
+		return pivot;
+	}
+	// Links replacement where node is, under node's parent or as the root.
+	void replace_child(Node* node, Node* replacement) {
+		Node* const parent = node->parent_;
+		replacement->parent_ = parent;
+		if (!parent) {
+			this->root_ = replacement;
+		}
+		else if (parent->left_ == node) {
+			parent->left_ = replacement;
+		}
+		else {
+			parent->right_ = replacement;
+		}
+	}
+
+	static Node* find_min_in_subtree(Node* root) {
+		while (root->left_) {
+			root = root->left_;
+		}
+		return root;
+	}
+	static Node* find_max_in_subtree(Node* root) {
+		while (root->right_) {
+			root = root->right_;
+		}
+		return root;
+	}
+
+	// Destroys every node of a subtree, children before their parents, without recursion.
+	// A node is destroyed once its subtrees are, found by climbing back up from the leaf it was reached through.
+	void destroy_subtree(Node* root) {
+		Node* node = root;
+		while (node) {
+			if (node->left_) {
+				node = node->left_;
+			}
+			else if (node->right_) {
+				node = node->right_;
+			}
+			else {
+				Node* const parent = (node == root) ? nullptr : node->parent_;
+				if (parent) {
+					(parent->left_ == node) ? parent->left_ = nullptr : parent->right_ = nullptr;
+				}
+				this->allocator_.destroy(node);
+				node = parent;
+			}
+		}
+	}
+	// Copies the nodes of other into this empty tree in preorder, linking each copy under the copy of its parent.
+	void copy_from(const balanced_tree& other) {
+		if (!other.root_) {
+			return;
+		}
+		// Source node, and the copied parent it hangs under on the left or right.
+		struct PendingCopy {
+			const Node* source;
+			Node* parent;
+			bool isLeft;
+		};
+		std::vector<PendingCopy> stack = { { other.root_, nullptr, false } };
+		while (!stack.empty()) {
+			const PendingCopy pending = stack.back();
+			stack.pop_back();
+			Node* const node = this->allocator_.create(pending.source->key, pending.source->data);
+			node->rank_ = pending.source->rank_;
+			node->parent_ = pending.parent;
+			if (!pending.parent) {
+				this->root_ = node;
+			}
+			else if (pending.isLeft) {
+				pending.parent->left_ = node;
+			}
+			else {
+				pending.parent->right_ = node;
+			}
+			if (pending.source->right_) {
+				stack.push_back({ pending.source->right_, node, false });
+			}
+			if (pending.source->left_) {
+				stack.push_back({ pending.source->left_, node, true });
+			}
+		}
+		this->size_ = other.size_;
+		this->instrumentation_.on_allocations(this->size_);
+	}
+
+	Allocator allocator_;
+	Compare compare_;
+	mutable Instrumentation instrumentation_;
+	Node* root_ = nullptr;
+	size_t size_ = 0;
+};
@@ -0,0 +1,335 @@
+#pragma once
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+
+
+// Rebalancing policies for balanced_tree, see balanced_tree.hpp.
+// Every node keeps a rank_type value its policy decides the meaning of: a height, a color, a rank or a subtree size.
+// The tree does the search, linking and unlinking itself, and calls the policy to restore balance afterwards:
+// - after_insert(tree, node) once node is linked in as a leaf, with its rank set to new_node_rank.
+// - after_remove(tree, parent, child, isLeft, removedRank) once a node with at most one child is unlinked.
+//   child took its place as the left (isLeft) or right child of parent, either of them may be nullptr,
+//   and removedRank is the rank the unlinked node had.
+// - after_rotation(tree, lowered, raised) after every single rotation, raised being the node that took lowered's place.
+// Policies work through the tree's left_child(), right_child(), parent_of() and rank() accessors,
+// rotate_left(), rotate_right(), rotate_left_right() and rotate_right_left(), which return the new root of the rotated subtree,
+// and on_rebalance_step(), which policies call once per node they look at on the way up.
+//
+// Rotations per update, for the ones that matter to delete-heavy workloads:
+// - avl_balancing: at most 2 per insert, O(logn) per remove in the worst case.
+// - red_black_balancing: at most 2 per insert, at most 3 per remove.
+// - wavl_balancing: at most 2 per insert and per remove. Without removes it builds the same trees as AVL.
+// - weight_balancing: O(1) amortized per update, and rebalancing a subtree happens less often the bigger it is.
+
+template<typename Balancing>
+concept balancing_policy = requires {
+	typename Balancing::rank_type;
+	{ Balancing::new_node_rank } -> std::convertible_to<typename Balancing::rank_type>;
+};
+
+// AVL trees, kept by heights rather than balance factors so the policy needs nothing but the ranks of a node's children.
+// The rank of a node is the height of its subtree, leaves have height 0.
+// Subtree heights differ by at most 1 at every node, so the tree is at most 1.44 * log2(n) tall.
+struct avl_balancing {
+	using rank_type = int8_t;
+	static constexpr rank_type new_node_rank = 0;
+
+	template<typename Tree, typename Node>
+	static void after_insert(Tree& tree, Node* node) {
+		retrace(tree, tree.parent_of(node));
+	}
+	template<typename Tree, typename Node>
+	static void after_remove(Tree& tree, Node* parent, Node* child, bool isLeft, rank_type removedRank) {
+		retrace(tree, parent);
+	}
+	template<typename Tree, typename Node>
+	static void after_rotation(Tree& tree, Node* lowered, Node* raised) {
+		update_height(tree, lowered);
+		update_height(tree, raised);
+	}
+private:
+	template<typename Tree, typename Node>
+	static int height(Tree& tree, Node* node) {
+		return node ? tree.rank(node) : -1;
+	}
+	template<typename Tree, typename Node>
+	static void update_height(Tree& tree, Node* node) {
+		tree.rank(node) = static_cast<rank_type>(1 + std::max(height(tree, tree.left_child(node)), height(tree, tree.right_child(node))));
+	}
+	// Climbs from node, rotating every ancestor whose subtrees differ in height by 2, until a subtree is as tall as it was before.
+	// The stored height of node is still the one from before the update, which is what it is compared with.
+	template<typename Tree, typename Node>
+	static void retrace(Tree& tree, Node* node) {
+		while (node) {
+			tree.on_rebalance_step();
+			const int oldHeight = tree.rank(node);
+			Node* const left = tree.left_child(node);
+			Node* const right = tree.right_child(node);
+			const int balance = height(tree, left) - height(tree, right);
+			if (balance > 1) {
+				node = (height(tree, tree.left_child(left)) < height(tree, tree.right_child(left))) ? tree.rotate_left_right(node) : tree.rotate_right(node);
+			}
+			else if (balance < -1) {
+				node = (height(tree, tree.right_child(right)) < height(tree, tree.left_child(right))) ? tree.rotate_right_left(node) : tree.rotate_left(node);
+			}
+			else {
+				update_height(tree, node);
+			}
+			if (tree.rank(node) == oldHeight) {
+				return;
+			}
+			node = tree.parent_of(node);
+		}
+	}
+};
+
+// Red-black trees, as in CLRS. The rank of a node is its color, missing children are black.
+// No red node has a red child and every path down from a node passes the same number of black nodes,
+// so the tree is at most 2 * log2(n) tall. Recoloring does most of the work, rotations are kept to a constant number per update.
+struct red_black_balancing {
+	using rank_type = uint8_t;
+	static constexpr rank_type red = 0;
+	static constexpr rank_type black = 1;
+	static constexpr rank_type new_node_rank = red;
+
+	// A red node under a red parent is fixed by recoloring while its uncle is red, moving the problem two levels up,
+	// and by one single or double rotation once the uncle is black.
+	template<typename Tree, typename Node>
+	static void after_insert(Tree& tree, Node* node) {
+		Node* parent;
+		while ((parent = tree.parent_of(node)) && is_red(tree, parent)) {
+			tree.on_rebalance_step();
+			// A red parent isn't the root, so there is a grandparent.
+			Node* const grandparent = tree.parent_of(parent);
+			const bool isParentLeft = (tree.left_child(grandparent) == parent);
+			Node* const uncle = isParentLeft ? tree.right_child(grandparent) : tree.left_child(grandparent);
+			if (is_red(tree, uncle)) {
+				tree.rank(parent) = black;
+				tree.rank(uncle) = black;
+				tree.rank(grandparent) = red;
+				node = grandparent;
+				continue;
+			}
+			Node* top;
+			if (isParentLeft) {
+				top = (node == tree.right_child(parent)) ? tree.rotate_left_right(grandparent) : tree.rotate_right(grandparent);
+			}
+			else {
+				top = (node == tree.left_child(parent)) ? tree.rotate_right_left(grandparent) : tree.rotate_left(grandparent);
+			}
+			tree.rank(top) = black;
+			tree.rank(grandparent) = red;
+			return;
+		}
+		if (!parent) {
+			tree.rank(node) = black;
+		}
+	}
+	// Unlinking a black node leaves its side of parent one black short. A red child takes it by turning black,
+	// otherwise the shortage moves up while the sibling can be recolored red, and is settled by at most 3 rotations.
+	template<typename Tree, typename Node>
+	static void after_remove(Tree& tree, Node* parent, Node* child, bool isLeft, rank_type removedRank) {
+		if (removedRank == red) {
+			return;
+		}
+		Node* node = child;
+		while (parent && !is_red(tree, node)) {
+			tree.on_rebalance_step();
+			// node's side is a black short of the other, so the other side has a black node at least.
+			Node* sibling = isLeft ? tree.right_child(parent) : tree.left_child(parent);
+			if (is_red(tree, sibling)) {
+				tree.rank(sibling) = black;
+				tree.rank(parent) = red;
+				isLeft ? tree.rotate_left(parent) : tree.rotate_right(parent);
+				sibling = isLeft ? tree.right_child(parent) : tree.left_child(parent);
+			}
+			Node* const outer = isLeft ? tree.right_child(sibling) : tree.left_child(sibling);
+			Node* const inner = isLeft ? tree.left_child(sibling) : tree.right_child(sibling);
+			if (!is_red(tree, outer) && !is_red(tree, inner)) {
+				tree.rank(sibling) = red;
+				node = parent;
+				parent = tree.parent_of(node);
+				isLeft = parent && (tree.left_child(parent) == node);
+				continue;
+			}
+			if (!is_red(tree, outer)) {
+				tree.rank(inner) = black;
+				tree.rank(sibling) = red;
+				sibling = isLeft ? tree.rotate_right(sibling) : tree.rotate_left(sibling);
+			}
+			tree.rank(sibling) = tree.rank(parent);
+			tree.rank(parent) = black;
+			tree.rank(isLeft ? tree.right_child(sibling) : tree.left_child(sibling)) = black;
+			isLeft ? tree.rotate_left(parent) : tree.rotate_right(parent);
+			return;
+		}
+		if (node) {
+			tree.rank(node) = black;
+		}
+	}
+	template<typename Tree, typename Node>
+	static void after_rotation(Tree& tree, Node* lowered, Node* raised) {}
+private:
+	template<typename Tree, typename Node>
+	static bool is_red(Tree& tree, Node* node) {
+		return node && (tree.rank(node) == red);
+	}
+};
+
+// Weak AVL trees, after Haeupler, Sen and Tarjan's rank-balanced trees.
+// Every node has a rank and missing children have rank -1. A child's rank is 1 or 2 below its parent's, and leaves have rank 0.
+// Without removes the ranks are AVL heights. Removes let nodes have two children 2 ranks below them, which AVL forbids,
+// and in exchange never rotate more than twice. The tree is at most 2 * log2(n) tall, and at most 1.44 * log2(m) for m inserts.
+struct wavl_balancing {
+	using rank_type = int16_t;
+	static constexpr rank_type new_node_rank = 0;
+
+	// A child with the rank of its parent promotes the parent while the parent's other child is 1 rank below it,
+	// and is fixed with one single or double rotation once the other child is 2 ranks below.
+	template<typename Tree, typename Node>
+	static void after_insert(Tree& tree, Node* node) {
+		Node* parent = tree.parent_of(node);
+		while (parent && tree.rank(parent) == tree.rank(node)) {
+			tree.on_rebalance_step();
+			const bool isLeft = (tree.left_child(parent) == node);
+			Node* const sibling = isLeft ? tree.right_child(parent) : tree.left_child(parent);
+			if (tree.rank(parent) - rank_of(tree, sibling) == 1) {
+				tree.rank(parent)++;
+				node = parent;
+				parent = tree.parent_of(node);
+				continue;
+			}
+			Node* const inner = isLeft ? tree.right_child(node) : tree.left_child(node);
+			if (tree.rank(node) - rank_of(tree, inner) == 2) {
+				isLeft ? tree.rotate_right(parent) : tree.rotate_left(parent);
+				tree.rank(parent)--;
+			}
+			else {
+				isLeft ? tree.rotate_left_right(parent) : tree.rotate_right_left(parent);
+				tree.rank(inner)++;
+				tree.rank(node)--;
+				tree.rank(parent)--;
+			}
+			return;
+		}
+	}
+	// A parent left as a leaf of rank 1 is demoted. Then a child 3 ranks below its parent demotes the parent
+	// (and the sibling, if both the sibling's children are 2 ranks below it) while the sibling allows it,
+	// and is fixed with one single or double rotation otherwise.
+	template<typename Tree, typename Node>
+	static void after_remove(Tree& tree, Node* parent, Node* child, bool isLeft, rank_type removedRank) {
+		if (!parent) {
+			return;
+		}
+		Node* node = child;
+		if (!tree.left_child(parent) && !tree.right_child(parent) && tree.rank(parent) == 1) {
+			tree.on_rebalance_step();
+			tree.rank(parent) = 0;
+			node = parent;
+			parent = tree.parent_of(node);
+			isLeft = parent && (tree.left_child(parent) == node);
+		}
+		while (parent && tree.rank(parent) - rank_of(tree, node) == 3) {
+			tree.on_rebalance_step();
+			// parent's rank is at least 2, so its other child is there.
+			Node* const sibling = isLeft ? tree.right_child(parent) : tree.left_child(parent);
+			if (tree.rank(parent) - tree.rank(sibling) == 2) {
+				tree.rank(parent)--;
+			}
+			else if (tree.rank(sibling) - rank_of(tree, tree.left_child(sibling)) == 2 && tree.rank(sibling) - rank_of(tree, tree.right_child(sibling)) == 2) {
+				tree.rank(parent)--;
+				tree.rank(sibling)--;
+			}
+			else {
+				rotate_after_remove(tree, parent, sibling, isLeft);
+				return;
+			}
+			node = parent;
+			parent = tree.parent_of(node);
+			isLeft = parent && (tree.left_child(parent) == node);
+		}
+	}
+	template<typename Tree, typename Node>
+	static void after_rotation(Tree& tree, Node* lowered, Node* raised) {}
+private:
+	template<typename Tree, typename Node>
+	static int rank_of(Tree& tree, Node* node) {
+		return node ? tree.rank(node) : -1;
+	}
+	// parent has a child 3 ranks below it on the isLeft side, and sibling is 1 rank below it with a child 1 rank below sibling.
+	template<typename Tree, typename Node>
+	static void rotate_after_remove(Tree& tree, Node* parent, Node* sibling, bool isLeft) {
+		Node* const outer = isLeft ? tree.right_child(sibling) : tree.left_child(sibling);
+		Node* const inner = isLeft ? tree.left_child(sibling) : tree.right_child(sibling);
+		if (tree.rank(sibling) - rank_of(tree, outer) == 1) {
+			isLeft ? tree.rotate_left(parent) : tree.rotate_right(parent);
+			tree.rank(sibling)++;
+			tree.rank(parent)--;
+			if (!tree.left_child(parent) && !tree.right_child(parent)) {
+				tree.rank(parent)--;
+			}
+		}
+		else {
+			isLeft ? tree.rotate_right_left(parent) : tree.rotate_left_right(parent);
+			tree.rank(inner) += 2;
+			tree.rank(sibling)--;
+			tree.rank(parent) -= 2;
+		}
+	}
+};
+
+// Weight-balanced trees (BB[alpha]) with the parameters of Hirai and Yamamoto, delta = 3 and gamma = 2.
+// The rank of a node is the size of its subtree. Neither subtree of a node weighs more than delta times the other,
+// a subtree's weight being its size plus one, so the tree is at most about 2.7 * log2(n) tall.
+// Every update walks up to the root to keep the sizes, but rotations are O(1) amortized per update,
+// and a subtree of size s is only rotated again after O(s) updates inside it.
+struct weight_balancing {
+	using rank_type = size_t;
+	static constexpr rank_type new_node_rank = 1;
+	static constexpr size_t delta = 3;
+	static constexpr size_t gamma = 2;
+
+	template<typename Tree, typename Node>
+	static void after_insert(Tree& tree, Node* node) {
+		retrace(tree, tree.parent_of(node));
+	}
+	template<typename Tree, typename Node>
+	static void after_remove(Tree& tree, Node* parent, Node* child, bool isLeft, rank_type removedRank) {
+		retrace(tree, parent);
+	}
+	template<typename Tree, typename Node>
+	static void after_rotation(Tree& tree, Node* lowered, Node* raised) {
+		update_size(tree, lowered);
+		update_size(tree, raised);
+	}
+private:
+	template<typename Tree, typename Node>
+	static size_t weight(Tree& tree, Node* node) {
+		return (node ? tree.rank(node) : 0) + 1;
+	}
+	template<typename Tree, typename Node>
+	static void update_size(Tree& tree, Node* node) {
+		tree.rank(node) = weight(tree, tree.left_child(node)) + weight(tree, tree.right_child(node)) - 1;
+	}
+	// Updates the sizes from node up to the root, rotating wherever one side got too heavy.
+	// A heavy side whose inner subtree weighs gamma times its outer one or more needs a double rotation.
+	template<typename Tree, typename Node>
+	static void retrace(Tree& tree, Node* node) {
+		while (node) {
+			tree.on_rebalance_step();
+			update_size(tree, node);
+			Node* const left = tree.left_child(node);
+			Node* const right = tree.right_child(node);
+			if (weight(tree, right) > delta * weight(tree, left)) {
+				node = (weight(tree, tree.left_child(right)) < gamma * weight(tree, tree.right_child(right))) ? tree.rotate_left(node) : tree.rotate_right_left(node);
+			}
+			else if (weight(tree, left) > delta * weight(tree, right)) {
+				node = (weight(tree, tree.right_child(left)) < gamma * weight(tree, tree.left_child(left))) ? tree.rotate_right(node) : tree.rotate_left_right(node);
+			}
+			node = tree.parent_of(node);
+		}
+	}
+};
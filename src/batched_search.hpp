@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+#include <array>
+#include <ranges>
+#include <iterator>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define BATCHED_SEARCH_BUILTIN_PREFETCH
+#elif defined(_M_X64) || defined(_M_IX86)
+#define BATCHED_SEARCH_MM_PREFETCH
+#include <xmmintrin.h>
+#endif
+
+
+
+// Number of lookups search_many() keeps in flight at once. Enough to cover the misses a core can have outstanding,
+// few enough that the lookups' state stays in registers and L1.
+inline constexpr size_t batched_search_group_size = 16;
+
+// Asks for the cache line at address to be loaded for reading, without waiting for it. Does nothing where there is no prefetch instruction.
+inline void prefetch_for_read(const void* address) {
+#if defined(BATCHED_SEARCH_BUILTIN_PREFETCH)
+	__builtin_prefetch(address, 0, 3);
+#elif defined(BATCHED_SEARCH_MM_PREFETCH)
+	_mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#endif
+}
+
+// Where one step of a lookup went. isDone with a nullptr node means the key is not present.
+template<typename NodeType>
+struct search_step {
+	NodeType* node;
+	bool isDone;
+};
+
+// Looks up every key of keys in the tree rooted at root, writing the node found for keys[i], or nullptr, to out[i].
+// A single lookup is a chain of dependent cache misses, one per level. Here a group of lookups is advanced in turns,
+// one level each, and the child a lookup moves to is prefetched, so it has arrived by the time the lookup's next turn comes.
+// That keeps a miss of every lookup in the group in flight at once. A finished lookup is replaced by the next key right away,
+// so lookups of different depths don't wait on each other.
+// step(key, node) compares key with node and returns the child to continue at, or the result.
+// @return Number of keys found.
+template<typename NodeType, std::ranges::random_access_range KeyRange, std::random_access_iterator OutputIterator, typename Step>
+size_t interleaved_search(NodeType* root, const KeyRange& keys, OutputIterator out, Step&& step) {
+	struct Lookup {
+		size_t index;
+		NodeType* node;
+	};
+	const size_t count = static_cast<size_t>(std::ranges::size(keys));
+	const auto firstKey = std::ranges::begin(keys);
+	if (!root) {
+		for (size_t i = 0; i < count; i++) {
+			out[i] = nullptr;
+		}
+		return 0;
+	}
+
+	std::array<Lookup, batched_search_group_size> lookups;
+	size_t activeCount = 0;
+	size_t nextIndex = 0;
+	while (activeCount < batched_search_group_size && nextIndex < count) {
+		lookups[activeCount++] = { nextIndex++, root };
+	}
+	size_t foundCount = 0;
+	while (activeCount > 0) {
+		size_t slot = 0;
+		while (slot < activeCount) {
+			Lookup& lookup = lookups[slot];
+			const search_step<NodeType> result = step(firstKey[lookup.index], lookup.node);
+			if (!result.isDone) {
+				lookup.node = result.node;
+				prefetch_for_read(result.node);
+				slot++;
+				continue;
+			}
+			out[lookup.index] = result.node;
+			if (result.node) {
+				foundCount++;
+			}
+			if (nextIndex < count) {
+				lookup = { nextIndex++, root };
+				slot++;
+			}
+			else {
+				// The last lookup takes the finished one's slot, and gets its turn next.
+				lookup = lookups[--activeCount];
+			}
+		}
+	}
+	return foundCount;
+}
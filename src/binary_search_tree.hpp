@@ -1,7 +1,19 @@
 #pragma once
+#include "key_compare.hpp"
+#include "thread_pool.hpp"
+#include "instrumentation.hpp"
+#include "batched_search.hpp"
+
 #include <concepts>
+#include <type_traits>
 #include <vector>
 #include <utility>
+#include <compare>
+#include <ranges>
+#include <bit>
+#include <iterator>
+#include <functional>
+#include <optional>
 
 
 
@@ -9,16 +21,14 @@
 // <<<----------- Class forward declarations ----------->>>
 // <<<-------------------------------------------------->>>
 template<typename KeyType, typename DataType>
-	requires (std::totally_ordered<KeyType>&& std::copyable<KeyType>
-			  && std::copyable<DataType>)
+	requires (std::copyable<KeyType> && std::movable<DataType>)
 class binary_search_tree_iterator;
 template<typename KeyType, typename DataType>
-	requires (std::totally_ordered<KeyType> && std::copyable<KeyType>
-			  && std::copyable<DataType>)
+	requires (std::copyable<KeyType> && std::movable<DataType>)
 class binary_search_tree_node;
-template<typename KeyType, typename DataType>
-	requires (std::totally_ordered<KeyType> && std::copyable<KeyType>
-			  && std::copyable<DataType>)
+template<typename KeyType, typename DataType, typename Compare = three_way_key_compare, typename Instrumentation = no_instrumentation>
+	requires (std::copyable<KeyType> && std::movable<DataType>
+			  && key_comparator_for<Compare, KeyType, KeyType> && tree_instrumentation<Instrumentation>)
 class binary_search_tree;
 
 
@@ -26,8 +36,7 @@ class binary_search_tree;
 // An in-order traversal two way iterator.
 // end() iterator is nullptr.
 template<typename KeyType, typename DataType>
-	requires (std::totally_ordered<KeyType> && std::copyable<KeyType>
-			  && std::copyable<DataType>)
+	requires (std::copyable<KeyType> && std::movable<DataType>)
 class binary_search_tree_iterator {
 	using Iterator = typename binary_search_tree_iterator;
 	using Node = typename binary_search_tree_node<KeyType, DataType>;
@@ -39,6 +48,7 @@ public:
 		return (this->ptr_ != other.ptr_);
 	}
 
+	// Climbs by checking which child of its parent the node is, so a full traversal makes no key comparisons.
 	Iterator& operator++() {
 		if (!ptr_) {
 			return (*this);
@@ -52,45 +62,15 @@ public:
 			return *this;
 		}
 
-		while (ptr_->parent_) {
-			if (ptr_->key < ptr_->parent_->key) {
-				ptr_ = ptr_->parent_;
-				return *this;
-			}
-			else {
-				ptr_ = ptr_->parent_;
-			}
+		while (ptr_->parent_ && (ptr_ == ptr_->parent_->right_)) {
+			ptr_ = ptr_->parent_;
 		}
-
-		ptr_ = nullptr;
+		ptr_ = ptr_->parent_;
 		return *this;
 	}
 	Iterator operator++(int) {
 		Iterator temp = *this;
 		++(*this);
-		if (!temp.ptr_) {
-			return (temp);
-		}
-
-		if (temp.ptr_->right_) {
-			temp.ptr_ = temp.ptr_->right_;
-			while (temp.ptr_->left_) {
-				temp.ptr_ = temp.ptr_->left_;
-			}
-			return temp;
-		}
-
-		while (temp.ptr_->parent_) {
-			if (temp.ptr_->key < temp.ptr_->parent_->key) {
-				temp.ptr_ = temp.ptr_->parent_;
-				return temp;
-			}
-			else {
-				temp.ptr_ = temp.ptr_->parent_;
-			}
-		}
-
-		temp.ptr_ = nullptr;
 		return temp;
 	}
 
@@ -107,45 +87,15 @@ public:
 			return *this;
 		}
 
-		while (ptr_->parent_) {
-			if (ptr_->key > ptr_->parent_->key) {
-				ptr_ = ptr_->parent_;
-				return *this;
-			}
-			else {
-				ptr_ = ptr_->parent_;
-			}
+		while (ptr_->parent_ && (ptr_ == ptr_->parent_->left_)) {
+			ptr_ = ptr_->parent_;
 		}
-
-		ptr_ = nullptr;
+		ptr_ = ptr_->parent_;
 		return *this;
 	}
 	Iterator operator--(int) {
 		Iterator temp = *this;
-		++(*this);
-		if (!temp.ptr_) {
-			return (temp);
-		}
-
-		if (temp.ptr_->left_) {
-			temp.ptr_ = temp.ptr_->left_;
-			while (temp.ptr_->right_) {
-				temp.ptr_ = temp.ptr_->right_;
-			}
-			return temp;
-		}
-
-		while (temp.ptr_->parent_) {
-			if (temp.ptr_->key > temp.ptr_->parent_->key) {
-				temp.ptr_ = temp.ptr_->parent_;
-				return temp;
-			}
-			else {
-				temp.ptr_ = temp.ptr_->parent_;
-			}
-		}
-
-		temp.ptr_ = nullptr;
+		--(*this);
 		return temp;
 	}
 
@@ -164,8 +114,7 @@ private:
 
 // Holds a key-data pair.
 template<typename KeyType, typename DataType>
-	requires (std::totally_ordered<KeyType> && std::copyable<KeyType>
-			  && std::copyable<DataType>)
+	requires (std::copyable<KeyType> && std::movable<DataType>)
 class binary_search_tree_node {
 	using Node = typename binary_search_tree_node;
 public:
@@ -181,7 +130,10 @@ public:
 		, data(DataType(std::forward<ArgTypes>(args)...)) {}
 
 	friend binary_search_tree_iterator<KeyType, DataType>;
-	friend binary_search_tree<KeyType, DataType>;
+	template<typename TreeKeyType, typename TreeDataType, typename TreeCompare, typename TreeInstrumentation>
+		requires (std::copyable<TreeKeyType> && std::movable<TreeDataType>
+				  && key_comparator_for<TreeCompare, TreeKeyType, TreeKeyType> && tree_instrumentation<TreeInstrumentation>)
+	friend class binary_search_tree;
 private:
 	Node* left_ = nullptr;
 	Node* right_ = nullptr;
@@ -191,32 +143,59 @@ private:
 // A binary search tree implementation.
 // The key is a seperate member from the data, this means the DataType 
 // doesn't have to have comparison operators implemented.
-// KeyType must be copyable and totally_ordered.
-// DataType must be copyable.
-template<typename KeyType, typename DataType>
-	requires (std::totally_ordered<KeyType> && std::copyable<KeyType>
-			  && std::copyable<DataType>)
+// KeyType must be copyable.
+// DataType must be movable. Copying the tree needs it to be copyable.
+// Compare orders the keys, see key_compare.hpp. The default compares with <=>, or with < if KeyType has no <=>.
+// search() and remove() take any key type a transparent Compare can compare with KeyType.
+// Instrumentation counts comparisons, visited nodes and allocations, see instrumentation.hpp. The default no_instrumentation counts nothing.
+template<typename KeyType, typename DataType, typename Compare, typename Instrumentation>
+	requires (std::copyable<KeyType> && std::movable<DataType>
+			  && key_comparator_for<Compare, KeyType, KeyType> && tree_instrumentation<Instrumentation>)
 class binary_search_tree {
 	using Iterator = typename binary_search_tree_iterator<KeyType, DataType>;
 	using Node = typename binary_search_tree_node<KeyType, DataType>;
 public:
 	// @return nullptr if key is not present in the tree.
-	Node* search(const KeyType& key) {
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	Node* search(const LookupKeyType& key) {
+		this->instrumentation_.on_lookup();
 		if (root_) {
-			return search_subtree(key, root_);
+			return this->search_subtree(to_lookup_key<Compare, KeyType>(key), root_);
 		}
 		else {
 			return nullptr;
 		}
 	}
+	// Looks up every key of keys, writing the node found for keys[i], or nullptr, to out[i].
+	// The lookups are interleaved so the cache misses of many of them are waited on at once, see batched_search.hpp.
+	// For keys that aren't cached that is several times the throughput of calling search() in a loop.
+	// @return Number of keys found.
+	template<std::ranges::random_access_range KeyRange, std::random_access_iterator OutputIterator>
+		requires transparent_lookup_key_for<std::ranges::range_value_t<KeyRange>, Compare, KeyType>
+	size_t search_many(const KeyRange& keys, OutputIterator out) {
+		return interleaved_search(this->root_, keys, out, [this](const auto& key, Node* node) {
+			// Every lookup starts at the root.
+			if (node == this->root_) {
+				this->instrumentation_.on_lookup();
+			}
+			this->instrumentation_.on_visit();
+			const std::weak_ordering order = this->compare_keys(key, node->key);
+			if (order == 0) {
+				return search_step<Node>{ node, true };
+			}
+			Node* child = (order < 0) ? node->left_ : node->right_;
+			return search_step<Node>{ child, child == nullptr };
+		});
+	}
 
 	// Creates a node on the tree. Does a copy operation on the data.
 	// @return false if key is already in tree.
 	bool insert(const KeyType& key_, const DataType& data_) {
+		this->instrumentation_.on_insert();
 		if (this->root_) {
-			Node* parent = find_parent_for_key_in_subtree(key_, this->root_);
-			if (parent) {
-				this->insert_node_at(parent, new Node(key_, data_));
+			InsertPosition position = this->find_insert_position_in_subtree(key_, this->root_);
+			if (position.parent) {
+				insert_node_at(position, new Node(key_, data_));
 			}
 			else {
 				return false;
@@ -225,23 +204,28 @@ public:
 		else {
 			this->root_ = new Node(key_, data_);
 		}
+		this->size_++;
+		this->instrumentation_.on_allocations(1);
 		return true;
 	}
 	// Creates a newNode on the tree. Does a move operation on the data.
 	// @return false if key is already in tree.
 	bool insert(const KeyType& key_, DataType&& data_) {
+		this->instrumentation_.on_insert();
 		if (this->root_) {
-			Node* parent = find_parent_for_key_in_subtree(key_, this->root_);
-			if (parent) {
-				this->insert_node_at(parent, new Node(key_, std::move(data_)));
+			InsertPosition position = this->find_insert_position_in_subtree(key_, this->root_);
+			if (position.parent) {
+				insert_node_at(position, new Node(key_, std::move(data_)));
 			}
 			else {
 				return false;
 			}
 		}
 		else {
-			this->root_ = new Node(key_, std::move<DataType>(data_));
+			this->root_ = new Node(key_, std::move(data_));
 		}
+		this->size_++;
+		this->instrumentation_.on_allocations(1);
 		return true;
 	}
 	// Creates a newNode on the tree. Constructs the DataType object in place (avoids copy/move operations).
@@ -249,10 +233,11 @@ public:
 	// @return false if key is already in tree.
 	template <typename... ArgTypes>
 	bool emplace(const KeyType& key_, ArgTypes... args) {
+		this->instrumentation_.on_insert();
 		if (this->root_) {
-			Node* parent = find_parent_for_key_in_subtree(key_, this->root_);
-			if (parent) {
-				this->insert_node_at(parent, new Node(key_, std::forward<ArgTypes>(args)...));
+			InsertPosition position = this->find_insert_position_in_subtree(key_, this->root_);
+			if (position.parent) {
+				insert_node_at(position, new Node(key_, std::forward<ArgTypes>(args)...));
 			}
 			else {
 				return false;
@@ -261,81 +246,78 @@ public:
 		else {
 			this->root_ = new Node(key_, std::forward<ArgTypes>(args)...);
 		}
+		this->size_++;
+		this->instrumentation_.on_allocations(1);
 		return true;
 	}
 
+	// Creates a newNode on the tree if key is not in it, with one search for both the lookup and the insert.
+	// The DataType object is only constructed if key is absent, args are left untouched otherwise.
+	// @param[...args] args are passed to the DataType constructor.
+	// @return The node with key, and whether it was inserted.
+	template <typename... ArgTypes>
+	std::pair<Node*, bool> try_emplace(const KeyType& key_, ArgTypes&&... args) {
+		this->instrumentation_.on_insert();
+		return this->find_or_create(key_, [&]() { return new Node(key_, std::forward<ArgTypes>(args)...); });
+	}
+	// Creates a newNode on the tree, or assigns data_ to the data of key if it is already in the tree. One search either way.
+	// @return The node with key, and whether it was inserted.
+	template <typename ValueType>
+		requires (std::constructible_from<DataType, ValueType&&> && std::assignable_from<DataType&, ValueType&&>)
+	std::pair<Node*, bool> insert_or_assign(const KeyType& key_, ValueType&& data_) {
+		this->instrumentation_.on_insert();
+		std::pair<Node*, bool> result = this->find_or_create(key_, [&]() { return new Node(key_, std::forward<ValueType>(data_)); });
+		if (!result.second) {
+			result.first->data = std::forward<ValueType>(data_);
+		}
+		return result;
+	}
+	// Returns the node of key, creating it with the data makeData() returns if key is not in the tree. One search either way.
+	// makeData is only called if key is absent, so data that is expensive to build is only built when it is needed.
+	// @return The node with key, and whether it was inserted.
+	template <typename Factory>
+		requires std::constructible_from<DataType, std::invoke_result_t<Factory&>>
+	std::pair<Node*, bool> find_or_insert(const KeyType& key_, Factory&& makeData) {
+		this->instrumentation_.on_insert();
+		return this->find_or_create(key_, [&]() { return new Node(key_, makeData()); });
+	}
+
 	// Removes an element from the tree and calls the destructor on its data. 
-	// If the removed element has 2 children, copies the max() in left subtree to the element's place then deletes the original copy.
-	bool remove(const KeyType& key_) {
-		Node* node = this->search(key_);
+	// If the removed element has 2 children, the max() in its left subtree is relinked into its place first,
+	// so no key or data is copied or moved and every other node keeps its address.
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	bool remove(const LookupKeyType& key_) {
+		this->instrumentation_.on_remove();
+		Node* node = this->root_ ? this->search_subtree(to_lookup_key<Compare, KeyType>(key_), this->root_) : nullptr;
 
 		if (node) {
+			if (node->left_ && node->right_) {
+				this->swap_with_predecessor(node);
+			}
 			if (node != this->root_) {
+				const bool isLeftChild = (node->parent_->left_ == node);
+				Node*& parentsCorrectPointer = isLeftChild ? node->parent_->left_ : node->parent_->right_;
 				if (!(node->left_ || node->right_)) {
-					Node*& parentsCorrectPointer = (node->key < node->parent_->key) ? node->parent_->left_ : node->parent_->right_;
 					parentsCorrectPointer = nullptr;
-					delete node;
 				}
-				else  if (!node->left_ != !node->right_) {
-					Node*& parentsCorrectPointer = (node->key < node->parent_->key) ? node->parent_->left_ : node->parent_->right_;
-					if (node->left_) {
-						parentsCorrectPointer = node->left_;
-						node->left_->parent_ = node->parent_;
-						delete node;
-					}
-					else {
-						parentsCorrectPointer = node->right_;
-						node->right_->parent_ = node->parent_;
-						delete node;
-					}
+				else if (node->left_) {
+					parentsCorrectPointer = node->left_;
+					node->left_->parent_ = node->parent_;
 				}
-				else if (node->left_ && node->right_) {
-					Node* replacementNode = find_max_in_subtree(node->left_);
-					Node*& parentsCorrectPointer = (replacementNode->key < replacementNode->parent_->key) ? replacementNode->parent_->left_ : replacementNode->parent_->right_;
-					node->key = std::move(replacementNode->key);
-					node->data = std::move(replacementNode->data);
-					if (replacementNode->left_) {
-						replacementNode->left_->parent_ = replacementNode->parent_;
-						parentsCorrectPointer = replacementNode->left_;
-					}
-					else {
-						parentsCorrectPointer = nullptr;
-					}
-					delete replacementNode;
+				else {
+					parentsCorrectPointer = node->right_;
+					node->right_->parent_ = node->parent_;
 				}
 			}
 			else {
-				if (!(node->left_ || node->right_)) {
-					this->root_ = nullptr;
-					delete node;
-				}
-				else  if (!node->left_ != !node->right_) {
-					if (node->left_) {
-						this->root_ = node->left_;
-						root_->parent_ = nullptr;
-						delete node;
-					}
-					else {
-						this->root_ = node->right_;
-						root_->parent_ = nullptr;
-						delete node;
-					}
-				}
-				else if (node->left_ && node->right_) {
-					Node* replacementNode = find_max_in_subtree(node->left_);
-					Node*& parentsCorrectPointer = (replacementNode->key < replacementNode->parent_->key) ? replacementNode->parent_->left_ : replacementNode->parent_->right_;
-					node->key = std::move(replacementNode->key);
-					node->data = std::move(replacementNode->data);
-					if (replacementNode->left_) {
-						replacementNode->left_->parent_ = replacementNode->parent_;
-						parentsCorrectPointer = replacementNode->left_;
-					}
-					else {
-						parentsCorrectPointer = nullptr;
-					}
-					delete replacementNode;
+				this->root_ = node->left_ ? node->left_ : node->right_;
+				if (this->root_) {
+					this->root_->parent_ = nullptr;
 				}
 			}
+			delete node;
+			this->size_--;
+			this->instrumentation_.on_deallocations(1);
 			return true;
 		}
 		else {
@@ -353,8 +335,15 @@ public:
 			for (Node* node : allNodes) {
 				delete node;
 			}
+			this->instrumentation_.on_deallocations(allNodes.size());
 		}
 		this->root_ = nullptr;
+		this->size_ = 0;
+	}
+
+	// @return Number of elements in the tree. O(1).
+	size_t size() const {
+		return this->size_;
 	}
 
 	Node* min() {
@@ -387,66 +376,191 @@ public:
 		return Iterator(nullptr);
 	}
 
-	binary_search_tree(const binary_search_tree& other) {
+	const Compare& key_comp() const {
+		return this->compare_;
+	}
+	// @return The instrumentation policy the tree reports its work to, see instrumentation.hpp.
+	Instrumentation& instrumentation() const {
+		return this->instrumentation_;
+	}
+
+	// Calls function(node) for every node, visiting the subtrees under the top levels of big trees in parallel on pool.
+	// function is called from several threads at once and in no particular order, it may change the data of the node it's given.
+	// Nodes don't know the sizes of their subtrees, so the work is only split as evenly as the tree is balanced. O(n) work.
+	template<typename Function>
+	void for_each(Function&& function, thread_pool& pool = thread_pool::shared()) {
+		if (this->root_) {
+			for_each_in_subtree(this->root_, function, pool, this->fork_depth(pool));
+		}
+	}
+	// @return reduce(init, transform(first node), ..., transform(last node)) with the nodes in key order, 
+	// where the subtrees under the top levels of big trees are transformed in parallel on pool and reduced as they come back.
+	// Only neighbouring results are reduced with each other, left one first, so reduce has to be associative but not commutative.
+	// transform and reduce are called from several threads at once. O(n) work.
+	template<typename ValueType, typename Reduce, typename Transform>
+	ValueType transform_reduce(ValueType init, Reduce&& reduce, Transform&& transform, thread_pool& pool = thread_pool::shared()) const {
+		std::optional<ValueType> result = transform_reduce_subtree<ValueType>(this->root_, reduce, transform, pool, this->fork_depth(pool));
+		return result ? reduce(std::move(init), std::move(*result)) : init;
+	}
+	// @return Number of nodes predicate(node) is true for, counted in parallel on pool like transform_reduce() does.
+	template<typename Predicate>
+	size_t count_if(Predicate&& predicate, thread_pool& pool = thread_pool::shared()) const {
+		return this->transform_reduce(size_t(0), std::plus<size_t>(),
+									  [&predicate](const Node& node) { return predicate(node) ? size_t(1) : size_t(0); }, pool);
+	}
+
+	// @return Size, height, average depth and memory footprint of the tree. O(n).
+	// Nodes don't know their depths, so they are walked with an explicit stack that degenerate trees can't overflow.
+	tree_stats stats() const {
+		tree_stats stats;
+		stats.size = this->size_;
+		stats.memoryBytes = sizeof(binary_search_tree) + this->size_ * sizeof(Node);
+		if (!this->root_) {
+			return stats;
+		}
+		size_t depthSum = 0;
+		std::vector<std::pair<const Node*, size_t>> pending;
+		pending.emplace_back(this->root_, 1);
+		while (!pending.empty()) {
+			const auto [node, depth] = pending.back();
+			pending.pop_back();
+			depthSum += depth;
+			stats.height = (depth > stats.height) ? depth : stats.height;
+			if (node->right_) {
+				pending.emplace_back(node->right_, depth + 1);
+			}
+			if (node->left_) {
+				pending.emplace_back(node->left_, depth + 1);
+			}
+		}
+		stats.averageDepth = static_cast<double>(depthSum) / static_cast<double>(this->size_);
+		return stats;
+	}
+
+	binary_search_tree(const binary_search_tree& other) requires std::copyable<DataType>
+		: binary_search_tree(other, thread_pool::shared()) {}
+	// Copies other, splitting the copy of a big tree across pool. O(n) work.
+	binary_search_tree(const binary_search_tree& other, thread_pool& pool) requires std::copyable<DataType>
+		: compare_(other.compare_) {
 		this->root_ = nullptr;
 		if (other.root_)
-			clone_subtree(nullptr, this->root_, other.root_);
+			clone_subtree(nullptr, this->root_, other.root_, pool, other.fork_depth(pool));
+		this->size_ = other.size_;
+		this->instrumentation_.on_allocations(this->size_);
 	}
-	binary_search_tree& operator=(const binary_search_tree& other) {
+	binary_search_tree& operator=(const binary_search_tree& other) requires std::copyable<DataType> {
 		this->clear();
+		this->compare_ = other.compare_;
 		if (other.root_)
-			clone_subtree(nullptr, this->root_, other.root_);
+			clone_subtree(nullptr, this->root_, other.root_, thread_pool::shared(), other.fork_depth(thread_pool::shared()));
+		this->size_ = other.size_;
+		this->instrumentation_.on_allocations(this->size_);
 		return *this;
 	}
-	binary_search_tree(binary_search_tree&& other) noexcept {
+	binary_search_tree(binary_search_tree&& other) noexcept 
+		: compare_(other.compare_) {
 		this->root_ = other.root_;
+		this->size_ = other.size_;
 		other.root_ = nullptr;
+		other.size_ = 0;
 	}
 	binary_search_tree& operator=(binary_search_tree&& other) noexcept {
 		this->clear();
+		this->compare_ = other.compare_;
 		this->root_ = other.root_;
+		this->size_ = other.size_;
 		other.root_ = nullptr;
+		other.size_ = 0;
+		return *this;
 	}
 	~binary_search_tree() {
 		this->clear();
 	}
 
+	explicit binary_search_tree(const Compare& compare)
+		: root_(nullptr)
+		, compare_(compare) {}
 	binary_search_tree()
 		: root_(nullptr) {}
 private:
+	// Where a new key goes: under parent, as its left or right child. 
+	// parent is nullptr if the key is already in the tree, match is then the node holding it.
+	struct InsertPosition {
+		Node* parent = nullptr;
+		bool isLeftChild = false;
+		Node* match = nullptr;
+	};
+	// A node clone_subtree() still has to copy, and the link its copy goes in.
+	struct PendingClone {
+		const Node* source;
+		Node* destinationParent;
+		Node** destination;
+	};
+
+	// One call to compare_ per pair of keys, see three_way_compare().
+	template<typename LeftType, typename RightType>
+	std::weak_ordering compare_keys(const LeftType& left, const RightType& right) const {
+		this->instrumentation_.on_comparison();
+		return three_way_compare(this->compare_, left, right);
+	}
+
 	// Tail recursive method that searches a subtree for a suitable parent to attach the passed key to.
 	// Used by insert() and emplace() methods.
-	// @return nullptr if key is already in the tree.
-	static Node* find_parent_for_key_in_subtree(const KeyType& key, Node* node) {
-		if (node->key == key) {
-			return nullptr;
-		}
-		else if (key < node->key) {
+	// @return A position with a nullptr parent if key is already in the tree.
+	InsertPosition find_insert_position_in_subtree(const KeyType& key, Node* node) const {
+		this->instrumentation_.on_visit();
+		const std::weak_ordering order = this->compare_keys(key, node->key);
+		if (order == 0) {
+			return { nullptr, false, node };
+		}
+		else if (order < 0) {
 			if (!node->left_) {
-				return node;
+				return { node, true };
 			}
 			else {
-				return find_parent_for_key_in_subtree(key, node->left_);
+				return this->find_insert_position_in_subtree(key, node->left_);
 			}
 		} 
 		else {
 			if (!node->right_) {
-				return node;
+				return { node, false };
 			}
 			else {
-				return find_parent_for_key_in_subtree(key, node->right_);
+				return this->find_insert_position_in_subtree(key, node->right_);
 			}
 		}
 	}
 
-	// Inserts the node into the tree at the specified parent. 
-	static void insert_node_at(Node* parent, Node* node) {
-		node->parent_ = parent;
-		if (node->key < parent->key) {
-			parent->left_ = node;
+	// Searches for key once, and links in the node makeNode() creates if key is not in the tree.
+	// @return The node with key, and whether it was created.
+	template<typename NodeFactory>
+	std::pair<Node*, bool> find_or_create(const KeyType& key, NodeFactory&& makeNode) {
+		Node* node;
+		if (!this->root_) {
+			node = makeNode();
+			this->root_ = node;
 		}
 		else {
-			parent->right_ = node;
+			InsertPosition position = this->find_insert_position_in_subtree(key, this->root_);
+			if (!position.parent) {
+				return { position.match, false };
+			}
+			node = makeNode();
+			insert_node_at(position, node);
+		}
+		this->size_++;
+		this->instrumentation_.on_allocations(1);
+		return { node, true };
+	}
+
+	// Inserts the node into the tree at the specified position. 
+	static void insert_node_at(InsertPosition position, Node* node) {
+		node->parent_ = position.parent;
+		if (position.isLeftChild) {
+			position.parent->left_ = node;
+		}
+		else {
+			position.parent->right_ = node;
 		}
 	}
 
@@ -464,22 +578,57 @@ private:
 		}
 		return largestNode;
 	}
+	// Trades the tree positions of a node with two children and the max() of its left subtree, which has no right child.
+	// Only links change, the keys and data stay in their nodes. Afterwards node has at most one child. Used by remove().
+	void swap_with_predecessor(Node* node) {
+		Node* const predecessor = find_max_in_subtree(node->left_);
+		Node* const parent = node->parent_;
+		Node* const predecessorLeft = predecessor->left_;
+
+		if (parent) {
+			(parent->left_ == node) ? parent->left_ = predecessor : parent->right_ = predecessor;
+		}
+		else {
+			this->root_ = predecessor;
+		}
+		if (predecessor == node->left_) {
+			predecessor->left_ = node;
+			node->parent_ = predecessor;
+		}
+		else {
+			predecessor->left_ = node->left_;
+			node->left_->parent_ = predecessor;
+			predecessor->parent_->right_ = node;
+			node->parent_ = predecessor->parent_;
+		}
+		predecessor->parent_ = parent;
+		predecessor->right_ = node->right_;
+		node->right_->parent_ = predecessor;
+		node->left_ = predecessorLeft;
+		if (predecessorLeft) {
+			predecessorLeft->parent_ = node;
+		}
+		node->right_ = nullptr;
+	}
 
 	// Tail recursive method that searches a subtree for key.
 	// Used by search() and remove() methods.
 	// @return nullptr if key is not present in the tree.
-	static Node* search_subtree(const KeyType& key, Node* node) {
-		if (key < node->key) {
+	template<typename LookupKeyType>
+	Node* search_subtree(const LookupKeyType& key, Node* node) const {
+		this->instrumentation_.on_visit();
+		const std::weak_ordering order = this->compare_keys(key, node->key);
+		if (order < 0) {
 			if (node->left_) {
-				return search_subtree(key, node->left_);
+				return this->search_subtree(key, node->left_);
 			} 
 			else {
 				return nullptr;
 			}
 		}
-		else if (key > node->key) {
+		else if (order > 0) {
 			if (node->right_) {
-				return search_subtree(key, node->right_);
+				return this->search_subtree(key, node->right_);
 			}
 			else {
 				return nullptr;
@@ -490,17 +639,115 @@ private:
 		}
 	}
 
-	// Recursive method that copies a subtree to destination. 
-	// May overflow the stack if used on trees too big. Too bad.
-	// Used by the copy constructor and the copy assign operator.
-	static void clone_subtree(Node* destinationParent, Node*& destination, Node*& source) {
-		destination = new Node(*source);
+	// Visits a subtree for for_each(). The left subtrees of the top forkDepth levels are visited on pool
+	// while the calling thread visits the node and its right subtree.
+	template<typename Function>
+	static void for_each_in_subtree(Node* node, Function& function, thread_pool& pool, size_t forkDepth) {
+		if (forkDepth == 0 || !node->left_ || !node->right_) {
+			visit_in_order(node, function);
+			return;
+		}
+		pool.fork_join(
+			[&]() { for_each_in_subtree(node->left_, function, pool, forkDepth - 1); },
+			[&]() {
+				function(*node);
+				for_each_in_subtree(node->right_, function, pool, forkDepth - 1);
+			});
+	}
+	// Reduces a subtree in key order for transform_reduce(). Subtrees are split like for_each_in_subtree() splits them.
+	// @return std::nullopt for an empty subtree.
+	template<typename ValueType, typename Reduce, typename Transform>
+	static std::optional<ValueType> transform_reduce_subtree(Node* node, Reduce& reduce, Transform& transform, thread_pool& pool, size_t forkDepth) {
+		if (!node) {
+			return std::nullopt;
+		}
+		if (forkDepth == 0 || !node->left_ || !node->right_) {
+			std::optional<ValueType> result;
+			visit_in_order(node, [&](const Node& visited) {
+				if (result) {
+					result = reduce(std::move(*result), transform(visited));
+				}
+				else {
+					result.emplace(transform(visited));
+				}
+			});
+			return result;
+		}
+		std::optional<ValueType> left;
+		std::optional<ValueType> right;
+		pool.fork_join(
+			[&]() { left = transform_reduce_subtree<ValueType>(node->left_, reduce, transform, pool, forkDepth - 1); },
+			[&]() { right = transform_reduce_subtree<ValueType>(node->right_, reduce, transform, pool, forkDepth - 1); });
+		ValueType result = reduce(std::move(*left), transform(static_cast<const Node&>(*node)));
+		return reduce(std::move(result), std::move(*right));
+	}
+	// Calls function on every node of a subtree in key order, without recursion, keeping the path to the next node on a stack.
+	template<typename Function>
+	static void visit_in_order(Node* node, Function&& function) {
+		std::vector<Node*> path;
+		while (node || !path.empty()) {
+			while (node) {
+				path.push_back(node);
+				node = node->left_;
+			}
+			node = path.back();
+			path.pop_back();
+			function(*node);
+			node = node->right_;
+		}
+	}
+
+	// Copies a subtree to destination. Used by the copy constructor and the copy assign operator.
+	// The left halves of the top forkDepth levels are copied on pool while the calling thread copies the right ones.
+	// Nodes don't know the sizes of their subtrees, so the halves are only as even as the tree is balanced.
+	static void clone_subtree(Node* destinationParent, Node*& destination, const Node* source, thread_pool& pool, size_t forkDepth) {
+		if (forkDepth == 0 || !source->left_ || !source->right_) {
+			clone_subtree(destinationParent, destination, source);
+			return;
+		}
+		Node* const copy = clone_node(destinationParent, destination, source);
+		pool.fork_join(
+			[&]() { clone_subtree(copy, copy->left_, source->left_, pool, forkDepth - 1); },
+			[&]() { clone_subtree(copy, copy->right_, source->right_, pool, forkDepth - 1); });
+	}
+	// Copies a subtree to destination without recursion, in preorder with the children still to be copied kept on a stack.
+	// A degenerate tree is copied just like a balanced one, with no risk of overflowing the call stack.
+	// Every copy is linked to its parent as soon as it's made, so a copy that throws halfway leaves a tree clear() can destroy.
+	static void clone_subtree(Node* destinationParent, Node*& destination, const Node* source) {
+		std::vector<PendingClone> pending;
+		pending.push_back({ source, destinationParent, &destination });
+		while (!pending.empty()) {
+			const PendingClone next = pending.back();
+			pending.pop_back();
+			Node* const copy = clone_node(next.destinationParent, *next.destination, next.source);
+			if (next.source->right_) {
+				pending.push_back({ next.source->right_, copy, &copy->right_ });
+			}
+			if (next.source->left_) {
+				pending.push_back({ next.source->left_, copy, &copy->left_ });
+			}
+		}
+	}
+	// Copies a single node, without its children, to destination.
+	static Node* clone_node(Node* destinationParent, Node*& destination, const Node* source) {
+		destination = new Node(source->key, source->data);
 		destination->parent_ = destinationParent;
-		if (source->left_)
-			clone_subtree(destination, destination->left_, source->left_);
-		if (source->right_)
-			clone_subtree(destination, destination->right_, source->right_);
+		return destination;
 	}
+	// @return How many levels of a copy or a parallel traversal of this tree fork onto pool. Enough for a few tasks per thread, none for small trees.
+	size_t fork_depth(const thread_pool& pool) const {
+		if (this->size_ < parallel_cutoff_) {
+			return 0;
+		}
+		return static_cast<size_t>(std::bit_width(pool.thread_count())) + 2;
+	}
+
+	// Trees smaller than this are copied and traversed on a single thread.
+	static constexpr size_t parallel_cutoff_ = 1 << 14;
 
 	Node* root_;
+	size_t size_ = 0;
+	Compare compare_;
+	// Hooks are called from const members too, counting doesn't change the tree.
+	mutable Instrumentation instrumentation_;
 };
\ No newline at end of file
@@ -0,0 +1,613 @@
+#pragma once
+#include "key_compare.hpp"
+
+#include <concepts>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+#include <stdexcept>
+#include <compare>
+
+
+
+// <<<-------------------------------------------------->>>
+// <<<----------- Class forward declarations ----------->>>
+// <<<-------------------------------------------------->>>
+template<typename KeyType, typename DataType>
+	requires (std::copyable<KeyType> && std::copyable<DataType>)
+class compact_avl_tree_iterator;
+template<typename KeyType, typename DataType>
+	requires (std::copyable<KeyType> && std::copyable<DataType>)
+class compact_avl_tree_node;
+template<typename KeyType, typename DataType, typename Compare = three_way_key_compare>
+	requires (std::copyable<KeyType> && std::copyable<DataType>
+			  && key_comparator_for<Compare, KeyType, KeyType>)
+class compact_avl_tree;
+
+
+
+// An in-order traversal two way iterator.
+// end() iterator is index 0.
+template<typename KeyType, typename DataType>
+	requires (std::copyable<KeyType> && std::copyable<DataType>)
+class compact_avl_tree_iterator {
+	using Iterator = typename compact_avl_tree_iterator;
+	using Node = typename compact_avl_tree_node<KeyType, DataType>;
+public:
+	bool operator==(const Iterator& other) const {
+		return (this->index_ == other.index_);
+	}
+	bool operator!=(const Iterator& other) const {
+		return (this->index_ != other.index_);
+	}
+
+	// Climbs by checking which child of its parent the node is, so a full traversal makes no key comparisons.
+	Iterator& operator++() {
+		if (!this->index_) {
+			return (*this);
+		}
+
+		if (this->at(this->index_).right_) {
+			this->index_ = this->at(this->index_).right_;
+			while (this->at(this->index_).left_) {
+				this->index_ = this->at(this->index_).left_;
+			}
+			return *this;
+		}
+
+		while (this->at(this->index_).parent() && (this->index_ == this->at(this->at(this->index_).parent()).right_)) {
+			this->index_ = this->at(this->index_).parent();
+		}
+		this->index_ = this->at(this->index_).parent();
+		return *this;
+	}
+	Iterator operator++(int) {
+		Iterator temp = *this;
+		++(*this);
+		return temp;
+	}
+
+	Iterator& operator--() {
+		if (!this->index_) {
+			return (*this);
+		}
+
+		if (this->at(this->index_).left_) {
+			this->index_ = this->at(this->index_).left_;
+			while (this->at(this->index_).right_) {
+				this->index_ = this->at(this->index_).right_;
+			}
+			return *this;
+		}
+
+		while (this->at(this->index_).parent() && (this->index_ == this->at(this->at(this->index_).parent()).left_)) {
+			this->index_ = this->at(this->index_).parent();
+		}
+		this->index_ = this->at(this->index_).parent();
+		return *this;
+	}
+	Iterator operator--(int) {
+		Iterator temp = *this;
+		--(*this);
+		return temp;
+	}
+
+	Node* operator->() {
+		return &this->at(this->index_);
+	}
+	Node& operator*() {
+		return this->at(this->index_);
+	}
+
+	compact_avl_tree_iterator(Node* nodes, uint32_t index)
+		: nodes_(nodes)
+		, index_(index) {}
+
+	template<typename TreeKeyType, typename TreeDataType, typename TreeCompare>
+		requires (std::copyable<TreeKeyType> && std::copyable<TreeDataType>
+				  && key_comparator_for<TreeCompare, TreeKeyType, TreeKeyType>)
+	friend class compact_avl_tree;
+private:
+	Node& at(uint32_t index) const {
+		return this->nodes_[index - 1];
+	}
+
+	Node* nodes_;
+	uint32_t index_;
+};
+
+// Holds a key-data pair and 32-bit index links to its parent and children.
+// The balance factor is packed into the top 2 bits of the parent link, so the links of a node take 12 bytes in total.
+template<typename KeyType, typename DataType>
+	requires (std::copyable<KeyType> && std::copyable<DataType>)
+class compact_avl_tree_node {
+	using Node = typename compact_avl_tree_node;
+public:
+	KeyType key;
+	DataType data;
+
+	template <typename... ArgTypes>
+	compact_avl_tree_node(const KeyType& key_, ArgTypes&&... args)
+		: key(key_)
+		, data(DataType(std::forward<ArgTypes>(args)...)) {}
+
+	friend compact_avl_tree_iterator<KeyType, DataType>;
+	template<typename TreeKeyType, typename TreeDataType, typename TreeCompare>
+		requires (std::copyable<TreeKeyType> && std::copyable<TreeDataType>
+				  && key_comparator_for<TreeCompare, TreeKeyType, TreeKeyType>)
+	friend class compact_avl_tree;
+private:
+	static constexpr uint32_t parent_mask_ = (uint32_t(1) << 30) - 1;
+
+	uint32_t parent() const {
+		return this->parentAndBalance_ & parent_mask_;
+	}
+	void set_parent(uint32_t parent) {
+		this->parentAndBalance_ = (this->parentAndBalance_ & ~parent_mask_) | parent;
+	}
+	int balance_factor() const {
+		return static_cast<int>(this->parentAndBalance_ >> 30) - 1;
+	}
+	// Only -1, 0 and 1 fit, rotations are decided before a balance factor of 2 would be stored.
+	void set_balance_factor(int balanceFactor) {
+		this->parentAndBalance_ = (this->parentAndBalance_ & parent_mask_) | (static_cast<uint32_t>(balanceFactor + 1) << 30);
+	}
+
+	uint32_t left_ = 0;
+	uint32_t right_ = 0;
+	// Parent index in the low 30 bits, balance factor + 1 in the top 2 bits.
+	uint32_t parentAndBalance_ = uint32_t(1) << 30;
+};
+
+// An AVL tree with a compact node layout, for trees of small keys and data where pointers would be most of every node.
+// Nodes live in one contiguous array and link to each other with 32-bit indices instead of pointers,
+// and the balance factor is packed into the parent index. An avl_tree<int, int> node is 48 bytes, a compact one is 20.
+// Index 0 is the null link, a node's index is its position in the array + 1.
+// The array is kept dense: remove() moves the last node into the slot it frees, so the tree holds no dead nodes and
+// copying the tree is a single array copy.
+// Compared to avl_tree, subtree sizes aren't stored (no rank() or select()) and the tree holds at most 2^30 - 1 elements.
+// insert() and remove() invalidate iterators and node pointers, like they would for a std::vector.
+// KeyType must be copyable.
+// DataType must be copyable.
+// Compare orders the keys, see key_compare.hpp.
+template<typename KeyType, typename DataType, typename Compare>
+	requires (std::copyable<KeyType> && std::copyable<DataType>
+			  && key_comparator_for<Compare, KeyType, KeyType>)
+class compact_avl_tree {
+	using Iterator = typename compact_avl_tree_iterator<KeyType, DataType>;
+	using Node = typename compact_avl_tree_node<KeyType, DataType>;
+public:
+	// @return nullptr if key is not present in the tree.
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	Node* search(const LookupKeyType& key) {
+		const auto& lookupKey = to_lookup_key<Compare, KeyType>(key);
+		uint32_t node = this->root_;
+		while (node) {
+			const std::weak_ordering order = this->compare_keys(lookupKey, this->at(node).key);
+			if (order < 0) {
+				node = this->at(node).left_;
+			}
+			else if (order > 0) {
+				node = this->at(node).right_;
+			}
+			else {
+				return &this->at(node);
+			}
+		}
+		return nullptr;
+	}
+
+	// Creates a node on the tree. Does a copy operation on the data.
+	// @return false if key is already in tree.
+	bool insert(const KeyType& key_, const DataType& data_) {
+		return this->emplace(key_, data_);
+	}
+	// Creates a node on the tree. Does a move operation on the data.
+	// @return false if key is already in tree.
+	bool insert(const KeyType& key_, DataType&& data_) {
+		return this->emplace(key_, std::move(data_));
+	}
+	// Creates a node on the tree. Constructs the DataType object in place.
+	// @param[...args] args are passed to the DataType constructor.
+	// @return false if key is already in tree.
+	// @throw std::length_error if the tree already holds max_size() elements.
+	template <typename... ArgTypes>
+	bool emplace(const KeyType& key_, ArgTypes&&... args) {
+		uint32_t parent = 0;
+		bool isLeftChild = false;
+		uint32_t node = this->root_;
+		while (node) {
+			const std::weak_ordering order = this->compare_keys(key_, this->at(node).key);
+			if (order == 0) {
+				return false;
+			}
+			parent = node;
+			isLeftChild = (order < 0);
+			node = isLeftChild ? this->at(node).left_ : this->at(node).right_;
+		}
+		if (this->nodes_.size() >= max_size()) {
+			throw std::length_error("compact_avl_tree can't hold more than 2^30 - 1 elements");
+		}
+
+		this->nodes_.emplace_back(key_, std::forward<ArgTypes>(args)...);
+		const uint32_t index = static_cast<uint32_t>(this->nodes_.size());
+		if (!parent) {
+			this->root_ = index;
+			return true;
+		}
+		this->at(index).set_parent(parent);
+		(isLeftChild ? this->at(parent).left_ : this->at(parent).right_) = index;
+		this->balance_parents_after_insert(parent, index);
+		return true;
+	}
+
+	// Removes an element from the tree and calls the destructor on its data.
+	// If the removed element has 2 children, moves the max() in left subtree to the element's place and removes that node instead.
+	// The freed slot is filled with the last node of the array.
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	bool remove(const LookupKeyType& key_) {
+		Node* found = this->search(key_);
+		if (!found) {
+			return false;
+		}
+
+		uint32_t node = static_cast<uint32_t>(found - this->nodes_.data()) + 1;
+		if (found->left_ && found->right_) {
+			const uint32_t replacement = this->find_max_in_subtree(found->left_);
+			found->key = std::move(this->at(replacement).key);
+			found->data = std::move(this->at(replacement).data);
+			node = replacement;
+		}
+
+		const uint32_t parent = this->at(node).parent();
+		const uint32_t child = this->at(node).left_ ? this->at(node).left_ : this->at(node).right_;
+		if (child) {
+			this->at(child).set_parent(parent);
+		}
+		if (parent) {
+			const bool isLeftChild = (this->at(parent).left_ == node);
+			(isLeftChild ? this->at(parent).left_ : this->at(parent).right_) = child;
+			this->balance_parents_after_remove(parent, isLeftChild);
+		}
+		else {
+			this->root_ = child;
+		}
+		this->erase_slot(node);
+		return true;
+	}
+
+	// Removes all elements from the tree. Keeps the capacity of the node array.
+	void clear() {
+		this->nodes_.clear();
+		this->root_ = 0;
+	}
+
+	// Makes sure the next count insertions don't reallocate the node array.
+	void reserve(size_t count) {
+		this->nodes_.reserve(count);
+	}
+	// @return Number of nodes the node array can hold before it reallocates.
+	size_t capacity() const {
+		return this->nodes_.capacity();
+	}
+	void shrink_to_fit() {
+		this->nodes_.shrink_to_fit();
+	}
+
+	Node* min() {
+		return this->root_ ? &this->at(this->find_min_in_subtree(this->root_)) : nullptr;
+	}
+	Node* max() {
+		return this->root_ ? &this->at(this->find_max_in_subtree(this->root_)) : nullptr;
+	}
+
+	// @return Number of elements in the tree. O(1).
+	size_t size() const {
+		return this->nodes_.size();
+	}
+	bool empty() const {
+		return this->nodes_.empty();
+	}
+	// @return Largest number of elements 30-bit parent links can address.
+	static constexpr size_t max_size() {
+		return (size_t(1) << 30) - 1;
+	}
+
+	// @return An in-order traversal iterator pointing at the smallest element of the tree.
+	Iterator begin() {
+		return Iterator(this->nodes_.data(), this->root_ ? this->find_min_in_subtree(this->root_) : 0);
+	}
+	// @return An in-order traversal iterator pointing at index 0.
+	Iterator end() {
+		return Iterator(this->nodes_.data(), 0);
+	}
+
+	const Compare& key_comp() const {
+		return this->compare_;
+	}
+
+	// Links are indices, so the node array is copied as it is.
+	compact_avl_tree(const compact_avl_tree& other)
+		: root_(other.root_)
+		, nodes_(other.nodes_)
+		, compare_(other.compare_) {}
+	compact_avl_tree& operator=(const compact_avl_tree& other) {
+		this->root_ = other.root_;
+		this->nodes_ = other.nodes_;
+		this->compare_ = other.compare_;
+		return *this;
+	}
+	compact_avl_tree(compact_avl_tree&& other) noexcept
+		: root_(other.root_)
+		, nodes_(std::move(other.nodes_))
+		, compare_(other.compare_) {
+		other.clear();
+	}
+	compact_avl_tree& operator=(compact_avl_tree&& other) noexcept {
+		this->root_ = other.root_;
+		this->nodes_ = std::move(other.nodes_);
+		this->compare_ = other.compare_;
+		other.clear();
+		return *this;
+	}
+	~compact_avl_tree() = default;
+
+	explicit compact_avl_tree(const Compare& compare)
+		: root_(0)
+		, compare_(compare) {}
+	compact_avl_tree()
+		: root_(0) {}
+private:
+	// One call to compare_ per pair of keys, see three_way_compare().
+	template<typename LeftType, typename RightType>
+	std::weak_ordering compare_keys(const LeftType& left, const RightType& right) const {
+		return three_way_compare(this->compare_, left, right);
+	}
+
+	Node& at(uint32_t index) {
+		return this->nodes_[index - 1];
+	}
+	// @return The link pointing at child: the left_ or right_ of its parent, or root_ if it has none.
+	uint32_t& link_to(uint32_t child) {
+		const uint32_t parent = this->at(child).parent();
+		if (!parent) {
+			return this->root_;
+		}
+		return (this->at(parent).left_ == child) ? this->at(parent).left_ : this->at(parent).right_;
+	}
+
+	// Rotations point the parent's link (or root_) at the new root of the subtree.
+	// The balance factor of root isn't read, it is 2 or -2 and only known by the caller.
+	bool rotate_left(uint32_t root) {
+		Node& rootNode = this->at(root);
+		const uint32_t pivot = rootNode.right_;
+		Node& pivotNode = this->at(pivot);
+		const bool isHeightReduced = (pivotNode.balance_factor() == -1);
+
+		//rearrange nodes.
+		const uint32_t pivotLeft = pivotNode.left_;
+
+		this->link_to(root) = pivot;
+		pivotNode.set_parent(rootNode.parent());
+
+		pivotNode.left_ = root;
+		rootNode.set_parent(pivot);
+
+		rootNode.right_ = pivotLeft;
+		if (pivotLeft) {
+			this->at(pivotLeft).set_parent(root);
+		}
+
+		//set balance factors.
+		if (pivotNode.balance_factor() == -1) {
+			rootNode.set_balance_factor(0);
+			pivotNode.set_balance_factor(0);
+		}
+		else {
+			rootNode.set_balance_factor(-1);
+			pivotNode.set_balance_factor(1);
+		}
+
+		return isHeightReduced;
+	}
+	bool rotate_right_left(uint32_t root) {
+		Node& rootNode = this->at(root);
+		const uint32_t pivot = rootNode.right_;
+		Node& pivotNode = this->at(pivot);
+		const uint32_t secondary = pivotNode.left_;
+		Node& secondaryNode = this->at(secondary);
+
+		//resassign nodes
+		const uint32_t secondaryLeft = secondaryNode.left_;
+		const uint32_t secondaryRight = secondaryNode.right_;
+
+		this->link_to(root) = secondary;
+		secondaryNode.set_parent(rootNode.parent());
+
+		secondaryNode.left_ = root;
+		rootNode.set_parent(secondary);
+
+		secondaryNode.right_ = pivot;
+		pivotNode.set_parent(secondary);
+
+		rootNode.right_ = secondaryLeft;
+		if (secondaryLeft) {
+			this->at(secondaryLeft).set_parent(root);
+		}
+
+		pivotNode.left_ = secondaryRight;
+		if (secondaryRight) {
+			this->at(secondaryRight).set_parent(pivot);
+		}
+
+		//set balance factors.
+		const int secondaryBalanceFactor = secondaryNode.balance_factor();
+		rootNode.set_balance_factor((secondaryBalanceFactor == -1) ? 1 : 0);
+		pivotNode.set_balance_factor((secondaryBalanceFactor == 1) ? -1 : 0);
+		secondaryNode.set_balance_factor(0);
+
+		return true;
+	}
+	bool rotate_right(uint32_t root) {
+		Node& rootNode = this->at(root);
+		const uint32_t pivot = rootNode.left_;
+		Node& pivotNode = this->at(pivot);
+		const bool isHeightReduced = (pivotNode.balance_factor() == 1);
+
+		//rearrange nodes.
+		const uint32_t pivotRight = pivotNode.right_;
+
+		this->link_to(root) = pivot;
+		pivotNode.set_parent(rootNode.parent());
+
+		pivotNode.right_ = root;
+		rootNode.set_parent(pivot);
+
+		rootNode.left_ = pivotRight;
+		if (pivotRight) {
+			this->at(pivotRight).set_parent(root);
+		}
+
+		//set balance factors.
+		if (pivotNode.balance_factor() == 0) {
+			rootNode.set_balance_factor(1);
+			pivotNode.set_balance_factor(-1);
+		}
+		else {
+			rootNode.set_balance_factor(0);
+			pivotNode.set_balance_factor(0);
+		}
+
+		return isHeightReduced;
+	}
+	bool rotate_left_right(uint32_t root) {
+		Node& rootNode = this->at(root);
+		const uint32_t pivot = rootNode.left_;
+		Node& pivotNode = this->at(pivot);
+		const uint32_t secondary = pivotNode.right_;
+		Node& secondaryNode = this->at(secondary);
+
+		//resassign nodes
+		const uint32_t secondaryLeft = secondaryNode.left_;
+		const uint32_t secondaryRight = secondaryNode.right_;
+
+		this->link_to(root) = secondary;
+		secondaryNode.set_parent(rootNode.parent());
+
+		secondaryNode.right_ = root;
+		rootNode.set_parent(secondary);
+
+		secondaryNode.left_ = pivot;
+		pivotNode.set_parent(secondary);
+
+		pivotNode.right_ = secondaryLeft;
+		if (secondaryLeft) {
+			this->at(secondaryLeft).set_parent(pivot);
+		}
+
+		rootNode.left_ = secondaryRight;
+		if (secondaryRight) {
+			this->at(secondaryRight).set_parent(root);
+		}
+
+		//set balance factors.
+		const int secondaryBalanceFactor = secondaryNode.balance_factor();
+		rootNode.set_balance_factor((secondaryBalanceFactor == 1) ? -1 : 0);
+		pivotNode.set_balance_factor((secondaryBalanceFactor == -1) ? 1 : 0);
+		secondaryNode.set_balance_factor(0);
+
+		return true;
+	}
+	// Decides which rotation to do depending on which side of root is too tall and the balance factor of that child.
+	bool decide_and_do_rotation(uint32_t root, bool isLeftTaller) {
+		if (!isLeftTaller) {
+			if (this->at(this->at(root).right_).balance_factor() == 1) {
+				return this->rotate_right_left(root);
+			}
+			else {
+				return this->rotate_left(root);
+			}
+		}
+		else {
+			if (this->at(this->at(root).left_).balance_factor() == -1) {
+				return this->rotate_left_right(root);
+			}
+			else {
+				return this->rotate_right(root);
+			}
+		}
+	}
+
+	// Tail recursive method that balances all parents of the inserted node.
+	void balance_parents_after_insert(uint32_t parent, uint32_t child) {
+		Node& parentNode = this->at(parent);
+		const int balanceFactor = parentNode.balance_factor() + ((parentNode.left_ == child) ? 1 : -1);
+		if ((balanceFactor == 2) || (balanceFactor == -2)) {
+			this->decide_and_do_rotation(parent, balanceFactor == 2);
+			return;
+		}
+		parentNode.set_balance_factor(balanceFactor);
+		if ((balanceFactor != 0) && parentNode.parent()) {
+			this->balance_parents_after_insert(parentNode.parent(), parent);
+		}
+	}
+	// Tail recursive method that balances all parents of the removed node.
+	// isLeftShorter tells which subtree of parent lost height.
+	void balance_parents_after_remove(uint32_t parent, bool isLeftShorter) {
+		Node& parentNode = this->at(parent);
+		const int balanceFactor = parentNode.balance_factor() + (isLeftShorter ? -1 : 1);
+		if ((balanceFactor == -1) || (balanceFactor == 1)) {
+			parentNode.set_balance_factor(balanceFactor);
+		}
+		else if ((balanceFactor == 2) || (balanceFactor == -2)) {
+			const uint32_t grandParent = parentNode.parent();
+			const bool isParentLeftChild = grandParent && (this->at(grandParent).left_ == parent);
+			if (this->decide_and_do_rotation(parent, balanceFactor == 2) && grandParent) {
+				this->balance_parents_after_remove(grandParent, isParentLeftChild);
+			}
+		}
+		else {
+			parentNode.set_balance_factor(0);
+			const uint32_t grandParent = parentNode.parent();
+			if (grandParent) {
+				this->balance_parents_after_remove(grandParent, this->at(grandParent).left_ == parent);
+			}
+		}
+	}
+
+	// Destructs the node at index, which must already be unlinked from the tree, by moving the last node of the array into its slot.
+	void erase_slot(uint32_t index) {
+		const uint32_t last = static_cast<uint32_t>(this->nodes_.size());
+		if (index != last) {
+			Node& lastNode = this->at(last);
+			this->link_to(last) = index;
+			if (lastNode.left_) {
+				this->at(lastNode.left_).set_parent(index);
+			}
+			if (lastNode.right_) {
+				this->at(lastNode.right_).set_parent(index);
+			}
+			this->at(index) = std::move(lastNode);
+		}
+		this->nodes_.pop_back();
+	}
+
+	uint32_t find_min_in_subtree(uint32_t root) {
+		while (this->at(root).left_) {
+			root = this->at(root).left_;
+		}
+		return root;
+	}
+	uint32_t find_max_in_subtree(uint32_t root) {
+		while (this->at(root).right_) {
+			root = this->at(root).right_;
+		}
+		return root;
+	}
+
+	uint32_t root_;
+	std::vector<Node> nodes_;
+	Compare compare_;
+};
@@ -0,0 +1,421 @@
+#pragma once
+#include "node_allocator.hpp"
+#include "epoch_reclaimer.hpp"
+
+#include <concepts>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+
+
+// <<<-------------------------------------------------->>>
+// <<<----------- Class forward declarations ----------->>>
+// <<<-------------------------------------------------->>>
+template<typename KeyType, typename DataType>
+	requires (std::totally_ordered<KeyType>&& std::copyable<KeyType>
+			  && std::copyable<DataType>)
+class concurrent_avl_tree_node;
+template<typename KeyType, typename DataType, template<typename> typename NodeAllocator = slab_allocator>
+	requires (std::totally_ordered<KeyType>&& std::copyable<KeyType>
+			  && std::copyable<DataType>)
+class concurrent_avl_tree;
+
+
+
+// Holds an immutable key-data pair, the child links readers follow and the version readers validate against.
+template<typename KeyType, typename DataType>
+	requires (std::totally_ordered<KeyType>&& std::copyable<KeyType>
+			  && std::copyable<DataType>)
+class concurrent_avl_tree_node {
+	using Node = typename concurrent_avl_tree_node;
+public:
+	const KeyType key;
+	const DataType data;
+
+	template <typename... ArgTypes>
+	concurrent_avl_tree_node(const KeyType& key_, ArgTypes&&... args)
+		: key(key_)
+		, data(DataType(std::forward<ArgTypes>(args)...)) {}
+
+	template<typename TreeKeyType, typename TreeDataType, template<typename> typename TreeNodeAllocator>
+		requires (std::totally_ordered<TreeKeyType>&& std::copyable<TreeKeyType>
+				  && std::copyable<TreeDataType>)
+	friend class concurrent_avl_tree;
+private:
+	// Even while the node is stable. Odd while a writer removes keys from the subtree of the node,
+	// and odd for good once the node is unlinked from the tree.
+	std::atomic<uint64_t> version_ = 0;
+	std::atomic<Node*> left_ = nullptr;
+	std::atomic<Node*> right_ = nullptr;
+	// Only used by writers.
+	Node* parent_ = nullptr;
+	int_fast8_t balanceFactor_ = 0;
+};
+
+// An AVL tree that can be read and written from many threads at once.
+// Readers never lock and never write to the tree. They walk down the tree optimistically and validate
+// each step against the version of the node they came from, starting over if a writer changed it under them.
+// A writer bumps the version of a node only when keys leave its subtree, which happens to the node that moves down
+// in a rotation and to the nodes a removal takes keys from, so readers only retry when their own path was changed.
+// Writers are serialized with each other. Removed nodes are reclaimed through an epoch_reclaimer once no reader can hold them.
+// Keys and data are immutable once inserted, so readers can copy them without synchronization.
+// KeyType must be copyable and totally_ordered.
+// DataType must be copyable.
+// NodeAllocator is the node allocation policy, see node_allocator.hpp. It is only used by writers.
+template<typename KeyType, typename DataType, template<typename> typename NodeAllocator>
+	requires (std::totally_ordered<KeyType>&& std::copyable<KeyType>
+			  && std::copyable<DataType>)
+class concurrent_avl_tree {
+	using Node = typename concurrent_avl_tree_node<KeyType, DataType>;
+	using Allocator = typename NodeAllocator<Node>;
+	using Reclaimer = typename epoch_reclaimer<Node>;
+public:
+	// Lock-free.
+	// @return true if key is present in the tree.
+	bool contains(const KeyType& key) const {
+		return this->visit(key, [](const DataType& data) {});
+	}
+	// Lock-free.
+	// @return A copy of the data of key, std::nullopt if key is not present in the tree.
+	std::optional<DataType> search(const KeyType& key) const {
+		std::optional<DataType> result;
+		this->visit(key, [&result](const DataType& data) { result.emplace(data); });
+		return result;
+	}
+	// Lock-free. Calls function with the data of key, which stays alive for the duration of the call.
+	// @return false if key is not present in the tree.
+	template<typename Function>
+	bool visit(const KeyType& key, Function&& function) const {
+		typename Reclaimer::guard guard = this->reclaimer_.enter();
+		const Node* node = nullptr;
+		while (!this->try_search(key, node)) {
+			std::this_thread::yield();
+		}
+		if (node) {
+			function(node->data);
+		}
+		return (node != nullptr);
+	}
+
+	// Inserts a key-data pair if key is not present in the tree.
+	// @return false if key was already present.
+	bool insert(const KeyType& key_, const DataType& data_) {
+		return this->emplace(key_, data_);
+	}
+	bool insert(const KeyType& key_, DataType&& data_) {
+		return this->emplace(key_, std::move(data_));
+	}
+	template<typename... ArgTypes>
+	bool emplace(const KeyType& key_, ArgTypes&&... args) {
+		std::lock_guard<std::mutex> lock(this->writerMutex_);
+		Node* parent = nullptr;
+		Node* node = this->root_.load(std::memory_order_relaxed);
+		while (node) {
+			if (key_ == node->key) {
+				return false;
+			}
+			parent = node;
+			node = (key_ < node->key) ? node->left_.load(std::memory_order_relaxed) : node->right_.load(std::memory_order_relaxed);
+		}
+
+		Node* newNode = this->allocator_.create(key_, std::forward<ArgTypes>(args)...);
+		newNode->parent_ = parent;
+		if (!parent) {
+			this->root_.store(newNode, std::memory_order_release);
+		}
+		else {
+			((key_ < parent->key) ? parent->left_ : parent->right_).store(newNode, std::memory_order_release);
+			this->balance_parents_after_insert(parent, newNode);
+		}
+		this->size_.store(this->size_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Removes key from the tree. The node is reclaimed once no reader can reach it anymore.
+	// If the removed node has 2 children, the min() of its right subtree is relinked into its place, so keys never move between nodes.
+	// @return false if key was not present.
+	bool remove(const KeyType& key_) {
+		std::lock_guard<std::mutex> lock(this->writerMutex_);
+		Node* node = this->root_.load(std::memory_order_relaxed);
+		while (node && !(key_ == node->key)) {
+			node = (key_ < node->key) ? node->left_.load(std::memory_order_relaxed) : node->right_.load(std::memory_order_relaxed);
+		}
+		if (!node) {
+			return false;
+		}
+
+		Node* const parent = node->parent_;
+		Node* const left = node->left_.load(std::memory_order_relaxed);
+		Node* const right = node->right_.load(std::memory_order_relaxed);
+		const bool isLeftChild = parent && (parent->left_.load(std::memory_order_relaxed) == node);
+		if (!left || !right) {
+			Node* const child = left ? left : right;
+			begin_change(node);
+			this->replace_child(parent, node, child);
+			if (child) {
+				child->parent_ = parent;
+			}
+			this->balance_parents_after_remove(parent, isLeftChild);
+		}
+		else {
+			Node* replacement = right;
+			while (replacement->left_.load(std::memory_order_relaxed)) {
+				replacement = replacement->left_.load(std::memory_order_relaxed);
+			}
+			Node* const replacementParent = replacement->parent_;
+
+			// The key of replacement leaves the subtrees of every node between it and node.
+			begin_change(node);
+			for (Node* ancestor = replacementParent; ancestor != node; ancestor = ancestor->parent_) {
+				begin_change(ancestor);
+			}
+			if (replacementParent != node) {
+				Node* const replacementRight = replacement->right_.load(std::memory_order_relaxed);
+				replacementParent->left_.store(replacementRight, std::memory_order_release);
+				if (replacementRight) {
+					replacementRight->parent_ = replacementParent;
+				}
+				replacement->right_.store(right, std::memory_order_release);
+				right->parent_ = replacement;
+			}
+			replacement->left_.store(left, std::memory_order_release);
+			left->parent_ = replacement;
+			this->replace_child(parent, node, replacement);
+			replacement->parent_ = parent;
+			replacement->balanceFactor_ = node->balanceFactor_;
+
+			if (replacementParent != node) {
+				for (Node* ancestor = replacementParent; ancestor != replacement; ancestor = ancestor->parent_) {
+					end_change(ancestor);
+				}
+				this->balance_parents_after_remove(replacementParent, true);
+			}
+			else {
+				this->balance_parents_after_remove(replacement, false);
+			}
+		}
+		this->size_.store(this->size_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+		this->reclaimer_.retire(node);
+		return true;
+	}
+
+	// Removes all elements from the tree. Readers already inside the tree finish on the old elements or start over.
+	void clear() {
+		std::lock_guard<std::mutex> lock(this->writerMutex_);
+		Node* root = this->root_.load(std::memory_order_relaxed);
+		if (!root) {
+			return;
+		}
+		this->root_.store(nullptr, std::memory_order_release);
+		std::vector<Node*> stack = { root };
+		while (!stack.empty()) {
+			Node* node = stack.back();
+			stack.pop_back();
+			if (Node* left = node->left_.load(std::memory_order_relaxed)) {
+				stack.push_back(left);
+			}
+			if (Node* right = node->right_.load(std::memory_order_relaxed)) {
+				stack.push_back(right);
+			}
+			begin_change(node);
+			this->reclaimer_.retire(node);
+		}
+		this->size_.store(0, std::memory_order_relaxed);
+	}
+
+	// Only exact while no writer is running.
+	size_t size() const {
+		return this->size_.load(std::memory_order_relaxed);
+	}
+
+	concurrent_avl_tree(const concurrent_avl_tree& other) = delete;
+	concurrent_avl_tree& operator=(const concurrent_avl_tree& other) = delete;
+	// There must be no readers or writers left when the tree is destructed.
+	~concurrent_avl_tree() {
+		Node* root = this->root_.load(std::memory_order_relaxed);
+		if (!root) {
+			return;
+		}
+		std::vector<Node*> stack = { root };
+		while (!stack.empty()) {
+			Node* node = stack.back();
+			stack.pop_back();
+			if (Node* left = node->left_.load(std::memory_order_relaxed)) {
+				stack.push_back(left);
+			}
+			if (Node* right = node->right_.load(std::memory_order_relaxed)) {
+				stack.push_back(right);
+			}
+			this->allocator_.destroy(node);
+		}
+	}
+
+	concurrent_avl_tree()
+		: root_(nullptr) {}
+private:
+	// One optimistic walk from the root.
+	// A node is only entered after its version was read, and the version of its parent and the link to it were found unchanged,
+	// which means key was in the subtree of the node if it was in the tree at all.
+	// The link is checked again because a rotation only marks the node it moves down, not the parent whose link it replaces.
+	// A version read after the rotation ended would pass on its own, though the node has lost the pivot's keys by then.
+	// Sets result to the node holding key, or nullptr if key is not present.
+	// @return false if a writer got in the way and the walk has to start over.
+	bool try_search(const KeyType& key, const Node*& result) const {
+		const Node* node = this->root_.load(std::memory_order_acquire);
+		if (!node) {
+			result = nullptr;
+			return true;
+		}
+		uint64_t version = node->version_.load(std::memory_order_acquire);
+		if ((version & 1) || (this->root_.load(std::memory_order_acquire) != node)) {
+			return false;
+		}
+
+		while (true) {
+			if (key == node->key) {
+				result = node;
+				return true;
+			}
+			const std::atomic<Node*>& link = (key < node->key) ? node->left_ : node->right_;
+			const Node* child = link.load(std::memory_order_acquire);
+			const uint64_t childVersion = child ? child->version_.load(std::memory_order_acquire) : 0;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if ((childVersion & 1) || (link.load(std::memory_order_relaxed) != child) || (node->version_.load(std::memory_order_relaxed) != version)) {
+				return false;
+			}
+			if (!child) {
+				result = nullptr;
+				return true;
+			}
+			node = child;
+			version = childVersion;
+		}
+	}
+
+	// Seqlock style version updates. Readers that saw the version before begin_change() fail their validation,
+	// readers that see it in between start over.
+	static void begin_change(Node* node) {
+		node->version_.store(node->version_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+	static void end_change(Node* node) {
+		node->version_.store(node->version_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	void replace_child(Node* parent, Node* child, Node* replacement) {
+		if (!parent) {
+			this->root_.store(replacement, std::memory_order_release);
+		}
+		else if (parent->left_.load(std::memory_order_relaxed) == child) {
+			parent->left_.store(replacement, std::memory_order_release);
+		}
+		else {
+			parent->right_.store(replacement, std::memory_order_release);
+		}
+	}
+
+	// Rotations publish the new links bottom up so readers never see a subtree without one of its keys,
+	// except under root, which moves down and is marked as changing for the duration.
+	// @return The new root of the rotated subtree.
+	Node* rotate_left(Node* root) {
+		Node* const pivot = root->right_.load(std::memory_order_relaxed);
+		Node* const pivotLeft = pivot->left_.load(std::memory_order_relaxed);
+		Node* const parent = root->parent_;
+
+		begin_change(root);
+		root->right_.store(pivotLeft, std::memory_order_release);
+		if (pivotLeft) {
+			pivotLeft->parent_ = root;
+		}
+		pivot->left_.store(root, std::memory_order_release);
+		root->parent_ = pivot;
+		this->replace_child(parent, root, pivot);
+		pivot->parent_ = parent;
+		end_change(root);
+
+		root->balanceFactor_ = root->balanceFactor_ + 1 - ((pivot->balanceFactor_ < 0) ? pivot->balanceFactor_ : 0);
+		pivot->balanceFactor_ = pivot->balanceFactor_ + 1 + ((root->balanceFactor_ > 0) ? root->balanceFactor_ : 0);
+		return pivot;
+	}
+	Node* rotate_right(Node* root) {
+		Node* const pivot = root->left_.load(std::memory_order_relaxed);
+		Node* const pivotRight = pivot->right_.load(std::memory_order_relaxed);
+		Node* const parent = root->parent_;
+
+		begin_change(root);
+		root->left_.store(pivotRight, std::memory_order_release);
+		if (pivotRight) {
+			pivotRight->parent_ = root;
+		}
+		pivot->right_.store(root, std::memory_order_release);
+		root->parent_ = pivot;
+		this->replace_child(parent, root, pivot);
+		pivot->parent_ = parent;
+		end_change(root);
+
+		root->balanceFactor_ = root->balanceFactor_ - 1 - ((pivot->balanceFactor_ > 0) ? pivot->balanceFactor_ : 0);
+		pivot->balanceFactor_ = pivot->balanceFactor_ - 1 + ((root->balanceFactor_ < 0) ? root->balanceFactor_ : 0);
+		return pivot;
+	}
+	// Double rotations are done as two single rotations, each marking the node it moves down.
+	// @return The new root of the rebalanced subtree.
+	Node* decide_and_do_rotation(Node* root) {
+		if (root->balanceFactor_ == -2) {
+			if (root->right_.load(std::memory_order_relaxed)->balanceFactor_ == 1) {
+				this->rotate_right(root->right_.load(std::memory_order_relaxed));
+			}
+			return this->rotate_left(root);
+		}
+		else {
+			if (root->left_.load(std::memory_order_relaxed)->balanceFactor_ == -1) {
+				this->rotate_left(root->left_.load(std::memory_order_relaxed));
+			}
+			return this->rotate_right(root);
+		}
+	}
+
+	void balance_parents_after_insert(Node* parent, Node* child) {
+		while (parent) {
+			parent->balanceFactor_ += (parent->left_.load(std::memory_order_relaxed) == child) ? 1 : -1;
+			if (parent->balanceFactor_ == 0) {
+				return;
+			}
+			if ((parent->balanceFactor_ == 2) || (parent->balanceFactor_ == -2)) {
+				this->decide_and_do_rotation(parent);
+				return;
+			}
+			child = parent;
+			parent = parent->parent_;
+		}
+	}
+	// isLeftShorter tells which subtree of parent lost height.
+	void balance_parents_after_remove(Node* parent, bool isLeftShorter) {
+		while (parent) {
+			parent->balanceFactor_ += isLeftShorter ? -1 : 1;
+			Node* const grandParent = parent->parent_;
+			const bool isParentLeftChild = grandParent && (grandParent->left_.load(std::memory_order_relaxed) == parent);
+			if ((parent->balanceFactor_ == 1) || (parent->balanceFactor_ == -1)) {
+				return;
+			}
+			if ((parent->balanceFactor_ == 2) || (parent->balanceFactor_ == -2)) {
+				if (this->decide_and_do_rotation(parent)->balanceFactor_ != 0) {
+					return;
+				}
+			}
+			parent = grandParent;
+			isLeftShorter = isParentLeftChild;
+		}
+	}
+
+	std::atomic<Node*> root_;
+	std::atomic<size_t> size_ = 0;
+	std::mutex writerMutex_;
+	Allocator allocator_;
+	mutable Reclaimer reclaimer_{ [this](Node* node) { this->allocator_.destroy(node); } };
+};
@@ -0,0 +1,170 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <functional>
+#include <utility>
+
+
+
+// Epoch based memory reclamation for containers with lock-free readers.
+// Readers hold the guard returned by enter() for as long as they dereference shared objects.
+// Writers retire() objects once they are unreachable, and an object is handed to the deleter
+// only after every guard that could have reached it has been let go.
+// The global epoch moves forward once every reader inside a critical section has seen the current one,
+// so an object retired in epoch e is safe to delete once the global epoch reaches e + 2.
+template<typename ObjectType>
+class epoch_reclaimer {
+	// One per reading thread, on its own cache line so readers never write to a line another reader uses.
+	struct alignas(64) Record {
+		std::atomic<bool> isClaimed = false;
+		// Epoch the owning thread entered in, 0 while it is outside a critical section.
+		std::atomic<uint64_t> epoch = 0;
+		Record* next = nullptr;
+	};
+	struct Retired {
+		ObjectType* object;
+		uint64_t epoch;
+	};
+public:
+	// Keeps every object reachable at the time of enter() alive until it goes out of scope.
+	class guard {
+	public:
+		guard(const guard& other) = delete;
+		guard& operator=(const guard& other) = delete;
+		guard(guard&& other) noexcept
+			: record_(other.record_) {
+			other.record_ = nullptr;
+		}
+		guard& operator=(guard&& other) = delete;
+		~guard() {
+			if (this->record_) {
+				this->record_->epoch.store(0, std::memory_order_release);
+				this->record_->isClaimed.store(false, std::memory_order_release);
+			}
+		}
+	private:
+		explicit guard(Record* record)
+			: record_(record) {}
+
+		Record* record_;
+
+		friend epoch_reclaimer;
+	};
+
+	// Starts a critical section. Lock-free, each thread reuses the record it used last time.
+	guard enter() {
+		Record* record = this->claim_record();
+		uint64_t epoch = this->globalEpoch_.load(std::memory_order_relaxed);
+		while (true) {
+			record->epoch.store(epoch, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const uint64_t currentEpoch = this->globalEpoch_.load(std::memory_order_relaxed);
+			if (currentEpoch == epoch) {
+				return guard(record);
+			}
+			epoch = currentEpoch;
+		}
+	}
+
+	// Hands object to the deleter once no reader can reach it anymore.
+	// object has to be unreachable for readers entering from now on.
+	void retire(ObjectType* object) {
+		std::lock_guard<std::mutex> lock(this->retiredMutex_);
+		this->retired_.push_back({ object, this->globalEpoch_.load(std::memory_order_relaxed) });
+		this->try_advance();
+		this->delete_expired();
+	}
+
+	// Deletes whatever retired objects have become safe to delete since the last retire().
+	void collect() {
+		std::lock_guard<std::mutex> lock(this->retiredMutex_);
+		this->try_advance();
+		this->delete_expired();
+	}
+
+	// @return Number of retired objects still waiting on readers.
+	size_t pending_count() {
+		std::lock_guard<std::mutex> lock(this->retiredMutex_);
+		return this->retired_.size();
+	}
+
+	epoch_reclaimer(const epoch_reclaimer& other) = delete;
+	epoch_reclaimer& operator=(const epoch_reclaimer& other) = delete;
+	// There must be no guards left when the reclaimer is destructed.
+	~epoch_reclaimer() {
+		for (const Retired& retired : this->retired_) {
+			this->deleter_(retired.object);
+		}
+		Record* record = this->records_.load(std::memory_order_acquire);
+		while (record) {
+			Record* next = record->next;
+			delete record;
+			record = next;
+		}
+	}
+
+	explicit epoch_reclaimer(std::function<void(ObjectType*)> deleter)
+		: deleter_(std::move(deleter)) {}
+private:
+	Record* claim_record() {
+		// Records are never freed before the reclaimer, the id makes sure the cached one belongs to this reclaimer.
+		thread_local struct {
+			uint64_t reclaimerId = 0;
+			Record* record = nullptr;
+		} cache;
+		if (cache.reclaimerId == this->id_ && try_claim(cache.record)) {
+			return cache.record;
+		}
+		for (Record* record = this->records_.load(std::memory_order_acquire); record; record = record->next) {
+			if (try_claim(record)) {
+				cache.reclaimerId = this->id_;
+				cache.record = record;
+				return record;
+			}
+		}
+		Record* record = new Record();
+		record->isClaimed.store(true, std::memory_order_relaxed);
+		record->next = this->records_.load(std::memory_order_relaxed);
+		while (!this->records_.compare_exchange_weak(record->next, record, std::memory_order_release, std::memory_order_relaxed)) {}
+		cache.reclaimerId = this->id_;
+		cache.record = record;
+		return record;
+	}
+	static bool try_claim(Record* record) {
+		bool isClaimed = false;
+		return !record->isClaimed.load(std::memory_order_relaxed)
+			&& record->isClaimed.compare_exchange_strong(isClaimed, true, std::memory_order_acquire, std::memory_order_relaxed);
+	}
+
+	// Moves the global epoch forward if every reader in a critical section has entered in the current one.
+	void try_advance() {
+		const uint64_t epoch = this->globalEpoch_.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		for (Record* record = this->records_.load(std::memory_order_acquire); record; record = record->next) {
+			const uint64_t recordEpoch = record->epoch.load(std::memory_order_acquire);
+			if (recordEpoch != 0 && recordEpoch != epoch) {
+				return;
+			}
+		}
+		this->globalEpoch_.store(epoch + 1, std::memory_order_release);
+	}
+	void delete_expired() {
+		const uint64_t epoch = this->globalEpoch_.load(std::memory_order_relaxed);
+		while (!this->retired_.empty() && this->retired_.front().epoch + 2 <= epoch) {
+			this->deleter_(this->retired_.front().object);
+			this->retired_.pop_front();
+		}
+	}
+
+	inline static std::atomic<uint64_t> nextId_ = 1;
+
+	const uint64_t id_ = nextId_.fetch_add(1, std::memory_order_relaxed);
+	std::atomic<uint64_t> globalEpoch_ = 1;
+	std::atomic<Record*> records_ = nullptr;
+	std::mutex retiredMutex_;
+	std::deque<Retired> retired_;
+	std::function<void(ObjectType*)> deleter_;
+};
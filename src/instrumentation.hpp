@@ -0,0 +1,174 @@
+#pragma once
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <initializer_list>
+
+
+
+// Instrumentation policies for the tree containers, see avl_tree and binary_search_tree.
+// The trees call a policy's hooks where they do the work the hooks are named after:
+// - on_lookup(), on_insert() and on_remove() once per operation, so the other counts can be divided by them.
+//   Every descent from the root a query does is a lookup, equal_range() and count() do two.
+// - on_comparison() once per call to the key comparator.
+// - on_visit() once per node a lookup, insert or remove steps onto while searching for a key.
+// - on_rotation(kind) once per rotation, a double rotation counting as one of its own kind.
+// - on_rebalance_step() once per ancestor whose balance is updated on the way back up from an insert, remove or join.
+// - on_allocations(count) and on_deallocations(count) for the nodes created and destroyed.
+// The default no_instrumentation does nothing, so a tree that doesn't opt in compiles to the same code as before.
+
+// The rotations a balanced tree does, named after the direction(s) the subtree root moves in.
+enum class tree_rotation {
+	left,
+	right,
+	left_right,
+	right_left
+};
+
+template<typename Instrumentation>
+concept tree_instrumentation = requires(Instrumentation& instrumentation, tree_rotation rotation, size_t count) {
+	instrumentation.on_lookup();
+	instrumentation.on_insert();
+	instrumentation.on_remove();
+	instrumentation.on_comparison();
+	instrumentation.on_visit();
+	instrumentation.on_rotation(rotation);
+	instrumentation.on_rebalance_step();
+	instrumentation.on_allocations(count);
+	instrumentation.on_deallocations(count);
+};
+
+// Default instrumentation of the tree containers. Every hook is empty and inlines away.
+struct no_instrumentation {
+	void on_lookup() {}
+	void on_insert() {}
+	void on_remove() {}
+	void on_comparison() {}
+	void on_visit() {}
+	void on_rotation(tree_rotation rotation) {}
+	void on_rebalance_step() {}
+	void on_allocations(size_t count) {}
+	void on_deallocations(size_t count) {}
+};
+
+// A snapshot of the counters of counting_instrumentation.
+struct tree_operation_counts {
+	uint64_t lookups = 0;
+	uint64_t inserts = 0;
+	uint64_t removes = 0;
+	uint64_t comparisons = 0;
+	uint64_t nodesVisited = 0;
+	uint64_t leftRotations = 0;
+	uint64_t rightRotations = 0;
+	uint64_t leftRightRotations = 0;
+	uint64_t rightLeftRotations = 0;
+	uint64_t rebalanceSteps = 0;
+	uint64_t allocations = 0;
+	uint64_t deallocations = 0;
+
+	uint64_t rotations() const {
+		return this->leftRotations + this->rightRotations + this->leftRightRotations + this->rightLeftRotations;
+	}
+	// @return Number of operations the other counts are spread over.
+	uint64_t operations() const {
+		return this->lookups + this->inserts + this->removes;
+	}
+};
+
+// Counts every hook call with relaxed atomic increments.
+// Parallel set operations and copies count from many threads at once, and counts() can be scraped from any thread while the tree is in use.
+// A snapshot taken during an operation may be partway through it, the counters aren't updated together.
+// The counters belong to the tree object, a tree that is copied or moved into starts its own count from zero.
+class counting_instrumentation {
+public:
+	void on_lookup() {
+		increment(this->lookups_);
+	}
+	void on_insert() {
+		increment(this->inserts_);
+	}
+	void on_remove() {
+		increment(this->removes_);
+	}
+	void on_comparison() {
+		increment(this->comparisons_);
+	}
+	void on_visit() {
+		increment(this->nodesVisited_);
+	}
+	void on_rotation(tree_rotation rotation) {
+		switch (rotation) {
+			case tree_rotation::left: increment(this->leftRotations_); break;
+			case tree_rotation::right: increment(this->rightRotations_); break;
+			case tree_rotation::left_right: increment(this->leftRightRotations_); break;
+			case tree_rotation::right_left: increment(this->rightLeftRotations_); break;
+		}
+	}
+	void on_rebalance_step() {
+		increment(this->rebalanceSteps_);
+	}
+	void on_allocations(size_t count) {
+		this->allocations_.fetch_add(count, std::memory_order_relaxed);
+	}
+	void on_deallocations(size_t count) {
+		this->deallocations_.fetch_add(count, std::memory_order_relaxed);
+	}
+
+	tree_operation_counts counts() const {
+		tree_operation_counts counts;
+		counts.lookups = this->lookups_.load(std::memory_order_relaxed);
+		counts.inserts = this->inserts_.load(std::memory_order_relaxed);
+		counts.removes = this->removes_.load(std::memory_order_relaxed);
+		counts.comparisons = this->comparisons_.load(std::memory_order_relaxed);
+		counts.nodesVisited = this->nodesVisited_.load(std::memory_order_relaxed);
+		counts.leftRotations = this->leftRotations_.load(std::memory_order_relaxed);
+		counts.rightRotations = this->rightRotations_.load(std::memory_order_relaxed);
+		counts.leftRightRotations = this->leftRightRotations_.load(std::memory_order_relaxed);
+		counts.rightLeftRotations = this->rightLeftRotations_.load(std::memory_order_relaxed);
+		counts.rebalanceSteps = this->rebalanceSteps_.load(std::memory_order_relaxed);
+		counts.allocations = this->allocations_.load(std::memory_order_relaxed);
+		counts.deallocations = this->deallocations_.load(std::memory_order_relaxed);
+		return counts;
+	}
+	// Sets every counter back to zero.
+	void reset() {
+		for (std::atomic<uint64_t>* counter : { &this->lookups_, &this->inserts_, &this->removes_, &this->comparisons_, &this->nodesVisited_,
+												&this->leftRotations_, &this->rightRotations_, &this->leftRightRotations_, &this->rightLeftRotations_,
+												&this->rebalanceSteps_, &this->allocations_, &this->deallocations_ }) {
+			counter->store(0, std::memory_order_relaxed);
+		}
+	}
+
+	counting_instrumentation(const counting_instrumentation& other) = delete;
+	counting_instrumentation& operator=(const counting_instrumentation& other) = delete;
+
+	counting_instrumentation() = default;
+private:
+	static void increment(std::atomic<uint64_t>& counter) {
+		counter.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	std::atomic<uint64_t> lookups_ = 0;
+	std::atomic<uint64_t> inserts_ = 0;
+	std::atomic<uint64_t> removes_ = 0;
+	std::atomic<uint64_t> comparisons_ = 0;
+	std::atomic<uint64_t> nodesVisited_ = 0;
+	std::atomic<uint64_t> leftRotations_ = 0;
+	std::atomic<uint64_t> rightRotations_ = 0;
+	std::atomic<uint64_t> leftRightRotations_ = 0;
+	std::atomic<uint64_t> rightLeftRotations_ = 0;
+	std::atomic<uint64_t> rebalanceSteps_ = 0;
+	std::atomic<uint64_t> allocations_ = 0;
+	std::atomic<uint64_t> deallocations_ = 0;
+};
+
+// The shape of a tree, see avl_tree::stats() and binary_search_tree::stats().
+// Depths count nodes, the root is at depth 1 and height is the depth of the deepest node.
+// memoryBytes is the tree object plus the nodes (and out of line data) it holds, not counting what its allocator keeps in reserve.
+struct tree_stats {
+	size_t size = 0;
+	size_t height = 0;
+	double averageDepth = 0;
+	size_t memoryBytes = 0;
+};
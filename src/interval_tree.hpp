@@ -0,0 +1,306 @@
+#pragma once
+#include "avl_tree.hpp"
+#include "key_compare.hpp"
+
+#include <concepts>
+#include <utility>
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <compare>
+
+
+
+// <<<-------------------------------------------------->>>
+// <<<----------- Class forward declarations ----------->>>
+// <<<-------------------------------------------------->>>
+template<typename PointType>
+	requires (std::copyable<PointType> && std::totally_ordered<PointType>)
+struct interval;
+template<typename PointType>
+	requires (std::copyable<PointType> && std::totally_ordered<PointType>)
+struct interval_tree_augmentation;
+template<typename PointType, typename DataType>
+	requires (std::copyable<PointType> && std::totally_ordered<PointType> && std::movable<DataType>)
+class interval_tree_iterator;
+template<typename PointType, typename DataType>
+	requires (std::copyable<PointType> && std::totally_ordered<PointType> && std::movable<DataType>)
+class interval_tree_range;
+template<typename PointType, typename DataType, template<typename> typename NodeAllocator = slab_allocator>
+	requires (std::copyable<PointType> && std::totally_ordered<PointType> && std::movable<DataType>)
+class interval_tree;
+
+
+
+// A closed interval [low, high].
+// Ordered by low, then by high, which is the order an interval_tree keeps its intervals in.
+template<typename PointType>
+	requires (std::copyable<PointType> && std::totally_ordered<PointType>)
+struct interval {
+	PointType low;
+	PointType high;
+
+	// @return true if the interval and [otherLow, otherHigh] have at least one point in common.
+	bool overlaps(const PointType& otherLow, const PointType& otherHigh) const {
+		return !(otherHigh < this->low) && !(this->high < otherLow);
+	}
+
+	friend bool operator==(const interval& left, const interval& right) {
+		return (left.low == right.low) && (left.high == right.high);
+	}
+	friend std::weak_ordering operator<=>(const interval& left, const interval& right) {
+		const std::weak_ordering order = three_way_compare(three_way_key_compare(), left.low, right.low);
+		return (order != 0) ? order : three_way_compare(three_way_key_compare(), left.high, right.high);
+	}
+};
+
+// Keeps the biggest high of every subtree, so queries can skip subtrees that end before the queried interval starts.
+// std::nullopt is the biggest high of no intervals.
+template<typename PointType>
+	requires (std::copyable<PointType> && std::totally_ordered<PointType>)
+struct interval_tree_augmentation {
+	using summary_type = std::optional<PointType>;
+
+	static summary_type identity() {
+		return std::nullopt;
+	}
+	template<typename DataType>
+	static summary_type summarize(const interval<PointType>& key, const DataType& data) {
+		return key.high;
+	}
+	static summary_type combine(const summary_type& left, const summary_type& right) {
+		if (!left || (right && *left < *right)) {
+			return right;
+		}
+		return left;
+	}
+};
+
+// A forward iterator over the intervals overlapping a query interval, in the order of the tree.
+// Each increment walks on from the current node in order, skipping every subtree whose biggest high is smaller than the query's low,
+// and stops for good at the first interval whose low is bigger than the query's high.
+// end() iterator is nullptr.
+template<typename PointType, typename DataType>
+	requires (std::copyable<PointType> && std::totally_ordered<PointType> && std::movable<DataType>)
+class interval_tree_iterator {
+	using Iterator = typename interval_tree_iterator;
+	using Node = typename avl_tree_node<interval<PointType>, DataType, avl_tree_cold_data<DataType>::value, interval_tree_augmentation<PointType>>;
+public:
+	bool operator==(const Iterator& other) const {
+		return (this->ptr_ == other.ptr_);
+	}
+	bool operator!=(const Iterator& other) const {
+		return (this->ptr_ != other.ptr_);
+	}
+
+	// Climbs by checking which child of its parent the node is. Subtrees to the right of the path are searched with first_overlap().
+	Iterator& operator++() {
+		if (!this->ptr_) {
+			return *this;
+		}
+		Node* node = this->ptr_;
+		this->ptr_ = this->first_overlap(node->right_);
+		while (!this->ptr_ && node->parent_) {
+			Node* const parent = node->parent_;
+			if (parent->left_ == node) {
+				if (this->query_->high < parent->key.low) {
+					return *this;
+				}
+				if (!(parent->key.high < this->query_->low)) {
+					this->ptr_ = parent;
+					return *this;
+				}
+				this->ptr_ = this->first_overlap(parent->right_);
+			}
+			node = parent;
+		}
+		return *this;
+	}
+	Iterator operator++(int) {
+		Iterator temp = *this;
+		++(*this);
+		return temp;
+	}
+
+	Node* operator->() {
+		return this->ptr_;
+	}
+	Node& operator*() {
+		return *(this->ptr_);
+	}
+
+	using iterator_category = std::forward_iterator_tag;
+	using value_type = Node;
+	using difference_type = std::ptrdiff_t;
+	using pointer = Node*;
+	using reference = Node&;
+
+	interval_tree_iterator()
+		: ptr_(nullptr) {}
+
+	template<typename TreePointType, typename TreeDataType, template<typename> typename TreeNodeAllocator>
+		requires (std::copyable<TreePointType> && std::totally_ordered<TreePointType> && std::movable<TreeDataType>)
+	friend class interval_tree;
+private:
+	// Starts at the first interval in root's subtree that overlaps [low, high].
+	interval_tree_iterator(Node* root, const PointType& low, const PointType& high)
+		: query_(interval<PointType>{ low, high }) {
+		this->ptr_ = this->first_overlap(root);
+	}
+
+	// @return true if some interval in node's subtree ends at or after the query's low.
+	bool reaches_low(const Node* node) const {
+		return node && !(*node->summary_ < this->query_->low);
+	}
+	// @return The first interval in node's subtree, in order, that overlaps the query. nullptr if there is none.
+	// A left subtree that reaches the query's low under a node starting at or before its high is sure to hold an overlap, so it is never backed out of.
+	Node* first_overlap(Node* node) const {
+		if (!this->reaches_low(node)) {
+			return nullptr;
+		}
+		while (true) {
+			if (this->reaches_low(node->left_)) {
+				node = node->left_;
+			}
+			else if (this->query_->high < node->key.low) {
+				return nullptr;
+			}
+			else if (!(node->key.high < this->query_->low)) {
+				return node;
+			}
+			else if (this->reaches_low(node->right_)) {
+				node = node->right_;
+			}
+			else {
+				return nullptr;
+			}
+		}
+	}
+
+	Node* ptr_;
+	// The queried interval. Empty in end() iterators, so PointType doesn't need a default constructor.
+	std::optional<interval<PointType>> query_;
+};
+
+// The intervals overlapping a query interval, see interval_tree::overlapping().
+// Nothing is collected up front, each interval is found as the range is iterated.
+template<typename PointType, typename DataType>
+	requires (std::copyable<PointType> && std::totally_ordered<PointType> && std::movable<DataType>)
+class interval_tree_range {
+	using Iterator = typename interval_tree_iterator<PointType, DataType>;
+public:
+	Iterator begin() const {
+		return this->begin_;
+	}
+	Iterator end() const {
+		return Iterator();
+	}
+	bool empty() const {
+		return (this->begin_ == Iterator());
+	}
+
+	explicit interval_tree_range(Iterator begin)
+		: begin_(begin) {}
+private:
+	Iterator begin_;
+};
+
+// An interval tree for finding the intervals that overlap a point or another interval.
+// It is an avl_tree keyed by interval, ordered by low then high, and augmented with the biggest high of every subtree.
+// The augmentation is kept up to date by the AVL tree through its rotations, inserts and removes.
+// Every interval is stored once, inserting an interval that is already in the tree fails even if its data differs.
+// Intervals are closed, an interval with low == high holds a single point.
+// PointType must be copyable and totally ordered.
+// DataType must be movable. Copying the tree needs it to be copyable.
+// NodeAllocator is the node allocation policy, see node_allocator.hpp.
+template<typename PointType, typename DataType, template<typename> typename NodeAllocator>
+	requires (std::copyable<PointType> && std::totally_ordered<PointType> && std::movable<DataType>)
+class interval_tree {
+	using Interval = interval<PointType>;
+	using Tree = typename avl_tree<Interval, DataType, NodeAllocator, three_way_key_compare, interval_tree_augmentation<PointType>>;
+	using Node = typename avl_tree_node<Interval, DataType, avl_tree_cold_data<DataType>::value, interval_tree_augmentation<PointType>>;
+	using OverlapIterator = typename interval_tree_iterator<PointType, DataType>;
+	using OverlapRange = typename interval_tree_range<PointType, DataType>;
+public:
+	// @return The intervals that have at least one point in common with [low, high], ordered by low then high.
+	// Empty if high < low. Finding the first one is O(logn), and so is every increment at worst.
+	// Reporting k intervals visits the O(logn) nodes on the paths to low and high and the nodes on the paths to the k intervals,
+	// which is O(logn + k*log(n/k)) in total and never more than O(n).
+	OverlapRange overlapping(const PointType& low, const PointType& high) {
+		if (high < low) {
+			return OverlapRange(OverlapIterator());
+		}
+		return OverlapRange(OverlapIterator(this->tree_.root_, low, high));
+	}
+	// @return The intervals that contain point. Same as overlapping(point, point).
+	OverlapRange stabbing(const PointType& point) {
+		return this->overlapping(point, point);
+	}
+
+	// @return nullptr if the interval is not in the tree.
+	Node* search(const Interval& key) {
+		return this->tree_.search(key);
+	}
+
+	// Adds an interval to the tree. Does a copy operation on the data.
+	// @return false if the interval is already in the tree.
+	// @exception std::invalid_argument if key.high < key.low.
+	bool insert(const Interval& key, const DataType& data) {
+		check_interval(key);
+		return this->tree_.insert(key, data);
+	}
+	// Adds an interval to the tree. Does a move operation on the data.
+	// @return false if the interval is already in the tree.
+	// @exception std::invalid_argument if key.high < key.low.
+	bool insert(const Interval& key, DataType&& data) {
+		check_interval(key);
+		return this->tree_.insert(key, std::move(data));
+	}
+	// Adds an interval to the tree. Constructs the DataType object in place.
+	// @param[...args] args are passed to the DataType constructor.
+	// @return false if the interval is already in the tree.
+	// @exception std::invalid_argument if key.high < key.low.
+	template <typename... ArgTypes>
+	bool emplace(const Interval& key, ArgTypes&&... args) {
+		check_interval(key);
+		return this->tree_.emplace(key, std::forward<ArgTypes>(args)...);
+	}
+
+	// Removes an interval from the tree and calls the destructor on its data.
+	// @return false if the interval is not in the tree.
+	bool remove(const Interval& key) {
+		return this->tree_.remove(key);
+	}
+
+	// Removes all intervals from the tree.
+	void clear() {
+		this->tree_.clear();
+	}
+
+	// @return Number of intervals in the tree. O(1).
+	size_t size() const {
+		return this->tree_.size();
+	}
+	bool empty() const {
+		return (this->tree_.size() == 0);
+	}
+
+	// @return An in-order traversal iterator over every interval, pointing at the one with the smallest low.
+	auto begin() {
+		return this->tree_.begin();
+	}
+	auto end() {
+		return this->tree_.end();
+	}
+
+	interval_tree() = default;
+private:
+	static void check_interval(const Interval& key) {
+		if (key.high < key.low) {
+			throw std::invalid_argument("Interval ends before it starts.");
+		}
+	}
+
+	Tree tree_;
+};
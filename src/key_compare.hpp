@@ -0,0 +1,104 @@
+#pragma once
+#include <compare>
+#include <concepts>
+#include <type_traits>
+#include <limits>
+#include <utility>
+
+
+
+// Key comparison for the tree containers.
+// A comparator is either three-way, returning something comparable with 0 like std::compare_three_way does,
+// or less-than, returning bool like std::less does. Trees turn either into a std::weak_ordering with three_way_compare(),
+// so every node on a search path costs one comparison instead of separate <, > and == tests.
+// A comparator with an is_transparent member type takes lookup keys of other types as they are, without converting them to the key type.
+
+// Integers of the types std::cmp_less takes, which are all integral types but bool and the character types.
+template<typename Type>
+concept value_comparable_integer = std::integral<Type> && !std::same_as<Type, bool> && !std::same_as<Type, char> && !std::same_as<Type, wchar_t>
+								   && !std::same_as<Type, char8_t> && !std::same_as<Type, char16_t> && !std::same_as<Type, char32_t>;
+
+// Integers of two different types. Compared as they are they would go through the usual arithmetic conversions,
+// so -1 would compare bigger than 3u, and a 64-bit key would be truncated to a 32-bit one.
+template<typename LeftType, typename RightType>
+concept mixed_integers = value_comparable_integer<LeftType> && value_comparable_integer<RightType> && !std::same_as<LeftType, RightType>;
+
+// Default comparator of the tree containers. Transparent.
+// Integers of different types are compared by value with std::cmp_less and std::cmp_equal.
+// Otherwise uses <=> if the compared types have it, and builds the ordering out of < if they don't.
+struct three_way_key_compare {
+	using is_transparent = void;
+
+	template<typename LeftType, typename RightType>
+		requires (mixed_integers<LeftType, RightType> || std::three_way_comparable_with<LeftType, RightType> || std::totally_ordered_with<LeftType, RightType>)
+	constexpr auto operator()(const LeftType& left, const RightType& right) const {
+		if constexpr (mixed_integers<LeftType, RightType>) {
+			return std::cmp_less(left, right) ? std::strong_ordering::less : (std::cmp_equal(left, right) ? std::strong_ordering::equal : std::strong_ordering::greater);
+		}
+		else if constexpr (std::three_way_comparable_with<LeftType, RightType>) {
+			return left <=> right;
+		}
+		else {
+			return (left < right) ? std::weak_ordering::less : ((right < left) ? std::weak_ordering::greater : std::weak_ordering::equivalent);
+		}
+	}
+};
+
+template<typename Compare, typename LeftType, typename RightType>
+concept key_comparator_for = std::invocable<const Compare&, const LeftType&, const RightType&>
+							 && std::invocable<const Compare&, const RightType&, const LeftType&>;
+
+// Arithmetic lookup keys of another type than the key, like a size_t or a double looked up in a tree of int keys.
+template<typename LookupKeyType, typename KeyType>
+concept mismatched_arithmetic_key = std::is_arithmetic_v<LookupKeyType> && std::is_arithmetic_v<KeyType> && !std::same_as<LookupKeyType, KeyType>;
+
+// Arithmetic lookup keys KeyType can hold every value of, like an int looked up in a tree of int64_t or double keys.
+template<typename LookupKeyType, typename KeyType>
+concept losslessly_convertible_key = mismatched_arithmetic_key<LookupKeyType, KeyType>
+									 && (std::is_integral_v<LookupKeyType> || std::is_floating_point_v<KeyType>)
+									 && (std::numeric_limits<LookupKeyType>::digits <= std::numeric_limits<KeyType>::digits)
+									 && (std::is_signed_v<KeyType> || !std::is_signed_v<LookupKeyType>)
+									 && (std::is_integral_v<LookupKeyType> || (std::numeric_limits<LookupKeyType>::max_exponent <= std::numeric_limits<KeyType>::max_exponent));
+
+// Lookup keys of a type Compare can take as they are.
+// Of mismatched arithmetic keys, only integers compared by three_way_key_compare are, other comparators would apply the usual arithmetic conversions.
+// They are ruled out before Compare is asked, so a comparator deducing its result type isn't instantiated for them.
+template<typename LookupKeyType, typename Compare, typename KeyType>
+concept transparent_lookup_key_for = std::same_as<LookupKeyType, KeyType>
+									 || (std::same_as<Compare, three_way_key_compare> && mixed_integers<LookupKeyType, KeyType>)
+									 || (requires { typename Compare::is_transparent; } && !mismatched_arithmetic_key<LookupKeyType, KeyType>
+										 && key_comparator_for<Compare, KeyType, LookupKeyType>);
+
+// Lookup keys the tree containers accept. Ones Compare can't take as they are get converted to KeyType once per lookup.
+// Mismatched arithmetic keys are only converted if the conversion keeps their value. Others, like 3.5 looked up in a tree of int keys
+// or -1 in a tree of unsigned keys under a comparator that isn't transparent, don't compile instead of finding the key they would be converted to.
+template<typename LookupKeyType, typename Compare, typename KeyType>
+concept lookup_key_for = transparent_lookup_key_for<LookupKeyType, Compare, KeyType>
+						 || (std::convertible_to<const LookupKeyType&, KeyType>
+							 && (!mismatched_arithmetic_key<LookupKeyType, KeyType> || losslessly_convertible_key<LookupKeyType, KeyType>));
+
+// @return left compared to right by compare. Less-than comparators are called a second time if the first call returns false.
+template<typename Compare, typename LeftType, typename RightType>
+constexpr std::weak_ordering three_way_compare(const Compare& compare, const LeftType& left, const RightType& right) {
+	if constexpr (std::same_as<std::invoke_result_t<const Compare&, const LeftType&, const RightType&>, bool>) {
+		if (compare(left, right)) {
+			return std::weak_ordering::less;
+		}
+		return compare(right, left) ? std::weak_ordering::greater : std::weak_ordering::equivalent;
+	}
+	else {
+		const auto order = compare(left, right);
+		return (order < 0) ? std::weak_ordering::less : ((order > 0) ? std::weak_ordering::greater : std::weak_ordering::equivalent);
+	}
+}
+
+// @return key as it is if Compare can take it, key converted to KeyType otherwise.
+template<typename Compare, typename KeyType, typename LookupKeyType>
+constexpr decltype(auto) to_lookup_key(const LookupKeyType& key) {
+	if constexpr (transparent_lookup_key_for<LookupKeyType, Compare, KeyType>) {
+		return (key);
+	}
+	else {
+		return KeyType(key);
+	}
+}
@@ -0,0 +1,235 @@
+#pragma once
+#include "key_compare.hpp"
+#include "mapped_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+#include <compare>
+
+
+
+// <<<-------------------------------------------------->>>
+// <<<----------- Class forward declarations ----------->>>
+// <<<-------------------------------------------------->>>
+template<typename KeyType, typename DataType>
+	requires (std::is_trivially_copyable_v<KeyType> && std::is_trivially_copyable_v<DataType>)
+class mapped_avl_tree_node;
+template<typename KeyType, typename DataType, typename Compare = three_way_key_compare>
+	requires (std::is_trivially_copyable_v<KeyType> && std::is_trivially_copyable_v<DataType>
+			  && key_comparator_for<Compare, KeyType, KeyType>)
+class mapped_avl_tree;
+
+
+
+// Start of a tree image written by avl_tree::save().
+// The header is followed by size mapped_avl_tree_node records in key order, so a node's index is also its rank.
+// Nodes link to their children by index, which makes the image independent of where it is loaded.
+// Images are only read back on machines with the same byte order and the same key and data layouts, the header records both.
+struct alignas(64) avl_tree_image_header {
+	static constexpr char format_magic[8] = { 'A', 'V', 'L', 'I', 'M', 'A', 'G', 'E' };
+	static constexpr uint32_t format_version = 1;
+	static constexpr uint32_t byte_order_mark = 0x01020304;
+	// Index of a missing child, or of the root of an empty tree.
+	static constexpr uint32_t null_index = UINT32_MAX;
+
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t keySize;
+	uint32_t dataSize;
+	uint32_t nodeSize;
+	uint32_t nodeAlignment;
+	uint64_t size;
+	uint32_t root;
+};
+
+// A key-data pair of a tree image and the indices of its children.
+template<typename KeyType, typename DataType>
+	requires (std::is_trivially_copyable_v<KeyType> && std::is_trivially_copyable_v<DataType>)
+class mapped_avl_tree_node {
+public:
+	KeyType key;
+	DataType data;
+
+	// Used by avl_tree::save() to lay out the records.
+	mapped_avl_tree_node(const KeyType& key_, const DataType& data_, uint32_t left, uint32_t right)
+		: key(key_)
+		, data(data_)
+		, left_(left)
+		, right_(right) {}
+
+	template<typename TreeKeyType, typename TreeDataType, typename TreeCompare>
+		requires (std::is_trivially_copyable_v<TreeKeyType> && std::is_trivially_copyable_v<TreeDataType>
+				  && key_comparator_for<TreeCompare, TreeKeyType, TreeKeyType>)
+	friend class mapped_avl_tree;
+private:
+	uint32_t left_;
+	uint32_t right_;
+};
+
+// A read-only tree served straight from an image file mapped into memory, see avl_tree::save().
+// Opening one maps the file and checks the header, nothing is allocated or read per node.
+// Lookups check every child link they follow, so a corrupt image throws instead of being read out of bounds.
+// Startup cost is the page faults of the first lookups, not the O(nlogn) of inserting every element.
+// Nodes are stored in key order, so iterators are plain pointers and iterating is a sequential scan.
+// The image has to have been written by a tree with the same Compare, the order of the nodes isn't checked.
+// KeyType and DataType must be trivially copyable.
+template<typename KeyType, typename DataType, typename Compare>
+	requires (std::is_trivially_copyable_v<KeyType> && std::is_trivially_copyable_v<DataType>
+			  && key_comparator_for<Compare, KeyType, KeyType>)
+class mapped_avl_tree {
+	using Node = typename mapped_avl_tree_node<KeyType, DataType>;
+	using Header = typename avl_tree_image_header;
+public:
+	// @return nullptr if key is not present in the tree.
+	// @exception std::runtime_error if the search runs into a corrupt child link, see descend().
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	const Node* search(const LookupKeyType& key) const {
+		const auto& lookupKey = to_lookup_key<Compare, KeyType>(key);
+		size_t low = 0;
+		size_t high = this->size_;
+		uint32_t index = this->root_;
+		while (index != Header::null_index) {
+			const Node& node = this->nodes_[index];
+			const std::weak_ordering order = this->compare_keys(lookupKey, node.key);
+			if (order < 0) {
+				index = this->descend(index, false, low, high);
+			}
+			else if (order > 0) {
+				index = this->descend(index, true, low, high);
+			}
+			else {
+				return &node;
+			}
+		}
+		return nullptr;
+	}
+
+	// @return The first node with a key not smaller than key, end() if there is none. O(logn).
+	// @exception std::runtime_error if the search runs into a corrupt child link, see descend().
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	const Node* lower_bound(const LookupKeyType& key) const {
+		const auto& lookupKey = to_lookup_key<Compare, KeyType>(key);
+		const Node* bound = this->end();
+		size_t low = 0;
+		size_t high = this->size_;
+		uint32_t index = this->root_;
+		while (index != Header::null_index) {
+			const Node& node = this->nodes_[index];
+			if (this->compare_keys(node.key, lookupKey) < 0) {
+				index = this->descend(index, true, low, high);
+			}
+			else {
+				bound = &node;
+				index = this->descend(index, false, low, high);
+			}
+		}
+		return bound;
+	}
+	// @return The first node with a key bigger than key, end() if there is none. O(logn).
+	// @exception std::runtime_error if the search runs into a corrupt child link, see descend().
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	const Node* upper_bound(const LookupKeyType& key) const {
+		const auto& lookupKey = to_lookup_key<Compare, KeyType>(key);
+		const Node* bound = this->end();
+		size_t low = 0;
+		size_t high = this->size_;
+		uint32_t index = this->root_;
+		while (index != Header::null_index) {
+			const Node& node = this->nodes_[index];
+			if (this->compare_keys(lookupKey, node.key) < 0) {
+				bound = &node;
+				index = this->descend(index, false, low, high);
+			}
+			else {
+				index = this->descend(index, true, low, high);
+			}
+		}
+		return bound;
+	}
+
+	// @return Number of elements in the tree. O(1).
+	size_t size() const {
+		return this->size_;
+	}
+	bool empty() const {
+		return (this->size_ == 0);
+	}
+
+	// @return Pointer to the node with the smallest key. Nodes are contiguous and in key order.
+	const Node* begin() const {
+		return this->nodes_;
+	}
+	const Node* end() const {
+		return this->nodes_ + this->size_;
+	}
+
+	const Compare& key_comp() const {
+		return this->compare_;
+	}
+
+	// Maps the image at path. Only the header and the file length are checked here, child links are checked by the lookups that follow them.
+	// @exception std::runtime_error if the file can't be mapped, or isn't an image of a tree with these key and data types.
+	explicit mapped_avl_tree(const std::string& path, const Compare& compare = Compare())
+		: file_(path)
+		, compare_(compare) {
+		Header header;
+		if (this->file_.size() < sizeof(Header)) {
+			throw std::runtime_error(path + " is too small to be a tree image.");
+		}
+		std::memcpy(&header, this->file_.data(), sizeof(Header));
+		if (std::memcmp(header.magic, Header::format_magic, sizeof(header.magic)) != 0 || header.version != Header::format_version) {
+			throw std::runtime_error(path + " isn't a tree image of a known version.");
+		}
+		if (header.byteOrder != Header::byte_order_mark || header.keySize != sizeof(KeyType) || header.dataSize != sizeof(DataType)
+			|| header.nodeSize != sizeof(Node) || header.nodeAlignment != alignof(Node)) {
+			throw std::runtime_error(path + " was written with a different byte order or key and data types.");
+		}
+		// The node count is checked against the one the file length gives, multiplying the recorded one could overflow.
+		const size_t nodeBytes = this->file_.size() - sizeof(Header);
+		if (nodeBytes % sizeof(Node) != 0 || header.size != nodeBytes / sizeof(Node)
+			|| (header.size == 0) != (header.root == Header::null_index) || (header.size != 0 && header.root >= header.size)) {
+			throw std::runtime_error(path + " is truncated or corrupt.");
+		}
+		this->nodes_ = reinterpret_cast<const Node*>(this->file_.data() + sizeof(Header));
+		this->size_ = static_cast<size_t>(header.size);
+		this->root_ = header.root;
+	}
+private:
+	// Nodes are in key order, so the subtree of the node at index spans the indices [low, high) between its ancestors.
+	// Narrows [low, high) to the span of the node's right or left child.
+	// @return Index of that child, or Header::null_index if there is none.
+	// @exception std::runtime_error if the child is outside the span. Only a corrupt image has such links, and following them could read
+	// past the nodes or go around in circles. The span shrinks with every step, so a lookup ends after at most size() of them.
+	uint32_t descend(uint32_t index, bool isRight, size_t& low, size_t& high) const {
+		const Node& node = this->nodes_[index];
+		uint32_t child;
+		if (isRight) {
+			child = node.right_;
+			low = static_cast<size_t>(index) + 1;
+		}
+		else {
+			child = node.left_;
+			high = index;
+		}
+		if (child != Header::null_index && (child < low || child >= high)) {
+			throw std::runtime_error("Tree image is corrupt, a child link points outside its subtree.");
+		}
+		return child;
+	}
+	// One call to compare_ per pair of keys, see three_way_compare().
+	template<typename LeftType, typename RightType>
+	std::weak_ordering compare_keys(const LeftType& left, const RightType& right) const {
+		return three_way_compare(this->compare_, left, right);
+	}
+
+	mapped_file file_;
+	const Node* nodes_ = nullptr;
+	size_t size_ = 0;
+	uint32_t root_ = avl_tree_image_header::null_index;
+	Compare compare_;
+};
@@ -0,0 +1,109 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+
+// A whole file mapped read-only into memory.
+// Pages are read in by the OS as they are first touched, so opening is O(1) no matter how big the file is.
+// The mapping is private, later writes to the file by other processes aren't guaranteed to show up.
+// The file must not be truncated while it is mapped, reading the pages past its new end faults.
+class mapped_file {
+public:
+	const std::byte* data() const {
+		return this->data_;
+	}
+	size_t size() const {
+		return this->size_;
+	}
+
+	mapped_file(const mapped_file& other) = delete;
+	mapped_file& operator=(const mapped_file& other) = delete;
+	mapped_file(mapped_file&& other) noexcept
+		: data_(std::exchange(other.data_, nullptr))
+		, size_(std::exchange(other.size_, 0)) {}
+	mapped_file& operator=(mapped_file&& other) noexcept {
+		std::swap(this->data_, other.data_);
+		std::swap(this->size_, other.size_);
+		return *this;
+	}
+	~mapped_file() {
+		this->unmap();
+	}
+
+	// @exception std::runtime_error if the file can't be opened or mapped.
+	explicit mapped_file(const std::string& path) {
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			throw std::runtime_error("Couldn't open " + path + ".");
+		}
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize)) {
+			CloseHandle(file);
+			throw std::runtime_error("Couldn't read the size of " + path + ".");
+		}
+		this->size_ = static_cast<size_t>(fileSize.QuadPart);
+		if (this->size_ > 0) {
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping) {
+				this->data_ = static_cast<const std::byte*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+				CloseHandle(mapping);
+			}
+		}
+		CloseHandle(file);
+#else
+		const int file = open(path.c_str(), O_RDONLY);
+		if (file < 0) {
+			throw std::runtime_error("Couldn't open " + path + ".");
+		}
+		struct stat fileStatus;
+		if (fstat(file, &fileStatus) != 0) {
+			close(file);
+			throw std::runtime_error("Couldn't read the size of " + path + ".");
+		}
+		this->size_ = static_cast<size_t>(fileStatus.st_size);
+		if (this->size_ > 0) {
+			void* memory = mmap(nullptr, this->size_, PROT_READ, MAP_PRIVATE, file, 0);
+			this->data_ = (memory == MAP_FAILED) ? nullptr : static_cast<const std::byte*>(memory);
+		}
+		close(file);
+#endif
+		if (this->size_ > 0 && !this->data_) {
+			throw std::runtime_error("Couldn't map " + path + " into memory.");
+		}
+	}
+private:
+	void unmap() {
+		if (!this->data_) {
+			return;
+		}
+#ifdef _WIN32
+		UnmapViewOfFile(this->data_);
+#else
+		munmap(const_cast<std::byte*>(this->data_), this->size_);
+#endif
+		this->data_ = nullptr;
+		this->size_ = 0;
+	}
+
+	const std::byte* data_ = nullptr;
+	size_t size_ = 0;
+};
@@ -0,0 +1,224 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+
+
+// Node allocation policies for the tree containers.
+// A policy is a class template over the node type and provides:
+// - create(args...) constructs a node and returns a pointer to it.
+// - destroy(node) calls the destructor of a node and takes its memory back.
+// - release() gives all memory back at once. Nodes still alive are NOT destructed.
+// - reserve(count) makes sure the next count create() calls don't allocate, if the policy can batch allocations.
+// - share(other) makes nodes created by other safe to destroy through and keep alive with this allocator.
+//   Used by trees that move nodes between each other, like avl_tree::split() and avl_tree::join().
+// - releases_in_bulk is true if release() actually frees the memory of live nodes.
+// - allocation_count() is the number of calls made to the global operator new.
+
+// Allocates every node on its own with new/delete.
+template<typename NodeType>
+class heap_allocator {
+public:
+	static constexpr bool releases_in_bulk = false;
+
+	template<typename... ArgTypes>
+	NodeType* create(ArgTypes&&... args) {
+		this->allocationCount_++;
+		return new NodeType(std::forward<ArgTypes>(args)...);
+	}
+	void destroy(NodeType* node) {
+		delete node;
+	}
+	void release() {}
+	void reserve(size_t count) {}
+	void share(const heap_allocator& other) {}
+
+	size_t allocation_count() const {
+		return this->allocationCount_;
+	}
+
+	heap_allocator(const heap_allocator& other) = delete;
+	heap_allocator& operator=(const heap_allocator& other) = delete;
+	heap_allocator(heap_allocator&& other) noexcept
+		: allocationCount_(other.allocationCount_) {
+		other.allocationCount_ = 0;
+	}
+	heap_allocator& operator=(heap_allocator&& other) noexcept {
+		std::swap(this->allocationCount_, other.allocationCount_);
+		return *this;
+	}
+
+	heap_allocator() = default;
+private:
+	size_t allocationCount_ = 0;
+};
+
+// Carves nodes out of large contiguous blocks.
+// Destroyed nodes are put on a free list and handed out again by later create() calls.
+// release() drops every block, so it is O(number of blocks) no matter how many nodes there are.
+// Blocks are owned by reference counted arenas. After share() two allocators keep each other's arenas alive,
+// and an arena is freed when the last allocator referencing it lets go. 
+// Only the allocator that created an arena adds blocks to it, so allocators sharing arenas can be used from different threads.
+template<typename NodeType>
+class slab_allocator {
+	// Destroyed nodes are reused as free list entries.
+	struct FreeSlot {
+		FreeSlot* next;
+	};
+	// Blocks are chained through a header placed in front of the node storage.
+	struct BlockHeader {
+		BlockHeader* next;
+	};
+	// A chain of blocks, freed when the last allocator referencing it lets go.
+	struct Arena {
+		BlockHeader* blocks = nullptr;
+
+		~Arena() {
+			BlockHeader* block = this->blocks;
+			while (block) {
+				BlockHeader* next = block->next;
+				::operator delete(static_cast<void*>(block), std::align_val_t(block_alignment_));
+				block = next;
+			}
+		}
+	};
+
+	static constexpr size_t slot_size_ = (sizeof(NodeType) > sizeof(FreeSlot)) ? sizeof(NodeType) : sizeof(FreeSlot);
+	static constexpr size_t slot_alignment_ = (alignof(NodeType) > alignof(FreeSlot)) ? alignof(NodeType) : alignof(FreeSlot);
+	static constexpr size_t header_size_ = ((sizeof(BlockHeader) + slot_alignment_ - 1) / slot_alignment_) * slot_alignment_;
+	static constexpr size_t block_alignment_ = (slot_alignment_ > alignof(BlockHeader)) ? slot_alignment_ : alignof(BlockHeader);
+public:
+	static constexpr bool releases_in_bulk = true;
+	// Blocks are sized to hold roughly 64KiB worth of nodes.
+	static constexpr size_t nodes_per_block = (65536 / slot_size_ > 0) ? (65536 / slot_size_) : 1;
+
+	template<typename... ArgTypes>
+	NodeType* create(ArgTypes&&... args) {
+		void* slot = this->allocate_slot();
+		try {
+			return new(slot) NodeType(std::forward<ArgTypes>(args)...);
+		}
+		catch (...) {
+			this->free_slot(slot);
+			throw;
+		}
+	}
+	void destroy(NodeType* node) {
+		node->~NodeType();
+		this->free_slot(node);
+	}
+	void release() {
+		this->arena_.reset();
+		this->sharedArenas_.clear();
+		this->freeList_ = nullptr;
+		this->bumpCursor_ = nullptr;
+		this->bumpEnd_ = nullptr;
+	}
+
+	// Makes sure the next count create() calls are served without another allocation.
+	void reserve(size_t count) {
+		const size_t available = static_cast<size_t>(this->bumpEnd_ - this->bumpCursor_) / slot_size_;
+		if (available < count) {
+			this->push_block((count > nodes_per_block) ? count : nodes_per_block);
+		}
+	}
+
+	// Keeps the arenas of other alive for as long as this allocator holds on to them.
+	void share(const slab_allocator& other) {
+		if (other.arena_) {
+			this->reference_arena(other.arena_);
+		}
+		for (const std::shared_ptr<Arena>& arena : other.sharedArenas_) {
+			this->reference_arena(arena);
+		}
+	}
+
+	size_t allocation_count() const {
+		return this->allocationCount_;
+	}
+
+	slab_allocator(const slab_allocator& other) = delete;
+	slab_allocator& operator=(const slab_allocator& other) = delete;
+	slab_allocator(slab_allocator&& other) noexcept
+		: arena_(std::move(other.arena_))
+		, sharedArenas_(std::move(other.sharedArenas_))
+		, freeList_(other.freeList_)
+		, bumpCursor_(other.bumpCursor_)
+		, bumpEnd_(other.bumpEnd_)
+		, allocationCount_(other.allocationCount_) {
+		other.freeList_ = nullptr;
+		other.bumpCursor_ = nullptr;
+		other.bumpEnd_ = nullptr;
+		other.allocationCount_ = 0;
+	}
+	slab_allocator& operator=(slab_allocator&& other) noexcept {
+		std::swap(this->arena_, other.arena_);
+		std::swap(this->sharedArenas_, other.sharedArenas_);
+		std::swap(this->freeList_, other.freeList_);
+		std::swap(this->bumpCursor_, other.bumpCursor_);
+		std::swap(this->bumpEnd_, other.bumpEnd_);
+		std::swap(this->allocationCount_, other.allocationCount_);
+		return *this;
+	}
+	~slab_allocator() {
+		this->release();
+	}
+
+	slab_allocator() = default;
+private:
+	void reference_arena(const std::shared_ptr<Arena>& arena) {
+		if (arena == this->arena_ || std::find(this->sharedArenas_.begin(), this->sharedArenas_.end(), arena) != this->sharedArenas_.end()) {
+			return;
+		}
+		this->sharedArenas_.push_back(arena);
+	}
+
+	void* allocate_slot() {
+		if (this->freeList_) {
+			FreeSlot* slot = this->freeList_;
+			this->freeList_ = slot->next;
+			return slot;
+		}
+		if (this->bumpCursor_ == this->bumpEnd_) {
+			this->push_block(nodes_per_block);
+		}
+		void* slot = this->bumpCursor_;
+		this->bumpCursor_ += slot_size_;
+		return slot;
+	}
+	void free_slot(void* slot) {
+		FreeSlot* freeSlot = static_cast<FreeSlot*>(slot);
+		freeSlot->next = this->freeList_;
+		this->freeList_ = freeSlot;
+	}
+
+	// Allocates a new block and points the bump cursor at its storage.
+	// Whatever was left of the previous block goes to the free list.
+	void push_block(size_t nodeCount) {
+		while (this->bumpCursor_ != this->bumpEnd_) {
+			this->free_slot(this->bumpCursor_);
+			this->bumpCursor_ += slot_size_;
+		}
+		if (!this->arena_) {
+			this->arena_ = std::make_shared<Arena>();
+		}
+		void* memory = ::operator new(header_size_ + nodeCount * slot_size_, std::align_val_t(block_alignment_));
+		this->allocationCount_++;
+		BlockHeader* block = static_cast<BlockHeader*>(memory);
+		block->next = this->arena_->blocks;
+		this->arena_->blocks = block;
+		this->bumpCursor_ = static_cast<char*>(memory) + header_size_;
+		this->bumpEnd_ = this->bumpCursor_ + nodeCount * slot_size_;
+	}
+
+	std::shared_ptr<Arena> arena_;
+	std::vector<std::shared_ptr<Arena>> sharedArenas_;
+	FreeSlot* freeList_ = nullptr;
+	char* bumpCursor_ = nullptr;
+	char* bumpEnd_ = nullptr;
+	size_t allocationCount_ = 0;
+};
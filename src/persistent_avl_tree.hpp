@@ -0,0 +1,408 @@
+#pragma once
+#include "key_compare.hpp"
+
+#include <concepts>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <compare>
+#include <iterator>
+#include <vector>
+
+
+
+// <<<-------------------------------------------------->>>
+// <<<----------- Class forward declarations ----------->>>
+// <<<-------------------------------------------------->>>
+template<typename KeyType, typename DataType>
+	requires (std::copyable<KeyType> && std::copyable<DataType>)
+class persistent_avl_tree_iterator;
+template<typename KeyType, typename DataType>
+	requires (std::copyable<KeyType> && std::copyable<DataType>)
+class persistent_avl_tree_node;
+template<typename KeyType, typename DataType, typename Compare = three_way_key_compare>
+	requires (std::copyable<KeyType> && std::copyable<DataType>
+			  && key_comparator_for<Compare, KeyType, KeyType>)
+class persistent_avl_tree;
+
+
+
+// An in-order traversal forward iterator.
+// Nodes have no parent pointers since they can be shared by many trees, so the iterator keeps the path from the root on a stack.
+// end() iterator has an empty stack.
+template<typename KeyType, typename DataType>
+	requires (std::copyable<KeyType> && std::copyable<DataType>)
+class persistent_avl_tree_iterator {
+	using Iterator = typename persistent_avl_tree_iterator;
+	using Node = typename persistent_avl_tree_node<KeyType, DataType>;
+public:
+	bool operator==(const Iterator& other) const {
+		return (this->current() == other.current());
+	}
+	bool operator!=(const Iterator& other) const {
+		return (this->current() != other.current());
+	}
+
+	Iterator& operator++() {
+		if (this->path_.empty()) {
+			return *this;
+		}
+		const Node* node = this->path_.back()->right_;
+		this->path_.pop_back();
+		this->push_left_spine(node);
+		return *this;
+	}
+	Iterator operator++(int) {
+		Iterator temp = *this;
+		++(*this);
+		return temp;
+	}
+
+	const Node* operator->() const {
+		return this->current();
+	}
+	const Node& operator*() const {
+		return *(this->current());
+	}
+
+	template<typename TreeKeyType, typename TreeDataType, typename TreeCompare>
+		requires (std::copyable<TreeKeyType> && std::copyable<TreeDataType>
+				  && key_comparator_for<TreeCompare, TreeKeyType, TreeKeyType>)
+	friend class persistent_avl_tree;
+private:
+	const Node* current() const {
+		return this->path_.empty() ? nullptr : this->path_.back();
+	}
+	void push_left_spine(const Node* node) {
+		while (node) {
+			this->path_.push_back(node);
+			node = node->left_;
+		}
+	}
+
+	// Ancestors of the current node that come after it in order, the current node last.
+	std::vector<const Node*> path_;
+};
+
+// Holds an immutable key-data pair, the height and size of the subtree rooted at the node,
+// and the number of trees and parent nodes referencing it.
+template<typename KeyType, typename DataType>
+	requires (std::copyable<KeyType> && std::copyable<DataType>)
+class persistent_avl_tree_node {
+	using Node = typename persistent_avl_tree_node;
+public:
+	const KeyType key;
+	const DataType data;
+
+	template <typename... ArgTypes>
+	persistent_avl_tree_node(const KeyType& key_, ArgTypes&&... args)
+		: key(key_)
+		, data(DataType(std::forward<ArgTypes>(args)...)) {}
+
+	friend persistent_avl_tree_iterator<KeyType, DataType>;
+	template<typename TreeKeyType, typename TreeDataType, typename TreeCompare>
+		requires (std::copyable<TreeKeyType> && std::copyable<TreeDataType>
+				  && key_comparator_for<TreeCompare, TreeKeyType, TreeKeyType>)
+	friend class persistent_avl_tree;
+private:
+	std::atomic<size_t> referenceCount_ = 1;
+	size_t subtreeSize_ = 1;
+	int_fast8_t height_ = 1;
+	Node* left_ = nullptr;
+	Node* right_ = nullptr;
+};
+
+// A persistent AVL tree for multi-version readers.
+// Copying a tree, or taking a snapshot(), is O(1): the copy shares all nodes with the original.
+// Updates copy only the O(logn) nodes on the path they change and share every other subtree, so a long-lived snapshot
+// costs memory proportional to the changes made since it was taken, not to the size of the tree.
+// Nodes are reference counted. A node referenced by exactly one tree or parent is changed in place instead of copied,
+// so a tree without snapshots pays for path copying only in the reference count checks.
+// Reference counts are atomic, so snapshots can be read and destroyed on other threads while the original is updated.
+// A single tree object is not thread-safe, snapshot() has to be called by the thread updating the tree.
+// Nodes aren't allocated through a NodeAllocator since the last snapshot referencing a node may be destroyed on any thread.
+// KeyType must be copyable.
+// DataType must be copyable.
+// Compare orders the keys, see key_compare.hpp.
+template<typename KeyType, typename DataType, typename Compare>
+	requires (std::copyable<KeyType> && std::copyable<DataType>
+			  && key_comparator_for<Compare, KeyType, KeyType>)
+class persistent_avl_tree {
+	using Iterator = typename persistent_avl_tree_iterator<KeyType, DataType>;
+	using Node = typename persistent_avl_tree_node<KeyType, DataType>;
+public:
+	// @return nullptr if key is not present in the tree. The node stays valid for as long as some tree references it.
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	const Node* search(const LookupKeyType& key) const {
+		const auto& lookupKey = to_lookup_key<Compare, KeyType>(key);
+		const Node* node = this->root_;
+		while (node) {
+			const std::weak_ordering order = this->compare_keys(lookupKey, node->key);
+			if (order < 0) {
+				node = node->left_;
+			}
+			else if (order > 0) {
+				node = node->right_;
+			}
+			else {
+				return node;
+			}
+		}
+		return nullptr;
+	}
+
+	// @return An O(1) copy of the tree as it is now. Later updates to either tree don't show up in the other.
+	persistent_avl_tree snapshot() const {
+		return persistent_avl_tree(*this);
+	}
+
+	// Creates a node on the tree, path copying the nodes shared with snapshots.
+	// @return false if key is already in tree.
+	bool insert(const KeyType& key_, const DataType& data_) {
+		return this->emplace(key_, data_);
+	}
+	bool insert(const KeyType& key_, DataType&& data_) {
+		return this->emplace(key_, std::move(data_));
+	}
+	template <typename... ArgTypes>
+	bool emplace(const KeyType& key_, ArgTypes&&... args) {
+		if (this->search(key_)) {
+			return false;
+		}
+		this->root_ = this->insert_into_subtree(this->root_, key_, std::forward<ArgTypes>(args)...);
+		return true;
+	}
+	// Inserts the key-data pair, or replaces the data of key if it's already in the tree.
+	// Snapshots keep seeing the old data.
+	// @return true if a new element was inserted.
+	bool insert_or_assign(const KeyType& key_, const DataType& data_) {
+		const bool isInserted = !this->search(key_);
+		this->root_ = this->insert_into_subtree(this->root_, key_, data_);
+		return isInserted;
+	}
+
+	// Removes key from the tree, path copying the nodes shared with snapshots.
+	// Nodes are destructed once no tree references them anymore.
+	// @return false if key is not in the tree.
+	template<lookup_key_for<Compare, KeyType> LookupKeyType>
+	bool remove(const LookupKeyType& key_) {
+		const Node* node = this->search(key_);
+		if (!node) {
+			return false;
+		}
+		this->root_ = this->remove_from_subtree(this->root_, node->key);
+		return true;
+	}
+
+	// Drops this tree's reference to its nodes. Snapshots are left untouched.
+	void clear() {
+		release(this->root_);
+		this->root_ = nullptr;
+	}
+
+	// @return Number of elements in the tree. O(1).
+	size_t size() const {
+		return subtree_size(this->root_);
+	}
+	bool empty() const {
+		return !this->root_;
+	}
+
+	// @return An in-order traversal iterator pointing at the smallest element of the tree.
+	Iterator begin() const {
+		Iterator iterator;
+		iterator.push_left_spine(this->root_);
+		return iterator;
+	}
+	// @return An in-order traversal iterator past the last element.
+	Iterator end() const {
+		return Iterator();
+	}
+
+	const Compare& key_comp() const {
+		return this->compare_;
+	}
+
+	// O(1), shares the nodes of other.
+	persistent_avl_tree(const persistent_avl_tree& other)
+		: root_(acquire(other.root_))
+		, compare_(other.compare_) {}
+	persistent_avl_tree& operator=(const persistent_avl_tree& other) {
+		Node* root = acquire(other.root_);
+		release(this->root_);
+		this->root_ = root;
+		this->compare_ = other.compare_;
+		return *this;
+	}
+	persistent_avl_tree(persistent_avl_tree&& other) noexcept
+		: root_(other.root_)
+		, compare_(other.compare_) {
+		other.root_ = nullptr;
+	}
+	persistent_avl_tree& operator=(persistent_avl_tree&& other) noexcept {
+		std::swap(this->root_, other.root_);
+		this->compare_ = other.compare_;
+		return *this;
+	}
+	~persistent_avl_tree() {
+		this->clear();
+	}
+
+	explicit persistent_avl_tree(const Compare& compare)
+		: root_(nullptr)
+		, compare_(compare) {}
+	persistent_avl_tree()
+		: root_(nullptr) {}
+private:
+	// One call to compare_ per pair of keys, see three_way_compare().
+	template<typename LeftType, typename RightType>
+	std::weak_ordering compare_keys(const LeftType& left, const RightType& right) const {
+		return three_way_compare(this->compare_, left, right);
+	}
+
+	// <<<----------- Reference counting ----------->>>
+	// Functions taking a Node* take over the reference the caller held to it, and the Node* they return carries a reference.
+	static Node* acquire(Node* node) {
+		if (node) {
+			node->referenceCount_.fetch_add(1, std::memory_order_relaxed);
+		}
+		return node;
+	}
+	// Recursive method that drops a reference, destructing the node and dropping its references to its children if it was the last one.
+	// Recursion depth is at most the height of the tree.
+	static void release(Node* node) {
+		if (node && node->referenceCount_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			release(node->left_);
+			release(node->right_);
+			delete node;
+		}
+	}
+	// @return node itself if the caller holds the only reference to it, an unshared copy referencing the same children otherwise.
+	static Node* make_unshared(Node* node) {
+		if (node->referenceCount_.load(std::memory_order_acquire) == 1) {
+			return node;
+		}
+		Node* copy = new Node(node->key, node->data);
+		copy->subtreeSize_ = node->subtreeSize_;
+		copy->height_ = node->height_;
+		copy->left_ = acquire(node->left_);
+		copy->right_ = acquire(node->right_);
+		release(node);
+		return copy;
+	}
+
+	// <<<----------- Balancing ----------->>>
+	static int height(const Node* node) {
+		return node ? node->height_ : 0;
+	}
+	static size_t subtree_size(const Node* node) {
+		return node ? node->subtreeSize_ : 0;
+	}
+	static void update(Node* node) {
+		const int leftHeight = height(node->left_);
+		const int rightHeight = height(node->right_);
+		node->height_ = static_cast<int_fast8_t>(((leftHeight > rightHeight) ? leftHeight : rightHeight) + 1);
+		node->subtreeSize_ = subtree_size(node->left_) + subtree_size(node->right_) + 1;
+	}
+	// Rotations only change unshared nodes: root has to be unshared, and the pivot is made unshared first.
+	// @return The new root of the subtree.
+	static Node* rotate_left(Node* root) {
+		Node* const pivot = make_unshared(root->right_);
+		root->right_ = pivot->left_;
+		pivot->left_ = root;
+		update(root);
+		update(pivot);
+		return pivot;
+	}
+	static Node* rotate_right(Node* root) {
+		Node* const pivot = make_unshared(root->left_);
+		root->left_ = pivot->right_;
+		pivot->right_ = root;
+		update(root);
+		update(pivot);
+		return pivot;
+	}
+	// Updates an unshared node after one of its subtrees changed, rotating if its balance went out of [-1, 1].
+	// @return The new root of the subtree.
+	static Node* rebalance(Node* node) {
+		update(node);
+		const int balanceFactor = height(node->left_) - height(node->right_);
+		if (balanceFactor == 2) {
+			if (height(node->left_->left_) < height(node->left_->right_)) {
+				node->left_ = rotate_left(make_unshared(node->left_));
+			}
+			return rotate_right(node);
+		}
+		else if (balanceFactor == -2) {
+			if (height(node->right_->right_) < height(node->right_->left_)) {
+				node->right_ = rotate_right(make_unshared(node->right_));
+			}
+			return rotate_left(node);
+		}
+		return node;
+	}
+
+	// <<<----------- Path copying updates ----------->>>
+	// Recursive method that inserts key into a subtree, replacing the node with key if there is one.
+	// @return The new root of the subtree.
+	template <typename... ArgTypes>
+	Node* insert_into_subtree(Node* node, const KeyType& key, ArgTypes&&... args) {
+		if (!node) {
+			return new Node(key, std::forward<ArgTypes>(args)...);
+		}
+		const std::weak_ordering order = this->compare_keys(key, node->key);
+		if (order == 0) {
+			Node* replacement = new Node(key, std::forward<ArgTypes>(args)...);
+			replacement->left_ = acquire(node->left_);
+			replacement->right_ = acquire(node->right_);
+			update(replacement);
+			release(node);
+			return replacement;
+		}
+		node = make_unshared(node);
+		if (order < 0) {
+			node->left_ = this->insert_into_subtree(node->left_, key, std::forward<ArgTypes>(args)...);
+		}
+		else {
+			node->right_ = this->insert_into_subtree(node->right_, key, std::forward<ArgTypes>(args)...);
+		}
+		return rebalance(node);
+	}
+	// Recursive method that removes key from a subtree. key has to be in the subtree.
+	// @return The new root of the subtree.
+	Node* remove_from_subtree(Node* node, const KeyType& key) {
+		const std::weak_ordering order = this->compare_keys(key, node->key);
+		if (order == 0) {
+			if (!node->left_ || !node->right_) {
+				Node* const child = acquire(node->left_ ? node->left_ : node->right_);
+				release(node);
+				return child;
+			}
+			// Two children: a copy of the min() of the right subtree takes the node's place.
+			const Node* successor = node->right_;
+			while (successor->left_) {
+				successor = successor->left_;
+			}
+			// The replacement takes over the references of an unshared node, so the right subtree isn't copied needlessly.
+			Node* replacement = new Node(successor->key, successor->data);
+			node = make_unshared(node);
+			replacement->left_ = std::exchange(node->left_, nullptr);
+			replacement->right_ = std::exchange(node->right_, nullptr);
+			release(node);
+			replacement->right_ = this->remove_from_subtree(replacement->right_, replacement->key);
+			return rebalance(replacement);
+		}
+		node = make_unshared(node);
+		if (order < 0) {
+			node->left_ = this->remove_from_subtree(node->left_, key);
+		}
+		else {
+			node->right_ = this->remove_from_subtree(node->right_, key);
+		}
+		return rebalance(node);
+	}
+
+	Node* root_;
+	Compare compare_;
+};
@@ -0,0 +1,379 @@
+#pragma once
+#include "avl_tree.hpp"
+#include "epoch_reclaimer.hpp"
+#include "key_compare.hpp"
+
+#include <concepts>
+#include <utility>
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <compare>
+
+
+
+// <<<-------------------------------------------------->>>
+// <<<----------- Class forward declarations ----------->>>
+// <<<-------------------------------------------------->>>
+template<typename KeyType, typename DataType, template<typename> typename NodeAllocator = slab_allocator, typename Compare = three_way_key_compare>
+	requires (std::copyable<KeyType> && std::copyable<DataType> && key_comparator_for<Compare, KeyType, KeyType>)
+class sharded_avl_tree;
+
+
+
+// An ordered map for many threads, split by key range into shards that are each an avl_tree with its own reader-writer lock.
+// Point operations find their shard in an immutable shard map and only lock that shard, so threads working on different
+// key ranges never wait on each other. Readers of the same shard share its lock.
+// The shard map is replaced whole when shards are split or merged, and old maps are reclaimed through an epoch_reclaimer,
+// so finding a shard takes no lock and writes nothing other threads read.
+// A shard that grows past twice its share of the elements is split at its median, and one that shrinks below
+// an eighth of that is merged into its smaller neighbour, so the shards follow the keys when they are skewed.
+// Splits and merges are done with avl_tree::split() and avl_tree::join() in O(logn), and are serialized with each other.
+// Range visits walk the shards in key order, locking one at a time.
+// KeyType must be copyable.
+// DataType must be copyable, lookups return copies of it.
+// NodeAllocator is the node allocation policy of the shards, see node_allocator.hpp.
+// Compare orders the keys, see key_compare.hpp.
+template<typename KeyType, typename DataType, template<typename> typename NodeAllocator, typename Compare>
+	requires (std::copyable<KeyType> && std::copyable<DataType> && key_comparator_for<Compare, KeyType, KeyType>)
+class sharded_avl_tree {
+	using Tree = typename avl_tree<KeyType, DataType, NodeAllocator, Compare>;
+	// On its own cache lines, so threads locking neighbouring shards don't share one.
+	struct alignas(64) Shard {
+		mutable std::shared_mutex mutex;
+		Tree tree;
+		// Set under the exclusive lock once a split or merge took the elements of the shard. Threads that find it set start over.
+		bool isRetired = false;
+		// Written under the exclusive lock, read without it to decide on splits and merges.
+		std::atomic<size_t> size = 0;
+
+		explicit Shard(Tree&& tree_)
+			: tree(std::move(tree_))
+			, size(tree.size()) {}
+	};
+	// Shard i holds the keys in [bounds[i - 1], bounds[i]), the first and last shards are open ended.
+	struct ShardMap {
+		std::vector<KeyType> bounds;
+		std::vector<Shard*> shards;
+		// Shards above splitSize are split, shards below mergeSize are merged. Set when the map is published.
+		size_t splitSize = 0;
+		size_t mergeSize = 0;
+		// Shards that were replaced when the map after this one was published, deleted along with this map.
+		std::vector<Shard*> retiredShards;
+	};
+	using Reclaimer = typename epoch_reclaimer<ShardMap>;
+	// Shards don't split before they hold this many elements, so a small tree isn't cut into tiny shards.
+	static constexpr size_t min_split_size_ = 1024;
+public:
+	// @return true if key is present in the tree.
+	bool contains(const KeyType& key) const {
+		return this->visit(key, [](const DataType& data) {});
+	}
+	// @return A copy of the data of key, std::nullopt if key is not present in the tree.
+	std::optional<DataType> search(const KeyType& key) const {
+		std::optional<DataType> result;
+		this->visit(key, [&result](const DataType& data) { result.emplace(data); });
+		return result;
+	}
+	// Calls function with the data of key, under the read lock of its shard.
+	// @return false if key is not present in the tree.
+	template<typename Function>
+	bool visit(const KeyType& key, Function&& function) const {
+		typename Reclaimer::guard guard = this->reclaimer_.enter();
+		return this->with_shard<false>(key, [&](Shard& shard, const ShardMap& map) {
+			const auto* node = shard.tree.search(key);
+			if (node) {
+				function(node->data);
+			}
+			return (node != nullptr);
+		});
+	}
+
+	// Inserts a key-data pair if key is not present in the tree.
+	// @return false if key was already present.
+	bool insert(const KeyType& key_, const DataType& data_) {
+		return this->emplace(key_, data_);
+	}
+	bool insert(const KeyType& key_, DataType&& data_) {
+		return this->emplace(key_, std::move(data_));
+	}
+	template<typename... ArgTypes>
+	bool emplace(const KeyType& key_, ArgTypes&&... args) {
+		typename Reclaimer::guard guard = this->reclaimer_.enter();
+		Shard* oversized = nullptr;
+		const bool isInserted = this->with_shard<true>(key_, [&](Shard& shard, const ShardMap& map) {
+			if (!shard.tree.emplace(key_, std::forward<ArgTypes>(args)...)) {
+				return false;
+			}
+			shard.size.store(shard.tree.size(), std::memory_order_relaxed);
+			if (shard.tree.size() > map.splitSize) {
+				oversized = &shard;
+			}
+			return true;
+		});
+		if (oversized) {
+			this->split_shard(oversized);
+		}
+		return isInserted;
+	}
+
+	// Removes key from the tree.
+	// @return false if key was not present.
+	bool remove(const KeyType& key_) {
+		typename Reclaimer::guard guard = this->reclaimer_.enter();
+		Shard* undersized = nullptr;
+		const bool isRemoved = this->with_shard<true>(key_, [&](Shard& shard, const ShardMap& map) {
+			if (!shard.tree.remove(key_)) {
+				return false;
+			}
+			shard.size.store(shard.tree.size(), std::memory_order_relaxed);
+			if (shard.tree.size() < map.mergeSize && map.shards.size() > 1) {
+				undersized = &shard;
+			}
+			return true;
+		});
+		if (undersized) {
+			this->merge_shard(undersized);
+		}
+		return isRemoved;
+	}
+
+	// Calls function(key, data) for every element with a key in [low, high), in key order.
+	// Each shard is visited under its read lock and released before the next one is locked, so the elements of a shard
+	// are seen as they were at one point in time, but shards further on may change before they are reached.
+	// A shard split or merged during the visit is picked up in the new shard map, after the last key visited.
+	template<typename Function>
+	void visit_range(const KeyType& low, const KeyType& high, Function&& function) const {
+		if (this->compare_keys(low, high) < 0) {
+			this->visit_shards(&low, &high, function);
+		}
+	}
+	// Calls function(key, data) for every element, in key order. See visit_range().
+	template<typename Function>
+	void visit_all(Function&& function) const {
+		this->visit_shards(nullptr, nullptr, function);
+	}
+
+	// Removes all elements from the tree. The shards are replaced by a single empty one.
+	void clear() {
+		std::lock_guard<std::mutex> restructureLock(this->restructureMutex_);
+		ShardMap* const map = this->map_.load(std::memory_order_relaxed);
+		// Held until the new map is published, so threads waiting on the shards find it.
+		std::vector<std::unique_lock<std::shared_mutex>> locks;
+		locks.reserve(map->shards.size());
+		for (Shard* shard : map->shards) {
+			locks.emplace_back(shard->mutex);
+			shard->isRetired = true;
+			// Threads that find the shard retired never touch its tree, so its elements go now instead of with the old map.
+			shard->tree.clear();
+		}
+		ShardMap* const newMap = new ShardMap();
+		newMap->shards.push_back(new Shard(Tree(this->compare_)));
+		this->publish(map, newMap, map->shards);
+	}
+
+	// Only exact while no writer is running. O(number of shards).
+	size_t size() const {
+		typename Reclaimer::guard guard = this->reclaimer_.enter();
+		return this->total_size(*this->map_.load(std::memory_order_acquire));
+	}
+	bool empty() const {
+		return (this->size() == 0);
+	}
+	// @return Number of shards the keys are split into right now.
+	size_t shard_count() const {
+		typename Reclaimer::guard guard = this->reclaimer_.enter();
+		return this->map_.load(std::memory_order_acquire)->shards.size();
+	}
+
+	const Compare& key_comp() const {
+		return this->compare_;
+	}
+
+	sharded_avl_tree(const sharded_avl_tree& other) = delete;
+	sharded_avl_tree& operator=(const sharded_avl_tree& other) = delete;
+	// There must be no readers or writers left when the tree is destructed.
+	~sharded_avl_tree() {
+		ShardMap* const map = this->map_.load(std::memory_order_relaxed);
+		for (Shard* shard : map->shards) {
+			delete shard;
+		}
+		delete map;
+	}
+
+	// @param[targetShardCount] Number of shards the elements are spread over once there are enough of them.
+	// A few shards per core keeps threads from meeting on the same one. Skewed keys may split the tree into more.
+	explicit sharded_avl_tree(size_t targetShardCount, const Compare& compare = Compare())
+		: compare_(compare)
+		, targetShardCount_(std::max<size_t>(targetShardCount, 1)) {
+		ShardMap* const map = new ShardMap();
+		map->shards.push_back(new Shard(Tree(this->compare_)));
+		this->set_thresholds(*map);
+		this->map_.store(map, std::memory_order_relaxed);
+	}
+	sharded_avl_tree()
+		: sharded_avl_tree(4 * std::max<size_t>(std::thread::hardware_concurrency(), 1)) {}
+private:
+	// One call to compare_ per pair of keys, see three_way_compare().
+	std::weak_ordering compare_keys(const KeyType& left, const KeyType& right) const {
+		return three_way_compare(this->compare_, left, right);
+	}
+	// @return Index of the shard key belongs to, the number of bounds not bigger than key.
+	size_t shard_index(const ShardMap& map, const KeyType& key) const {
+		size_t low = 0;
+		size_t high = map.bounds.size();
+		while (low < high) {
+			const size_t middle = low + (high - low) / 2;
+			if (this->compare_keys(key, map.bounds[middle]) < 0) {
+				high = middle;
+			}
+			else {
+				low = middle + 1;
+			}
+		}
+		return low;
+	}
+	// Runs function(shard, map) under the lock of the shard key belongs to, exclusive if IsWrite and shared otherwise.
+	// A shard retired by a split or merge before its lock was taken is found in the new map, which is published before the old shard is unlocked.
+	// The caller holds a guard, so the map and the shard stay alive.
+	template<bool IsWrite, typename Function>
+	bool with_shard(const KeyType& key, Function&& function) const {
+		using Lock = std::conditional_t<IsWrite, std::unique_lock<std::shared_mutex>, std::shared_lock<std::shared_mutex>>;
+		while (true) {
+			const ShardMap* map = this->map_.load(std::memory_order_acquire);
+			Shard* const shard = map->shards[this->shard_index(*map, key)];
+			Lock lock(shard->mutex);
+			if (!shard->isRetired) {
+				return function(*shard, *map);
+			}
+		}
+	}
+
+	// Visits the elements with keys in [low, high) shard by shard, a nullptr bound is open. See visit_range().
+	template<typename Function>
+	void visit_shards(const KeyType* low, const KeyType* high, Function& function) const {
+		typename Reclaimer::guard guard = this->reclaimer_.enter();
+		std::optional<KeyType> lastKey;
+		bool isDone = false;
+		while (!isDone) {
+			const ShardMap* map = this->map_.load(std::memory_order_acquire);
+			const KeyType* from = lastKey ? &*lastKey : low;
+			isDone = true;
+			for (size_t index = (from ? this->shard_index(*map, *from) : 0); index < map->shards.size(); index++) {
+				Shard* const shard = map->shards[index];
+				std::shared_lock<std::shared_mutex> lock(shard->mutex);
+				if (shard->isRetired) {
+					isDone = false;
+					break;
+				}
+				auto it = lastKey ? shard->tree.upper_bound(*lastKey) : (low ? shard->tree.lower_bound(*low) : shard->tree.begin());
+				for (; it != shard->tree.end(); ++it) {
+					if (high && !(this->compare_keys(it->key, *high) < 0)) {
+						return;
+					}
+					function(static_cast<const KeyType&>(it->key), static_cast<const DataType&>(it->data));
+					lastKey = it->key;
+				}
+				// The next shard starts at bounds[index].
+				if (high && index < map->bounds.size() && !(this->compare_keys(map->bounds[index], *high) < 0)) {
+					return;
+				}
+			}
+		}
+	}
+
+	// Splits shard at its median if it is still in the map and still too big.
+	void split_shard(Shard* shard) {
+		std::lock_guard<std::mutex> restructureLock(this->restructureMutex_);
+		ShardMap* const map = this->map_.load(std::memory_order_relaxed);
+		const auto position = std::find(map->shards.begin(), map->shards.end(), shard);
+		if (position == map->shards.end()) {
+			return;
+		}
+		const size_t index = static_cast<size_t>(position - map->shards.begin());
+		std::unique_lock<std::shared_mutex> lock(shard->mutex);
+		if (shard->tree.size() <= map->splitSize) {
+			return;
+		}
+		const KeyType median = shard->tree.select(shard->tree.size() / 2)->key;
+		std::pair<Tree, Tree> halves = shard->tree.split(median);
+		shard->isRetired = true;
+
+		ShardMap* const newMap = new ShardMap(*map);
+		newMap->retiredShards.clear();
+		newMap->shards[index] = new Shard(std::move(halves.first));
+		newMap->shards.insert(newMap->shards.begin() + index + 1, new Shard(std::move(halves.second)));
+		newMap->bounds.insert(newMap->bounds.begin() + index, median);
+		this->publish(map, newMap, { shard });
+	}
+	// Merges shard into its smaller neighbour if it is still in the map and still too small,
+	// unless the merged shard would be big enough to be split again.
+	void merge_shard(Shard* shard) {
+		std::lock_guard<std::mutex> restructureLock(this->restructureMutex_);
+		ShardMap* const map = this->map_.load(std::memory_order_relaxed);
+		const auto position = std::find(map->shards.begin(), map->shards.end(), shard);
+		if (position == map->shards.end() || map->shards.size() < 2) {
+			return;
+		}
+		size_t index = static_cast<size_t>(position - map->shards.begin());
+		if (index + 1 == map->shards.size()
+			|| (index > 0 && map->shards[index - 1]->size.load(std::memory_order_relaxed) < map->shards[index + 1]->size.load(std::memory_order_relaxed))) {
+			index--;
+		}
+		Shard* const left = map->shards[index];
+		Shard* const right = map->shards[index + 1];
+		// Point operations hold one shard lock at a time and restructuring is serialized, so locking two in key order can't deadlock.
+		std::unique_lock<std::shared_mutex> leftLock(left->mutex);
+		std::unique_lock<std::shared_mutex> rightLock(right->mutex);
+		if (shard->tree.size() >= map->mergeSize || left->tree.size() + right->tree.size() > map->splitSize / 2) {
+			return;
+		}
+		Tree merged = Tree::join(std::move(left->tree), std::move(right->tree));
+		left->isRetired = true;
+		right->isRetired = true;
+
+		ShardMap* const newMap = new ShardMap(*map);
+		newMap->retiredShards.clear();
+		newMap->shards[index] = new Shard(std::move(merged));
+		newMap->shards.erase(newMap->shards.begin() + index + 1);
+		newMap->bounds.erase(newMap->bounds.begin() + index);
+		this->publish(map, newMap, { left, right });
+	}
+	// Replaces map with newMap. The replaced shards are deleted with map, once no thread can still be using either.
+	// Called with the restructuring lock and the locks of the replaced shards held, so threads waiting on them find newMap.
+	void publish(ShardMap* map, ShardMap* newMap, std::vector<Shard*> replacedShards) {
+		this->set_thresholds(*newMap);
+		map->retiredShards = std::move(replacedShards);
+		this->map_.store(newMap, std::memory_order_release);
+		this->reclaimer_.retire(map);
+	}
+	// A shard's share is the elements divided by the target shard count, but never less than min_split_size_ / 2.
+	void set_thresholds(ShardMap& map) const {
+		const size_t share = std::max(this->total_size(map) / this->targetShardCount_, min_split_size_ / 2);
+		map.splitSize = 2 * share;
+		map.mergeSize = share / 4;
+	}
+	static size_t total_size(const ShardMap& map) {
+		size_t size = 0;
+		for (const Shard* shard : map.shards) {
+			size += shard->size.load(std::memory_order_relaxed);
+		}
+		return size;
+	}
+
+	Compare compare_;
+	size_t targetShardCount_;
+	std::atomic<ShardMap*> map_;
+	std::mutex restructureMutex_;
+	mutable Reclaimer reclaimer_ = Reclaimer([](ShardMap* map) {
+		for (Shard* shard : map->retiredShards) {
+			delete shard;
+		}
+		delete map;
+	});
+};
@@ -1,13 +1,30 @@
 #include "tracked_array.hpp"
 #include "binary_search_tree.hpp"
 #include "avl_tree.hpp"
+#include "b_plus_tree.hpp"
+#include "balanced_tree.hpp"
+#include "interval_tree.hpp"
+#include "concurrent_avl_tree.hpp"
+#include "sharded_avl_tree.hpp"
+#include "compact_avl_tree.hpp"
+#include "persistent_avl_tree.hpp"
 #include "doubly_linked_list.hpp"
 
 #include <iostream>
 #include <chrono>
 #include <cstdint>
 #include <vector>
+#include <utility>
 #include <ctime>
+#include <thread>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <array>
+#include <cstdio>
+#include <limits>
+#include <functional>
 
 #define TIMER_START {auto _TStartTime = std::chrono::high_resolution_clock::now();
 #define TIMER_END(timerName) auto _TCurrentTime = std::chrono::high_resolution_clock::now(); std::cerr << "[" << timerName << "]\nRan for: " << (_TCurrentTime - _TStartTime) << " \n\n";}
@@ -152,6 +169,25 @@ private:
 	inline static int count_ = 0;
 };
 
+// A payload bigger than a cache line, which avl_tree keeps out of line.
+struct Record {
+	Record(size_t id_ = 0)
+		: id(id_) {}
+
+	size_t id;
+	char payload[248] = {};
+};
+// The same payload kept in the nodes.
+struct InlineRecord {
+	InlineRecord(size_t id_ = 0)
+		: id(id_) {}
+
+	size_t id;
+	char payload[248] = {};
+};
+template<>
+struct avl_tree_cold_data<InlineRecord> : std::false_type {};
+
 
 namespace AVLUtilities {
 	size_t* GetRandomizedArrayOfSize(size_t size) {
@@ -197,8 +233,9 @@ namespace AVLUtilities {
 		delete[] indices;
 	}
 	
-	avl_tree<int, Tracer> CreateRandomTreeOfSize(size_t size) {
-		avl_tree<int, Tracer> avl;
+	template<typename DataType = Tracer, template<typename> typename NodeAllocator = slab_allocator>
+	avl_tree<int, DataType, NodeAllocator> CreateRandomTreeOfSize(size_t size) {
+		avl_tree<int, DataType, NodeAllocator> avl;
 		const size_t* indices = GetRandomizedArrayOfSize(size);
 
 		for (size_t i = 0; i < size; i++) {
@@ -208,7 +245,42 @@ namespace AVLUtilities {
 		delete[] indices;
 		return avl;
 	}
-	void RandomlyClearTreeOfSize(avl_tree<int, Tracer>& avl, size_t size) {
+	// Returns keys 0 to size-1 in increasing order, with each key displaced by at most window-1 places.
+	size_t* GetNearlySortedArrayOfSize(size_t size, size_t window) {
+		size_t* array = new size_t[size];
+		for (size_t i = 0; i < size; i++) {
+			array[i] = i;
+		}
+		for (size_t i = 0; i + 1 < size; i++) {
+			const size_t swapIndex = i + rand() % ((window < size - i) ? window : (size - i));
+			size_t temp = array[i];
+			array[i] = array[swapIndex];
+			array[swapIndex] = temp;
+		}
+		return array;
+	}
+
+	// Returns key-data pairs with keys 0 to size-1, shuffled if isShuffled is set.
+	std::vector<std::pair<int, int>> GetKeyDataPairsOfSize(size_t size, bool isShuffled) {
+		std::vector<std::pair<int, int>> pairs;
+		pairs.reserve(size);
+		if (isShuffled) {
+			const size_t* indices = GetRandomizedArrayOfSize(size);
+			for (size_t i = 0; i < size; i++) {
+				pairs.emplace_back(indices[i], indices[i]);
+			}
+			delete[] indices;
+		}
+		else {
+			for (size_t i = 0; i < size; i++) {
+				pairs.emplace_back(i, i);
+			}
+		}
+		return pairs;
+	}
+
+	template<typename DataType, template<typename> typename NodeAllocator>
+	void RandomlyClearTreeOfSize(avl_tree<int, DataType, NodeAllocator>& avl, size_t size) {
 		const size_t* indices = GetRandomizedArrayOfSize(size);
 
 		for (size_t i = 0; i < size; i++) {
@@ -217,6 +289,28 @@ namespace AVLUtilities {
 
 		delete[] indices;
 	}
+
+	// Fills an avl_tree and a compact_avl_tree with size random keys and logs the bytes each takes per element.
+	// avl_tree is measured by the slab blocks its nodes take, compact_avl_tree by the capacity of its node array.
+	template<typename KeyType, typename DataType>
+	void LogBytesPerElement(const char* typeName, size_t size) {
+		avl_tree<KeyType, DataType> avl;
+		compact_avl_tree<KeyType, DataType> compactAvl;
+		const size_t* indices = GetRandomizedArrayOfSize(size);
+		for (size_t i = 0; i < size; i++) {
+			avl.emplace(static_cast<KeyType>(indices[i]));
+			compactAvl.emplace(static_cast<KeyType>(indices[i]));
+		}
+		delete[] indices;
+
+		const size_t slotsPerBlock = slab_allocator<avl_tree_node<KeyType, DataType>>::nodes_per_block;
+		const double avlBytes = static_cast<double>(avl.get_allocator().allocation_count() * slotsPerBlock * sizeof(avl_tree_node<KeyType, DataType>)) / size;
+		const double compactBytes = static_cast<double>(compactAvl.capacity() * sizeof(compact_avl_tree_node<KeyType, DataType>)) / size;
+		LOG("[AVL Node Size Test: Bytes per Element of " << typeName << " Tree of Size " << size << "]\n"
+			<< "Key + Data: " << sizeof(KeyType) + sizeof(DataType) << "\n"
+			<< "avl_tree: " << sizeof(avl_tree_node<KeyType, DataType>) << " per node, " << avlBytes << " per element\n"
+			<< "compact_avl_tree: " << sizeof(compact_avl_tree_node<KeyType, DataType>) << " per node, " << compactBytes << " per element\n")
+	}
 }
 namespace BSTUtilities{
 	namespace {
@@ -285,6 +379,78 @@ namespace DLLUtilities{
 	}
 }
 
+namespace BalancingUtilities {
+	// A step of a benchmark workload: a search, insert or remove of key.
+	struct Operation {
+		enum Kind { search, insert, remove } kind;
+		int key;
+	};
+
+	// @return count operations on random keys in [0, keySpace), insertPercent of them inserts, removePercent removes and the rest searches.
+	std::vector<Operation> GetWorkload(size_t count, size_t keySpace, unsigned insertPercent, unsigned removePercent) {
+		std::mt19937 random(0);
+		std::vector<Operation> operations;
+		operations.reserve(count);
+		for (size_t i = 0; i < count; i++) {
+			const unsigned roll = random() % 100;
+			const Operation::Kind kind = (roll < insertPercent) ? Operation::insert : (roll < insertPercent + removePercent) ? Operation::remove : Operation::search;
+			operations.push_back({ kind, static_cast<int>(random() % keySpace) });
+		}
+		return operations;
+	}
+
+	template<typename Tree>
+	void Prefill(Tree& tree, size_t prefill, size_t keySpace) {
+		std::mt19937 random(1);
+		for (size_t i = 0; i < prefill; i++) {
+			tree.insert(static_cast<int>(random() % keySpace), 0);
+		}
+	}
+	template<typename Tree>
+	size_t Run(Tree& tree, const std::vector<Operation>& operations) {
+		size_t found = 0;
+		for (const Operation& operation : operations) {
+			switch (operation.kind) {
+				case Operation::search: found += tree.search(operation.key) ? 1 : 0; break;
+				case Operation::insert: found += tree.insert(operation.key, 0) ? 0 : 1; break;
+				case Operation::remove: found += tree.remove(operation.key) ? 1 : 0; break;
+			}
+		}
+		return found;
+	}
+
+	// Times operations on a balanced_tree with Balancing, prefilled with prefill random keys,
+	// then runs them again on a counting tree to log the rotations and rebalancing steps per update.
+	template<typename Balancing>
+	void LogWorkload(const char* policyName, const char* workloadName, const std::vector<Operation>& operations, size_t prefill, size_t keySpace) {
+		size_t iter = 3;
+		size_t checksum = 0;
+		ITERATE_TIMER_START(iter)
+			balanced_tree<int, int, Balancing> tree;
+			Prefill(tree, prefill, keySpace);
+		ITERATE_TIMER_HEADER_END
+			checksum += Run(tree, operations);
+		ITERATE_TIMER_END("Balancing Policy Test: " << policyName << " " << workloadName << " Workload of " << operations.size() << " Operations on Tree of Size " << prefill)
+
+		balanced_tree<int, int, Balancing, slab_allocator, three_way_key_compare, counting_instrumentation> counted;
+		Prefill(counted, prefill, keySpace);
+		counted.instrumentation().reset();
+		checksum -= Run(counted, operations) * iter;
+		const tree_operation_counts counts = counted.instrumentation().counts();
+		const double updates = static_cast<double>(counts.inserts + counts.removes);
+		const tree_stats stats = counted.stats();
+		LOG(policyName << " per update: " << counts.rotations() / updates << " rotations, " << counts.rebalanceSteps / updates << " rebalancing steps. "
+			<< "Final height " << stats.height << ", average depth " << stats.averageDepth << ". Checksum (0 if both runs agree): " << checksum << "\n")
+	}
+	// Runs a workload under every balancing policy.
+	void LogWorkloadForPolicies(const char* workloadName, const std::vector<Operation>& operations, size_t prefill, size_t keySpace) {
+		LogWorkload<avl_balancing>("AVL", workloadName, operations, prefill, keySpace);
+		LogWorkload<red_black_balancing>("Red-Black", workloadName, operations, prefill, keySpace);
+		LogWorkload<wavl_balancing>("WAVL", workloadName, operations, prefill, keySpace);
+		LogWorkload<weight_balancing>("Weight-Balanced", workloadName, operations, prefill, keySpace);
+	}
+}
+
 
 constexpr size_t size = 10000;
 
@@ -338,7 +504,854 @@ int main(int argc, char** args) {
 			avl.remove(randomKeyArray[index]);
 			avl.emplace(randomKeyArray[index], randomKeyArray[index]);
 		ITERATE_TIMER_END("AVL Operation Time Complexity Test: Search/Remove/Insert To Random Tree of Size " << size)
-	
+	}
+
+	//Node Allocator Tests
+	{
+		size_t iter = 100;
+		size_t size = 25000;
+
+		{
+			avl_tree<int, int, heap_allocator> heapAvl = AVLUtilities::CreateRandomTreeOfSize<int, heap_allocator>(size);
+			avl_tree<int, int, slab_allocator> slabAvl = AVLUtilities::CreateRandomTreeOfSize<int, slab_allocator>(size);
+			LOG("[AVL Node Allocator Test: Allocations To Create Random Tree of Size " << size << "]\n"
+				<< "heap_allocator: " << heapAvl.get_allocator().allocation_count() << "\n"
+				<< "slab_allocator: " << slabAvl.get_allocator().allocation_count() << "\n")
+		}
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			avl_tree<int, int, heap_allocator> avl = AVLUtilities::CreateRandomTreeOfSize<int, heap_allocator>(size);
+			AVLUtilities::RandomlyClearTreeOfSize(avl, size / 2);
+			avl.clear();
+		HEADLESS_ITERATE_TIMER_END("AVL heap_allocator Test: Create Random Tree of Size " << size << ", Remove Half, then Clear")
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			avl_tree<int, int, slab_allocator> avl = AVLUtilities::CreateRandomTreeOfSize<int, slab_allocator>(size);
+			AVLUtilities::RandomlyClearTreeOfSize(avl, size / 2);
+			avl.clear();
+		HEADLESS_ITERATE_TIMER_END("AVL slab_allocator Test: Create Random Tree of Size " << size << ", Remove Half, then Clear")
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			avl_tree<int, Tracer, heap_allocator> avl = AVLUtilities::CreateRandomTreeOfSize<Tracer, heap_allocator>(size);
+			AVLUtilities::RandomlyClearTreeOfSize(avl, size / 2);
+			avl.clear();
+		HEADLESS_ITERATE_TIMER_END("AVL heap_allocator Test: Create Random Tracer Tree of Size " << size << ", Remove Half, then Clear")
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			avl_tree<int, Tracer, slab_allocator> avl = AVLUtilities::CreateRandomTreeOfSize<Tracer, slab_allocator>(size);
+			AVLUtilities::RandomlyClearTreeOfSize(avl, size / 2);
+			avl.clear();
+		HEADLESS_ITERATE_TIMER_END("AVL slab_allocator Test: Create Random Tracer Tree of Size " << size << ", Remove Half, then Clear")
+	}
+
+	//Node Size Tests
+	{
+		size_t iter = 20;
+		size_t size = 1000000;
+
+		AVLUtilities::LogBytesPerElement<int, int>("<int, int>", size);
+		AVLUtilities::LogBytesPerElement<int64_t, int64_t>("<int64_t, int64_t>", size);
+		AVLUtilities::LogBytesPerElement<int, std::string>("<int, std::string>", size);
+		AVLUtilities::LogBytesPerElement<int64_t, std::array<char, 64>>("<int64_t, std::array<char, 64>>", size);
+
+		avl_tree<int, int> avl = AVLUtilities::CreateRandomTreeOfSize<int>(size);
+		compact_avl_tree<int, int> compactAvl;
+		for (const avl_tree_node<int, int>& node : avl) {
+			compactAvl.insert(node.key, node.data);
+		}
+		const size_t* searchKeys = AVLUtilities::GetRandomizedArrayOfSize(size);
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (size_t i = 0; i < size; i++) {
+				avl.search(static_cast<int>(searchKeys[i]));
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL Node Size Test: avl_tree search() of Each Key in Random Tree of Size " << size)
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (size_t i = 0; i < size; i++) {
+				compactAvl.search(static_cast<int>(searchKeys[i]));
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL Node Size Test: compact_avl_tree search() of Each Key in Random Tree of Size " << size)
+		delete[] searchKeys;
+	}
+
+	//Cold Data Tests
+	{
+		size_t iter = 20;
+		size_t size = 1000000;
+
+		avl_tree<int, InlineRecord> inlineAvl = AVLUtilities::CreateRandomTreeOfSize<InlineRecord>(size);
+		avl_tree<int, Record> coldAvl = AVLUtilities::CreateRandomTreeOfSize<Record>(size);
+		const size_t* searchKeys = AVLUtilities::GetRandomizedArrayOfSize(size);
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (size_t i = 0; i < size; i++) {
+				inlineAvl.search(static_cast<int>(searchKeys[i]));
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL Cold Data Test: search() of Each Key in Random Tree of Size " << size << " with " << sizeof(InlineRecord) << " Byte Data in the Nodes")
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (size_t i = 0; i < size; i++) {
+				coldAvl.search(static_cast<int>(searchKeys[i]));
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL Cold Data Test: search() of Each Key in Random Tree of Size " << size << " with " << sizeof(Record) << " Byte Data out of Line")
+		delete[] searchKeys;
+	}
+
+	//Bulk Load Tests
+	{
+		size_t iter = 100;
+		size_t size = 100000;
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			avl_tree<int, int> avl = AVLUtilities::CreateRandomTreeOfSize<int>(size);
+		HEADLESS_ITERATE_TIMER_END("AVL Bulk Load Test: Emplace Loop of Size " << size)
+
+		const std::vector<std::pair<int, int>> sortedPairs = AVLUtilities::GetKeyDataPairsOfSize(size, false);
+		HEADLESS_ITERATE_TIMER_START(iter)
+			avl_tree<int, int> avl(sortedPairs.begin(), sortedPairs.end());
+		HEADLESS_ITERATE_TIMER_END("AVL Bulk Load Test: Sorted Range of Size " << size)
+
+		const std::vector<std::pair<int, int>> shuffledPairs = AVLUtilities::GetKeyDataPairsOfSize(size, true);
+		HEADLESS_ITERATE_TIMER_START(iter)
+			avl_tree<int, int> avl(shuffledPairs.begin(), shuffledPairs.end());
+		HEADLESS_ITERATE_TIMER_END("AVL Bulk Load Test: Shuffled Range of Size " << size)
+	}
+
+	//Restart Tests
+	{
+		size_t iter = 10;
+		size_t size = 1000000;
+		size_t lookupCount = 10000;
+		const char* imagePath = "avl_tree_image.bin";
+
+		avl_tree<int, int> avl = AVLUtilities::CreateRandomTreeOfSize<int>(size);
+		avl.save(imagePath);
+		const size_t* keys = AVLUtilities::GetRandomizedArrayOfSize(size);
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			avl_tree<int, int> restarted;
+			for (size_t i = 0; i < size; i++) {
+				restarted.emplace(keys[i], keys[i]);
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL Restart Test: Reinsert Every Key of Tree of Size " << size)
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			avl.save(imagePath);
+		HEADLESS_ITERATE_TIMER_END("AVL Restart Test: save() of Tree of Size " << size)
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			avl_tree<int, int> restarted;
+			restarted.load(imagePath);
+		HEADLESS_ITERATE_TIMER_END("AVL Restart Test: load() of Tree of Size " << size)
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			mapped_avl_tree<int, int> image(imagePath);
+			for (size_t i = 0; i < lookupCount; i++) {
+				image.search(static_cast<int>(keys[i]));
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL Restart Test: Map Image of Tree of Size " << size << " and Serve " << lookupCount << " Lookups")
+		delete[] keys;
+		std::remove(imagePath);
+	}
+
+	//Mostly Sorted Insert Tests
+	{
+		size_t iter = 20;
+		size_t size = 1000000;
+		size_t window = 16;
+
+		const size_t* sortedKeys = AVLUtilities::GetNearlySortedArrayOfSize(size, 1);
+		const size_t* nearlySortedKeys = AVLUtilities::GetNearlySortedArrayOfSize(size, window);
+		for (const size_t* keys : { sortedKeys, nearlySortedKeys }) {
+			const char* streamName = (keys == sortedKeys) ? "Monotonic" : "Nearly Monotonic";
+
+			HEADLESS_ITERATE_TIMER_START(iter)
+				avl_tree<int, int> avl;
+				for (size_t i = 0; i < size; i++) {
+					avl.emplace(keys[i], keys[i]);
+				}
+			HEADLESS_ITERATE_TIMER_END("AVL Mostly Sorted Insert Test: emplace() of " << streamName << " Stream of Size " << size)
+
+			HEADLESS_ITERATE_TIMER_START(iter)
+				avl_tree<int, int> avl;
+				for (size_t i = 0; i < size; i++) {
+					avl.emplace_hint(avl.end(), keys[i], keys[i]);
+				}
+			HEADLESS_ITERATE_TIMER_END("AVL Mostly Sorted Insert Test: emplace_hint(end()) of " << streamName << " Stream of Size " << size)
+
+			HEADLESS_ITERATE_TIMER_START(iter)
+				avl_tree<int, int> avl;
+				avl.set_finger_search(true);
+				for (size_t i = 0; i < size; i++) {
+					avl.emplace(keys[i], keys[i]);
+				}
+			HEADLESS_ITERATE_TIMER_END("AVL Mostly Sorted Insert Test: Finger Search emplace() of " << streamName << " Stream of Size " << size)
+		}
+		delete[] sortedKeys;
+		delete[] nearlySortedKeys;
+	}
+
+	//Set Operation Tests
+	{
+		size_t iter = 20;
+		size_t size = 1000000;
+		thread_pool singleThreadPool(0);
+
+		ITERATE_TIMER_START(iter)
+			avl_tree<int, int> avl = AVLUtilities::CreateRandomTreeOfSize<int>(size);
+			avl_tree<int, int> other = AVLUtilities::CreateRandomTreeOfSize<int>(size);
+		ITERATE_TIMER_HEADER_END
+			for (const avl_tree_node<int, int>& node : other) {
+				avl.insert(node.key, node.data);
+			}
+		ITERATE_TIMER_END("AVL Set Operation Test: Insert Loop Union of Two Trees of Size " << size)
+
 		ITERATE_TIMER_START(iter)
+			avl_tree<int, int> avl = AVLUtilities::CreateRandomTreeOfSize<int>(size);
+			avl_tree<int, int> other = AVLUtilities::CreateRandomTreeOfSize<int>(size);
+		ITERATE_TIMER_HEADER_END
+			avl.union_with(std::move(other), singleThreadPool);
+		ITERATE_TIMER_END("AVL Set Operation Test: union_with() of Two Trees of Size " << size << " on 1 Thread")
+
+		ITERATE_TIMER_START(iter)
+			avl_tree<int, int> avl = AVLUtilities::CreateRandomTreeOfSize<int>(size);
+			avl_tree<int, int> other = AVLUtilities::CreateRandomTreeOfSize<int>(size);
+		ITERATE_TIMER_HEADER_END
+			avl.union_with(std::move(other));
+		ITERATE_TIMER_END("AVL Set Operation Test: union_with() of Two Trees of Size " << size << " on " << (thread_pool::shared().thread_count() + 1) << " Threads")
+
+		ITERATE_TIMER_START(iter)
+			avl_tree<int, int> avl = AVLUtilities::CreateRandomTreeOfSize<int>(size);
+			avl_tree<int, int> other = AVLUtilities::CreateRandomTreeOfSize<int>(size / 2);
+		ITERATE_TIMER_HEADER_END
+			avl.intersect_with(std::move(other));
+		ITERATE_TIMER_END("AVL Set Operation Test: intersect_with() of Trees of Size " << size << " and " << size / 2 << " on " << (thread_pool::shared().thread_count() + 1) << " Threads")
+
+		ITERATE_TIMER_START(iter)
+			avl_tree<int, int> avl = AVLUtilities::CreateRandomTreeOfSize<int>(size);
+			avl_tree<int, int> other = AVLUtilities::CreateRandomTreeOfSize<int>(size / 2);
+		ITERATE_TIMER_HEADER_END
+			avl.difference_with(std::move(other));
+		ITERATE_TIMER_END("AVL Set Operation Test: difference_with() of Trees of Size " << size << " and " << size / 2 << " on " << (thread_pool::shared().thread_count() + 1) << " Threads")
+	}
+
+	//Copy Tests
+	{
+		size_t iter = 20;
+		size_t size = 1000000;
+		thread_pool singleThreadPool(0);
+
+		avl_tree<int, int> avl = AVLUtilities::CreateRandomTreeOfSize<int>(size);
+		binary_search_tree<int, Tracer> bst = BSTUtilities::CreateRandomTreeOfSize(size);
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			avl_tree<int, int> copy(avl, singleThreadPool);
+		HEADLESS_ITERATE_TIMER_END("AVL Copy Test: Copy of Tree of Size " << size << " on 1 Thread")
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			avl_tree<int, int> copy(avl);
+		HEADLESS_ITERATE_TIMER_END("AVL Copy Test: Copy of Tree of Size " << size << " on " << (thread_pool::shared().thread_count() + 1) << " Threads")
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			binary_search_tree<int, Tracer> copy(bst, singleThreadPool);
+		HEADLESS_ITERATE_TIMER_END("BST Copy Test: Copy of Tree of Size " << size << " on 1 Thread")
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			binary_search_tree<int, Tracer> copy(bst);
+		HEADLESS_ITERATE_TIMER_END("BST Copy Test: Copy of Tree of Size " << size << " on " << (thread_pool::shared().thread_count() + 1) << " Threads")
+	}
+
+	//Range Aggregate Tests
+	{
+		size_t iter = 20;
+		size_t size = 1000000;
+		size_t queryCount = 1000;
+		int rangeWidth = static_cast<int>(size / 10);
+
+		avl_tree<int, int> avl = AVLUtilities::CreateRandomTreeOfSize<int>(size);
+		avl_tree<int, int64_t, slab_allocator, three_way_key_compare, sum_augmentation<int64_t>> summedAvl;
+		for (const avl_tree_node<int, int>& node : avl) {
+			summedAvl.insert(node.key, node.data);
+		}
+		const size_t* lows = AVLUtilities::GetRandomizedArrayOfSize(queryCount);
+		int64_t checksum = 0;
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (size_t i = 0; i < queryCount; i++) {
+				const int low = static_cast<int>(lows[i] * (size / queryCount));
+				for (const avl_tree_node<int, int>& node : avl.range(low, low + rangeWidth)) {
+					checksum += node.data;
+				}
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL Range Aggregate Test: " << queryCount << " Sums over range() of " << rangeWidth << " Keys in Tree of Size " << size)
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (size_t i = 0; i < queryCount; i++) {
+				const int low = static_cast<int>(lows[i] * (size / queryCount));
+				checksum -= summedAvl.aggregate(low, low + rangeWidth);
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL Range Aggregate Test: " << queryCount << " Sums with aggregate() of " << rangeWidth << " Keys in Tree of Size " << size)
+		LOG("Checksum (0 if both agree): " << checksum << "\n")
+		delete[] lows;
+	}
+
+	//Interval Tree Tests
+	{
+		size_t iter = 5;
+		size_t size = 100000;
+		size_t queryCount = 100;
+
+		// Starts are about 100 points apart and intervals are up to 100 points long, so a stabbing query finds zero to a few intervals.
+		std::mt19937 random(0);
+		avl_tree<int, int> startTree;
+		interval_tree<int, int> intervalTree;
+		for (size_t i = 0; i < size; i++) {
+			const int low = static_cast<int>(random() % (size * 100));
+			const int high = low + static_cast<int>(random() % 100);
+			if (startTree.insert(low, high)) {
+				intervalTree.insert({ low, high }, high);
+			}
+		}
+		std::vector<int> points;
+		for (size_t i = 0; i < queryCount; i++) {
+			points.push_back(static_cast<int>(random() % (size * 100)));
+		}
+		size_t checksum = 0;
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (int point : points) {
+				for (const avl_tree_node<int, int>& node : startTree) {
+					if (node.key <= point && point <= node.data) {
+						checksum++;
+					}
+				}
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL Interval Test: " << queryCount << " Stabbing Queries by Scanning a Tree of Size " << size << " Keyed by Start")
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (int point : points) {
+				for (const auto& node : intervalTree.stabbing(point)) {
+					checksum -= (node.key.low <= point) ? 1 : 0;
+				}
+			}
+		HEADLESS_ITERATE_TIMER_END("Interval Tree Test: " << queryCount << " stabbing() Queries on Tree of Size " << size)
+		LOG("Checksum (0 if both agree): " << checksum << "\n")
+	}
+
+	//Instrumentation Tests
+	{
+		size_t iter = 5;
+		size_t size = 1000000;
+
+		using CountedAvl = avl_tree<int, int, slab_allocator, three_way_key_compare, no_augmentation, counting_instrumentation>;
+		using CountedBst = binary_search_tree<int, int, three_way_key_compare, counting_instrumentation>;
+		const size_t* keys = AVLUtilities::GetRandomizedArrayOfSize(size);
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			avl_tree<int, int> avl;
+			for (size_t i = 0; i < size; i++) {
+				avl.insert(static_cast<int>(keys[i]), 0);
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL Instrumentation Test: Insert " << size << " Random Keys without Counters")
+		HEADLESS_ITERATE_TIMER_START(iter)
+			CountedAvl avl;
+			for (size_t i = 0; i < size; i++) {
+				avl.insert(static_cast<int>(keys[i]), 0);
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL Instrumentation Test: Insert " << size << " Random Keys with Counters")
+
+		// Per operation averages to hold against the bounds in the README, log2(10^6) is about 20.
+		CountedAvl avl;
+		CountedBst bst;
+		for (size_t i = 0; i < size; i++) {
+			avl.insert(static_cast<int>(keys[i]), 0);
+			bst.insert(static_cast<int>(keys[i]), 0);
+		}
+		for (size_t i = 0; i < size; i += 2) {
+			avl.remove(static_cast<int>(keys[i]));
+			bst.remove(static_cast<int>(keys[i]));
+		}
+		const tree_operation_counts avlCounts = avl.instrumentation().counts();
+		const tree_operation_counts bstCounts = bst.instrumentation().counts();
+		const double operations = static_cast<double>(avlCounts.operations());
+		LOG("AVL per operation: " << avlCounts.comparisons / operations << " comparisons, " << avlCounts.nodesVisited / operations << " visits, "
+			<< avlCounts.rotations() / operations << " rotations (" << avlCounts.leftRotations << " L, " << avlCounts.rightRotations << " R, "
+			<< avlCounts.leftRightRotations << " LR, " << avlCounts.rightLeftRotations << " RL), " << avlCounts.rebalanceSteps / operations << " rebalancing steps")
+		LOG("BST per operation: " << bstCounts.comparisons / operations << " comparisons, " << bstCounts.nodesVisited / operations << " visits")
+		const tree_stats avlStats = avl.stats();
+		const tree_stats bstStats = bst.stats();
+		LOG("AVL shape: " << avlStats.size << " nodes, height " << avlStats.height << ", average depth " << avlStats.averageDepth << ", " << avlStats.memoryBytes << " bytes")
+		LOG("BST shape: " << bstStats.size << " nodes, height " << bstStats.height << ", average depth " << bstStats.averageDepth << ", " << bstStats.memoryBytes << " bytes\n")
+		delete[] keys;
+	}
+
+	//B+ Tree Tests
+	{
+		size_t iter = 5;
+		size_t size = 1000000;
+		size_t scanLength = 1000;
+
+		using BPlusTree = b_plus_tree<int, int>;
+
+		const size_t* keys = AVLUtilities::GetRandomizedArrayOfSize(size);
+		const size_t* searchKeys = AVLUtilities::GetRandomizedArrayOfSize(size);
+		size_t checksum = 0;
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			avl_tree<int, int> avl;
+			for (size_t i = 0; i < size; i++) {
+				avl.insert(static_cast<int>(keys[i]), 0);
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL B+ Tree Test: avl_tree Insert " << size << " Random Keys")
+		HEADLESS_ITERATE_TIMER_START(iter)
+			BPlusTree bPlus;
+			for (size_t i = 0; i < size; i++) {
+				bPlus.insert(static_cast<int>(keys[i]), 0);
+			}
+		HEADLESS_ITERATE_TIMER_END("B+ Tree Test: b_plus_tree Insert " << size << " Random Keys")
+
+		avl_tree<int, int> avl;
+		BPlusTree bPlus;
+		for (size_t i = 0; i < size; i++) {
+			avl.insert(static_cast<int>(keys[i]), static_cast<int>(i));
+			bPlus.insert(static_cast<int>(keys[i]), static_cast<int>(i));
+		}
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (size_t i = 0; i < size; i++) {
+				checksum += avl.search(static_cast<int>(searchKeys[i]))->data;
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL B+ Tree Test: avl_tree search() of Each Key in Random Tree of Size " << size)
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (size_t i = 0; i < size; i++) {
+				checksum -= bPlus.search(static_cast<int>(searchKeys[i]))->data;
+			}
+		HEADLESS_ITERATE_TIMER_END("B+ Tree Test: b_plus_tree search() of Each Key in Random Tree of Size " << size)
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (size_t i = 0; i < size; i += scanLength) {
+				const int low = static_cast<int>(searchKeys[i]);
+				for (const avl_tree_node<int, int>& node : avl.range(low, low + static_cast<int>(scanLength))) {
+					checksum += node.data;
+				}
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL B+ Tree Test: avl_tree range() Scans of " << scanLength << " Keys in Random Tree of Size " << size)
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (size_t i = 0; i < size; i += scanLength) {
+				const int low = static_cast<int>(searchKeys[i]);
+				for (const auto& entry : bPlus.range(low, low + static_cast<int>(scanLength))) {
+					checksum -= entry.data;
+				}
+			}
+		HEADLESS_ITERATE_TIMER_END("B+ Tree Test: b_plus_tree range() Scans of " << scanLength << " Keys in Random Tree of Size " << size)
+
+		const tree_stats avlStats = avl.stats();
+		const tree_stats bPlusStats = bPlus.stats();
+		LOG("avl_tree shape: height " << avlStats.height << ", " << avlStats.memoryBytes << " bytes")
+		LOG("b_plus_tree shape: height " << bPlusStats.height << ", " << bPlusStats.memoryBytes << " bytes, " << BPlusTree::leaf_capacity
+			<< " elements per leaf, " << BPlusTree::inner_capacity << " keys per inner node")
+		LOG("Checksum (0 if both agree): " << checksum << "\n")
+		delete[] keys;
+		delete[] searchKeys;
+	}
+
+	//Balancing Policy Tests
+	{
+		size_t count = 1000000;
+		size_t keySpace = 1 << 20;
+
+		// Inserts into a growing tree, removes from a shrinking one, and an even mix of searches and updates on a tree that stays the same size.
+		BalancingUtilities::LogWorkloadForPolicies("Insert-Heavy", BalancingUtilities::GetWorkload(count, keySpace, 90, 10), 0, keySpace);
+		BalancingUtilities::LogWorkloadForPolicies("Delete-Heavy", BalancingUtilities::GetWorkload(count, keySpace, 10, 90), count, keySpace);
+		BalancingUtilities::LogWorkloadForPolicies("Mixed", BalancingUtilities::GetWorkload(count, keySpace, 25, 25), count / 2, keySpace);
+	}
+
+	//Batched Search Tests
+	{
+		size_t iter = 5;
+		size_t size = 1000000;
+
+		const size_t* keys = AVLUtilities::GetRandomizedArrayOfSize(size);
+		const size_t* searchKeys = AVLUtilities::GetRandomizedArrayOfSize(size);
+		std::vector<int> lookupKeys(searchKeys, searchKeys + size);
+		size_t checksum = 0;
+
+		avl_tree<int, int> avl;
+		binary_search_tree<int, int> bst;
+		for (size_t i = 0; i < size; i++) {
+			avl.insert(static_cast<int>(keys[i]), static_cast<int>(i));
+			bst.insert(static_cast<int>(keys[i]), static_cast<int>(i));
+		}
+		std::vector<avl_tree_node<int, int>*> avlResults(size);
+		std::vector<binary_search_tree_node<int, int>*> bstResults(size);
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (size_t i = 0; i < size; i++) {
+				avlResults[i] = avl.search(lookupKeys[i]);
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL Batched Search Test: search() in a Loop of " << size << " Keys in Random Tree of Size " << size)
+		HEADLESS_ITERATE_TIMER_START(iter)
+			checksum += avl.search_many(lookupKeys, avlResults.begin());
+		HEADLESS_ITERATE_TIMER_END("AVL Batched Search Test: search_many() of " << size << " Keys in Random Tree of Size " << size)
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (size_t i = 0; i < size; i++) {
+				bstResults[i] = bst.search(lookupKeys[i]);
+			}
+		HEADLESS_ITERATE_TIMER_END("BST Batched Search Test: search() in a Loop of " << size << " Keys in Random Tree of Size " << size)
+		HEADLESS_ITERATE_TIMER_START(iter)
+			checksum -= bst.search_many(lookupKeys, bstResults.begin());
+		HEADLESS_ITERATE_TIMER_END("BST Batched Search Test: search_many() of " << size << " Keys in Random Tree of Size " << size)
+
+		LOG("Checksum (0 if both agree): " << checksum << "\n")
+		delete[] keys;
+		delete[] searchKeys;
+	}
+
+	//Upsert Tests
+	{
+		size_t iter = 5;
+		size_t size = 1000000;
+
+		// Half of the keys are already in the tree.
+		const size_t* keys = AVLUtilities::GetRandomizedArrayOfSize(size);
+		const size_t* upsertKeys = AVLUtilities::GetRandomizedArrayOfSize(2 * size);
+		size_t checksum = 0;
+
+		ITERATE_TIMER_START(iter)
+			avl_tree<int, int> avl;
+			for (size_t i = 0; i < size; i++) {
+				avl.insert(static_cast<int>(keys[i]), 0);
+			}
+		ITERATE_TIMER_HEADER_END
+			for (size_t i = 0; i < size; i++) {
+				const int key = static_cast<int>(upsertKeys[i]);
+				avl_tree_node<int, int>* node = avl.search(key);
+				if (!node) {
+					avl.emplace(key, 0);
+					node = avl.search(key);
+				}
+				checksum += ++node->data;
+			}
+		ITERATE_TIMER_END("AVL Upsert Test: search() Then emplace() of " << size << " Keys into Random Tree of Size " << size)
+		ITERATE_TIMER_START(iter)
+			avl_tree<int, int> avl;
+			for (size_t i = 0; i < size; i++) {
+				avl.insert(static_cast<int>(keys[i]), 0);
+			}
+		ITERATE_TIMER_HEADER_END
+			for (size_t i = 0; i < size; i++) {
+				checksum -= ++avl.try_emplace(static_cast<int>(upsertKeys[i]), 0).first->data;
+			}
+		ITERATE_TIMER_END("AVL Upsert Test: try_emplace() of " << size << " Keys into Random Tree of Size " << size)
+
+		LOG("Checksum (0 if both agree): " << checksum << "\n")
+		delete[] keys;
+		delete[] upsertKeys;
+	}
+
+	//Copy-on-Write Tests
+	{
+		size_t iter = 3;
+		size_t size = 1000000;
+		size_t copyCount = 100;
+
+		avl_tree<int, int> avl = AVLUtilities::CreateRandomTreeOfSize<int>(size);
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			std::vector<avl_tree<int, int>> copies(copyCount, avl);
+		HEADLESS_ITERATE_TIMER_END("AVL Copy-on-Write Test: " << copyCount << " Deep Copies of Random Tree of Size " << size)
+
+		avl.set_copy_on_write(true);
+		HEADLESS_ITERATE_TIMER_START(iter)
+			std::vector<avl_tree<int, int>> copies(copyCount, avl);
+		HEADLESS_ITERATE_TIMER_END("AVL Copy-on-Write Test: " << copyCount << " Shared Copies of Random Tree of Size " << size)
+
+		ITERATE_TIMER_START(iter)
+			std::vector<avl_tree<int, int>> copies(copyCount, avl);
+		ITERATE_TIMER_HEADER_END
+			copies.front().insert(-1, 0);
+		ITERATE_TIMER_END("AVL Copy-on-Write Test: First Insert into a Shared Copy of Random Tree of Size " << size)
+	}
+
+	//Parallel Traversal Tests
+	{
+		size_t iter = 5;
+		size_t size = 1000000;
+		size_t maxThreadCount = (std::thread::hardware_concurrency() > 0) ? std::thread::hardware_concurrency() : 1;
+
+		const size_t* keys = AVLUtilities::GetRandomizedArrayOfSize(size);
+		avl_tree<int, int> avl;
+		binary_search_tree<int, int> bst;
+		for (size_t i = 0; i < size; i++) {
+			avl.insert(static_cast<int>(keys[i]), 0);
+			bst.insert(static_cast<int>(keys[i]), 0);
+		}
+		long long sum = 0;
+		size_t evenCount = 0;
+		long long checksum = 0;
+
+		// for_each() recomputes data from the key, which is what the sums below add up.
+		avl.for_each([](avl_tree_node<int, int>& node) { node.data = node.key; });
+		bst.for_each([](binary_search_tree_node<int, int>& node) { node.data = node.key; });
+		HEADLESS_ITERATE_TIMER_START(iter)
+			sum = 0;
+			evenCount = 0;
+			for (const avl_tree_node<int, int>& node : avl) {
+				sum += node.data;
+				evenCount += (node.key % 2 == 0) ? 1 : 0;
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL Parallel Traversal Test: Single Threaded Iterator Sum over Random Tree of Size " << size)
+
+		// The thread calling join() works too, so a pool of threadCount - 1 workers runs on threadCount threads.
+		for (size_t threadCount = 1; threadCount <= maxThreadCount; threadCount *= 2) {
+			thread_pool pool(threadCount - 1);
+			HEADLESS_ITERATE_TIMER_START(iter)
+				avl.for_each([](avl_tree_node<int, int>& node) { node.data = node.key; }, pool);
+			HEADLESS_ITERATE_TIMER_END("AVL Parallel Traversal Test: for_each() over Random Tree of Size " << size << " on " << threadCount << " Threads")
+			HEADLESS_ITERATE_TIMER_START(iter)
+				checksum += avl.transform_reduce(0LL, std::plus<long long>(), [](const avl_tree_node<int, int>& node) { return static_cast<long long>(node.data); }, pool) - sum;
+			HEADLESS_ITERATE_TIMER_END("AVL Parallel Traversal Test: transform_reduce() Sum over Random Tree of Size " << size << " on " << threadCount << " Threads")
+			HEADLESS_ITERATE_TIMER_START(iter)
+				checksum += static_cast<long long>(avl.count_if([](const avl_tree_node<int, int>& node) { return node.key % 2 == 0; }, pool) - evenCount);
+			HEADLESS_ITERATE_TIMER_END("AVL Parallel Traversal Test: count_if() over Random Tree of Size " << size << " on " << threadCount << " Threads")
+
+			HEADLESS_ITERATE_TIMER_START(iter)
+				bst.for_each([](binary_search_tree_node<int, int>& node) { node.data = node.key; }, pool);
+			HEADLESS_ITERATE_TIMER_END("BST Parallel Traversal Test: for_each() over Random Tree of Size " << size << " on " << threadCount << " Threads")
+			HEADLESS_ITERATE_TIMER_START(iter)
+				checksum += bst.transform_reduce(0LL, std::plus<long long>(), [](const binary_search_tree_node<int, int>& node) { return static_cast<long long>(node.data); }, pool) - sum;
+			HEADLESS_ITERATE_TIMER_END("BST Parallel Traversal Test: transform_reduce() Sum over Random Tree of Size " << size << " on " << threadCount << " Threads")
+			HEADLESS_ITERATE_TIMER_START(iter)
+				checksum += static_cast<long long>(bst.count_if([](const binary_search_tree_node<int, int>& node) { return node.key % 2 == 0; }, pool) - evenCount);
+			HEADLESS_ITERATE_TIMER_END("BST Parallel Traversal Test: count_if() over Random Tree of Size " << size << " on " << threadCount << " Threads")
+		}
+
+		LOG("Checksum (0 if all agree): " << checksum << "\n")
+		delete[] keys;
+	}
+
+	//Range Bounds Tests
+	{
+		avl_tree<int, int> avl;
+		for (int key = 1; key <= 3; key++) {
+			avl.insert(key, key);
+		}
+		// Counts the elements range(low, high) yields that a linear scan of [low, high) doesn't agree with.
+		auto countMismatches = [&avl](int low, int high) {
+			size_t mismatches = 0;
+			size_t expected = 0;
+			for (const avl_tree_node<int, int>& node : avl) {
+				expected += (low <= node.key && node.key < high) ? 1 : 0;
+			}
+			size_t visited = 0;
+			for (const avl_tree_node<int, int>& node : avl.range(low, high)) {
+				mismatches += (low <= node.key && node.key < high) ? 0 : 1;
+				visited++;
+			}
+			return mismatches + ((visited > expected) ? visited - expected : expected - visited);
+		};
+		size_t mismatches = 0;
+		// Inverted and empty bounds, inside the keys and past either end of them.
+		for (int low = -1; low <= 10; low++) {
+			for (int high = -1; high <= 10; high++) {
+				mismatches += countMismatches(low, high);
+			}
+		}
+		mismatches += countMismatches(10, 2) + countMismatches(2, -5) + countMismatches(10, -5);
+		LOG("[AVL Range Bounds Test: range(low, high) over Every Pair of Bounds in [-1, 10]]\nMismatches (0 if correct): " << mismatches << "\n")
+	}
+
+	//Mixed Integer Key Tests
+	{
+		avl_tree<int, int> avl;
+		binary_search_tree<int, int> bst;
+		b_plus_tree<int, int> bPlus;
+		for (int key = -20; key <= 20; key++) {
+			avl.insert(key, key);
+			bst.insert(key, key);
+			bPlus.insert(key, key);
+		}
+		// Lookup keys of other integer types are compared with the int keys by value, not under the usual arithmetic conversions.
+		size_t misses = 0;
+		for (unsigned int key = 0; key <= 20; key++) {
+			misses += avl.search(key) ? 0 : 1;
+			misses += bst.search(static_cast<size_t>(key)) ? 0 : 1;
+			misses += (bPlus.search(static_cast<uint64_t>(key)) != bPlus.end()) ? 0 : 1;
+			misses += (avl.lower_bound(static_cast<size_t>(key))->key == static_cast<int>(key)) ? 0 : 1;
+		}
+		for (size_t key = 0; key <= 20; key += 5) {
+			misses += avl.remove(key) ? 0 : 1;
+			misses += bst.remove(key) ? 0 : 1;
+		}
+		misses += (avl.size() == 36 && bst.size() == 36) ? 0 : 1;
+
+		// Keys out of the range of int are misses and bounds, not truncated to an int key.
+		const int64_t truncatesToOne = (int64_t(1) << 32) | 1;
+		misses += (avl.search(truncatesToOne) || bst.search(truncatesToOne) || bPlus.search(truncatesToOne) != bPlus.end()) ? 1 : 0;
+		misses += (avl.lower_bound(int64_t(1) << 40) == avl.end() && avl.upper_bound(-(int64_t(1) << 40)) == avl.begin()) ? 0 : 1;
+
+		avl_tree<unsigned int, int> unsignedAvl;
+		for (unsigned int key = 0; key <= 20; key++) {
+			unsignedAvl.insert(key, 0);
+		}
+		unsignedAvl.insert(std::numeric_limits<unsigned int>::max(), 0);
+		misses += (unsignedAvl.search(-1) || unsignedAvl.remove(-1) || unsignedAvl.lower_bound(-1)->key != 0) ? 1 : 0;
+
+		// Floating point keys don't compile, instead of being truncated to the int key below them.
+		misses += (lookup_key_for<double, three_way_key_compare, int> || lookup_key_for<double, std::less<int>, int>) ? 1 : 0;
+		LOG("[Mixed Integer Key Test: Other Integer Type Lookups in Trees of int Keys in [-20, 20]]\nMisses (0 if correct): " << misses << "\n")
+	}
+
+	//Snapshot Tests
+	{
+		size_t iter = 20;
+		size_t size = 1000000;
+		size_t updateCount = 10000;
+
+		avl_tree<int, int> avl = AVLUtilities::CreateRandomTreeOfSize<int>(size);
+		persistent_avl_tree<int, int> persistentAvl;
+		for (const avl_tree_node<int, int>& node : avl) {
+			persistentAvl.insert(node.key, node.data);
+		}
+		const size_t* updateKeys = AVLUtilities::GetRandomizedArrayOfSize(updateCount);
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			avl_tree<int, int> copy(avl);
+		HEADLESS_ITERATE_TIMER_END("AVL Snapshot Test: Copy Constructor of Tree of Size " << size)
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			persistent_avl_tree<int, int> snapshot = persistentAvl.snapshot();
+		HEADLESS_ITERATE_TIMER_END("Persistent AVL Snapshot Test: snapshot() of Tree of Size " << size)
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (size_t i = 0; i < updateCount; i++) {
+				persistentAvl.insert_or_assign(static_cast<int>(updateKeys[i]), static_cast<int>(i));
+			}
+		HEADLESS_ITERATE_TIMER_END("Persistent AVL Snapshot Test: " << updateCount << " insert_or_assign() on Tree of Size " << size << " without Snapshots")
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			persistent_avl_tree<int, int> snapshot = persistentAvl.snapshot();
+			for (size_t i = 0; i < updateCount; i++) {
+				persistentAvl.insert_or_assign(static_cast<int>(updateKeys[i]), static_cast<int>(i));
+			}
+		HEADLESS_ITERATE_TIMER_END("Persistent AVL Snapshot Test: " << updateCount << " insert_or_assign() on Tree of Size " << size << " with a Live Snapshot")
+		delete[] updateKeys;
+	}
+
+	//String Key Scan Tests
+	{
+		size_t iter = 20;
+		size_t size = 1000000;
+
+		// Keys share a long prefix so every key comparison has to look at most of the string.
+		std::vector<std::string> keys;
+		keys.reserve(size);
+		std::mt19937 random(0);
+		for (size_t i = 0; i < size; i++) {
+			keys.push_back("string_key_with_a_long_shared_prefix_" + std::to_string(random()));
+		}
+		avl_tree<std::string, int> avl;
+		binary_search_tree<std::string, int> bst;
+		for (size_t i = 0; i < size; i++) {
+			avl.insert(keys[i], static_cast<int>(i));
+			bst.insert(keys[i], static_cast<int>(i));
+		}
+
+		// Scans the whole tree iter times and reports elements visited per second.
+		auto runScan = [&](const char* treeName, auto& tree) {
+			long long checksum = 0;
+			size_t visited = 0;
+			auto startTime = std::chrono::high_resolution_clock::now();
+			for (size_t i = 0; i < iter; i++) {
+				for (auto& node : tree) {
+					checksum += node.data;
+					visited++;
+				}
+			}
+			const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+			LOG("[" << treeName << " String Key Scan Test: Full In-Order Scan of Size " << visited / iter << " (checksum " << checksum << ")]\nThroughput: "
+				<< static_cast<size_t>(visited / seconds) << " elements/s\n")
+		};
+		runScan("AVL", avl);
+		runScan("BST", bst);
+
+		// Transparent lookups compare the string_view with the keys directly, instead of building a std::string per lookup.
+		std::vector<std::string_view> lookupKeys(keys.begin(), keys.end());
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (std::string_view key : lookupKeys) {
+				avl.search(std::string(key));
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL String Key Lookup Test: search() of std::string Built From std::string_view for Each of " << size << " Keys")
+
+		HEADLESS_ITERATE_TIMER_START(iter)
+			for (std::string_view key : lookupKeys) {
+				avl.search(key);
+			}
+		HEADLESS_ITERATE_TIMER_END("AVL String Key Lookup Test: Transparent search() of std::string_view for Each of " << size << " Keys")
+	}
+
+	//Concurrent Read/Write Mix Tests
+	{
+		size_t size = 100000;
+		size_t operationsPerThread = 1000000;
+		size_t maxThreadCount = (std::thread::hardware_concurrency() > 0) ? std::thread::hardware_concurrency() : 1;
+
+		// Runs operationsPerThread lookups on each thread, replacing every writeRatio-th lookup with an insert or a remove.
+		// Reports the total throughput of all threads.
+		auto runMix = [&](const char* treeName, size_t threadCount, size_t writeRatio, auto&& lookup, auto&& insert, auto&& remove) {
+			std::vector<std::thread> threads;
+			auto startTime = std::chrono::high_resolution_clock::now();
+			for (size_t t = 0; t < threadCount; t++) {
+				threads.emplace_back([&, t]() {
+					std::mt19937 random(static_cast<unsigned int>(t));
+					for (size_t i = 0; i < operationsPerThread; i++) {
+						const int key = static_cast<int>(random() % (2 * size));
+						if (i % writeRatio == 0) {
+							(random() % 2) ? insert(key) : remove(key);
+						}
+						else {
+							lookup(key);
+						}
+					}
+				});
+			}
+			for (std::thread& thread : threads) {
+				thread.join();
+			}
+			const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+			LOG("[" << treeName << " Read/Write Mix Test: 1 Write per " << writeRatio << " Operations on " << threadCount << " Threads]\nThroughput: "
+				<< static_cast<size_t>(threadCount * operationsPerThread / seconds) << " ops/s\n")
+		};
+
+		for (size_t writeRatio : { 10, 100 }) {
+			for (size_t threadCount = 1; threadCount <= maxThreadCount; threadCount *= 2) {
+				avl_tree<int, int> avl = AVLUtilities::CreateRandomTreeOfSize<int>(size);
+				std::mutex avlMutex;
+				runMix("Mutex Guarded AVL", threadCount, writeRatio,
+					[&](int key) { std::lock_guard<std::mutex> lock(avlMutex); avl.search(key); },
+					[&](int key) { std::lock_guard<std::mutex> lock(avlMutex); avl.insert(key, key); },
+					[&](int key) { std::lock_guard<std::mutex> lock(avlMutex); avl.remove(key); });
+
+				concurrent_avl_tree<int, int> concurrentAvl;
+				for (const avl_tree_node<int, int>& node : avl) {
+					concurrentAvl.insert(node.key, node.data);
+				}
+				runMix("Concurrent AVL", threadCount, writeRatio,
+					[&](int key) { concurrentAvl.contains(key); },
+					[&](int key) { concurrentAvl.insert(key, key); },
+					[&](int key) { concurrentAvl.remove(key); });
+
+				sharded_avl_tree<int, int> shardedAvl;
+				for (const avl_tree_node<int, int>& node : avl) {
+					shardedAvl.insert(node.key, node.data);
+				}
+				runMix("Sharded AVL", threadCount, writeRatio,
+					[&](int key) { shardedAvl.contains(key); },
+					[&](int key) { shardedAvl.insert(key, key); },
+					[&](int key) { shardedAvl.remove(key); });
+			}
+		}
 	}
 }
\ No newline at end of file
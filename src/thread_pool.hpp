@@ -0,0 +1,158 @@
+#pragma once
+#include <cstddef>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <exception>
+#include <utility>
+
+
+
+// A fixed size pool of worker threads for fork-join style recursion.
+// fork() queues a task and join() waits for it. While waiting, join() runs other queued tasks
+// on the calling thread, so tasks can fork and join subtasks without deadlocking the pool.
+class thread_pool {
+	struct TaskState {
+		std::function<void()> function;
+		std::atomic<bool> isDone = false;
+		std::exception_ptr exception;
+	};
+public:
+	// Handle to a forked task. Has to be passed to join() before it goes out of scope.
+	class task_handle {
+	public:
+		task_handle() = default;
+	private:
+		explicit task_handle(std::shared_ptr<TaskState> state)
+			: state_(std::move(state)) {}
+
+		std::shared_ptr<TaskState> state_;
+
+		friend thread_pool;
+	};
+
+	// Queues function to be run by a worker, or by a thread waiting in join().
+	template<typename Function>
+	task_handle fork(Function&& function) {
+		std::shared_ptr<TaskState> state = std::make_shared<TaskState>();
+		state->function = std::forward<Function>(function);
+		{
+			std::lock_guard<std::mutex> lock(this->mutex_);
+			this->tasks_.push_back(state);
+		}
+		this->workAvailable_.notify_one();
+		return task_handle(std::move(state));
+	}
+
+	// Waits for a forked task to finish, running queued tasks in the meantime.
+	// Rethrows the exception the task threw, if any.
+	void join(task_handle& handle) {
+		while (!handle.state_->isDone.load(std::memory_order_acquire)) {
+			std::shared_ptr<TaskState> task = this->pop_task();
+			if (task) {
+				run_task(*task);
+			}
+			else {
+				std::this_thread::yield();
+			}
+		}
+		if (handle.state_->exception) {
+			std::rethrow_exception(handle.state_->exception);
+		}
+		handle.state_.reset();
+	}
+
+	// Runs leftFunction on the pool and rightFunction on the calling thread, then waits for both.
+	template<typename LeftFunction, typename RightFunction>
+	void fork_join(LeftFunction&& leftFunction, RightFunction&& rightFunction) {
+		task_handle handle = this->fork(std::forward<LeftFunction>(leftFunction));
+		try {
+			rightFunction();
+		}
+		catch (...) {
+			this->join(handle);
+			throw;
+		}
+		this->join(handle);
+	}
+
+	// @return Number of worker threads. Threads waiting in join() help out on top of these.
+	size_t thread_count() const {
+		return this->workers_.size();
+	}
+
+	// @return A pool shared by the whole program, with one worker less than the hardware threads
+	// since the thread calling join() does work too.
+	static thread_pool& shared() {
+		static thread_pool pool((std::thread::hardware_concurrency() > 1) ? (std::thread::hardware_concurrency() - 1) : 1);
+		return pool;
+	}
+
+	thread_pool(const thread_pool& other) = delete;
+	thread_pool& operator=(const thread_pool& other) = delete;
+	~thread_pool() {
+		{
+			std::lock_guard<std::mutex> lock(this->mutex_);
+			this->isStopping_ = true;
+		}
+		this->workAvailable_.notify_all();
+		for (std::thread& worker : this->workers_) {
+			worker.join();
+		}
+	}
+
+	explicit thread_pool(size_t threadCount) {
+		for (size_t i = 0; i < threadCount; i++) {
+			this->workers_.emplace_back([this]() { this->work(); });
+		}
+	}
+private:
+	static void run_task(TaskState& task) {
+		try {
+			task.function();
+		}
+		catch (...) {
+			task.exception = std::current_exception();
+		}
+		task.isDone.store(true, std::memory_order_release);
+	}
+
+	// Takes the most recently forked task, which is the likeliest to be a subtask of what the caller is waiting on.
+	std::shared_ptr<TaskState> pop_task() {
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		if (this->tasks_.empty()) {
+			return nullptr;
+		}
+		std::shared_ptr<TaskState> task = std::move(this->tasks_.back());
+		this->tasks_.pop_back();
+		return task;
+	}
+
+	// Worker loop. Workers take the oldest tasks, which are the biggest ones in a fork-join recursion.
+	void work() {
+		while (true) {
+			std::shared_ptr<TaskState> task;
+			{
+				std::unique_lock<std::mutex> lock(this->mutex_);
+				this->workAvailable_.wait(lock, [this]() { return this->isStopping_ || !this->tasks_.empty(); });
+				if (this->tasks_.empty()) {
+					return;
+				}
+				task = std::move(this->tasks_.front());
+				this->tasks_.pop_front();
+			}
+			run_task(*task);
+		}
+	}
+
+	std::vector<std::thread> workers_;
+	std::deque<std::shared_ptr<TaskState>> tasks_;
+	std::mutex mutex_;
+	std::condition_variable workAvailable_;
+	bool isStopping_ = false;
+};